@@ -0,0 +1,570 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "gdal_priv.h"
+#include "Resample.h"
+#include "Window.h"
+#include "Upsampler.h"
+#include "Convert.h"
+#include "Kernels.h"
+
+// names of the Geotiffs of a scene written by bin/makescene
+// *********************************************************
+static const char* SCENE_FILES[5] = { "PAN.TIF","RED.TIF","GREEN.TIF","BLUE.TIF","NIR.TIF" };
+
+// pixels per window of the resampling benchmark (as the pipeline's default)
+// **************************************************************************
+static const size_t WINDOW_PIXELS = (size_t)1<<20;
+
+// define C++ structure holding one benchmark result. Its name (stage,
+// data type, method, bands) identifies it across runs, for comparisons
+// with a baseline. Pixels are panchromatic-grid pixels, and bytes are
+// those read and written by the stage.
+// ********************************************************************
+struct BenchResult {
+  std::string Name;
+  std::string Stage;
+  std::string Type;
+  std::string Method;
+  int Bands;
+  double Pixels;
+  double Bytes;
+  double Seconds;
+};
+
+void Usage() {
+  printf("                                                                         \n "
+   " ***************************************************************************** \n "
+   " NAME:                                                                         \n "
+   "  bench                                                                        \n "
+   " DESCRIPTION:                                                                  \n "
+   "  Times the stages of pan-sharpening and reports MPix/s and GB/s:             \n "
+   "   kernels  : the sharpening kernels, for every pixel type and kernel, on     \n "
+   "              pixels in memory (--pixels)                                     \n "
+   "   resample : resampling the red band of the scene (-d) to the pan grid,      \n "
+   "              with the GDAL warper and (if the grids allow) the fused         \n "
+   "              upsampler                                                       \n "
+   "   cli      : bin/pansharpen end-to-end on the scene (-d)                      \n "
+   "  Each timing is the best of --repeat runs. Scenes are made by bin/makescene.  \n "
+   " USAGE:                                                                        \n "
+   "  $ bin/bench [-d SCENE_DIR] [-z 3|4] [-j THREADS] [--stages LIST]           \n "
+   "      [--repeat N] [--pixels N] [--cli PATH] [--cli-args ARGS]                 \n "
+   "      [--json FILE] [--baseline FILE] [--tolerance PERCENT]                    \n "
+   "                                                                               \n "
+   "  --stages     comma-separated: kernels,resample,cli (default: all; only      \n "
+   "               kernels without -d)                                            \n "
+   "  --json       write the results as JSON lines (one object per result)        \n "
+   "  --baseline   compare MPix/s with the JSON lines of an earlier run, and      \n "
+   "               exit with status 1 if a result is more than --tolerance        \n "
+   "               percent (default 10) slower                                    \n "
+   " ***************************************************************************** \n\n");
+  exit(1);
+}
+
+template<typename F>
+static double BestOf( int Repeat,F&& Run ) {
+  /* *************************************************************************
+   * double BestOf( int,F&& ):
+   *
+   * This function runs Run() Repeat times and returns the shortest run time,
+   * which is the least disturbed by other activity on the machine.
+   *
+   * Args:
+   *   int : number of runs.
+   *   F&& : function to time.
+   * Returns:
+   *   double : shortest run time, in seconds.
+   */
+  double Best = 0.0;
+  for( int run=0; run<Repeat; run++ ) {
+    auto Start = std::chrono::steady_clock::now();
+    Run();
+    double Seconds = std::chrono::duration<double>( std::chrono::steady_clock::now()-Start ).count();
+    if( run == 0 || Seconds<Best ) Best = Seconds;
+  }
+  return Best;
+}
+
+template<typename T>
+static void BenchKernels( int N_bands,size_t nPixels,int Repeat,std::vector<BenchResult>& Results ) {
+  /* *************************************************************************
+   * void BenchKernels<T>( int,size_t,int,std::vector<BenchResult>& ):
+   *
+   * This function times the FIHS, Brovey, and component substitution
+   * kernels (as selected for this processor, see SelectSharpenKernel())
+   * for pixel type T on nPixels pixels in memory, and the fixed-point
+   * kernels, if T has them (see SelectFixedSharpenKernel()).
+   *
+   * Args:
+   *   int : number of bands (3 or 4).
+   *   size_t : number of pixels.
+   *   int : number of runs (the best is kept).
+   *   std::vector<BenchResult>& : results, appended to.
+   * Returns:
+   *   None. Void.
+   */
+  static const struct { const char* Name; int Kernel; } KERNELS[] = {
+    { "fihs",KERNEL_FIHS },{ "brovey",KERNEL_BROVEY },{ "cs",KERNEL_CS } };
+
+  // pseudo-random pixels within the range of every data type
+  // ********************************************************
+  unsigned Range = sizeof(T) == 1 ? 250 : 4000;
+  std::vector<T> Pan( nPixels ),MS[4];
+  for( size_t px=0; px<nPixels; px++ ) Pan[px] = (T)( 1+( px*2654435761u>>7 )%Range );
+  for( int band=0; band<N_bands; band++ ) {
+    MS[band].resize( nPixels );
+    for( size_t px=0; px<nPixels; px++ ) MS[band][px] = (T)( 1+( (px+band+1)*40503u>>3 )%Range );
+  }
+  std::vector<float> Out( (size_t)N_bands*nPixels );
+
+  SharpenParams Params;
+  for( int band=0; band<4; band++ ) {
+    Params.Weights[band] = 1.0f/N_bands;
+    Params.Gains[band]   = 1.0f;
+  }
+  Params.PanGain = 1.0f;
+  Params.PanBias = 0.0f;
+
+  SharpenArgs<T,T> Args;
+  Args.pan = Pan.data();
+  for( int band=0; band<4; band++ ) Args.ms[band] = band<N_bands ? MS[band].data() : nullptr;
+  Args.nPixels       = nPixels;
+  Args.NoDataValue   = 0.0;
+  Args.out           = Out.data();
+  Args.bandStride    = nPixels;
+  Args.Params        = &Params;
+  Args.panSubstitute = nullptr;
+
+  const char* TypeName = GDALGetDataTypeName( GDALTypeOf<T>() );
+  for( auto const& K : KERNELS ) {
+    SharpenKernel<T,T> Kernel = SelectSharpenKernel<T,T>( N_bands,K.Kernel );
+    Kernel( Args ); // warm up (page faults of the output)
+    double Seconds = BestOf( Repeat,[&]() { Kernel( Args ); } );
+    double Bytes = (double)nPixels*( (N_bands+1)*sizeof(T) + N_bands*sizeof(float) );
+    Results.push_back( { std::string( "kernel/" )+TypeName+"/"+K.Name+"/"+std::to_string( N_bands ),
+      "kernel",TypeName,K.Name,N_bands,(double)nPixels,Bytes,Seconds } );
+  }
+
+  // fixed-point kernels (Byte and UInt16), writing outputs of type T
+  // ****************************************************************
+  if constexpr ( HasFixedKernels<T>() ) {
+    std::vector<T> FixedOut( (size_t)N_bands*nPixels );
+    FixedSharpenArgs<T> Fixed = { Args.pan,{ Args.ms[0],Args.ms[1],Args.ms[2],Args.ms[3] },
+      nPixels,FixedOut.data(),nPixels };
+    for( auto const& K : KERNELS ) {
+      FixedSharpenKernel<T> Kernel = SelectFixedSharpenKernel<T>( N_bands,K.Kernel );
+      if( Kernel == nullptr ) continue;
+      Kernel( Fixed );
+      double Seconds = BestOf( Repeat,[&]() { Kernel( Fixed ); } );
+      double Bytes = (double)nPixels*( (N_bands+1)*sizeof(T) + N_bands*sizeof(T) );
+      std::string Method = std::string( K.Name )+"-fixed";
+      Results.push_back( { std::string( "kernel/" )+TypeName+"/"+Method+"/"+std::to_string( N_bands ),
+        "kernel",TypeName,Method,N_bands,(double)nPixels,Bytes,Seconds } );
+    }
+  }
+}
+
+template<typename T>
+static void UpsampleBand( GDALRasterBand* Band,GridAlignment Grid,std::vector<Window> const& Windows ) {
+  /* *************************************************************************
+   * void UpsampleBand<T>( GDALRasterBand*,GridAlignment,std::vector<Window> const& ):
+   *
+   * This function upsamples a low-resolution band to the pan grid with the
+   * fused bicubic upsampler, window by window (as the pipeline does).
+   *
+   * Args:
+   *   GDALRasterBand* : low-resolution band.
+   *   GridAlignment : alignment of the low-res and pan grids.
+   *   std::vector<Window> const& : windows of the pan grid, in order.
+   * Returns:
+   *   None. Void. Exits on failure.
+   */
+  BicubicUpsampler<T> Upsampler( Band,Grid );
+  std::vector<T> Buffer;
+  for( Window const& win : Windows ) {
+    Buffer.resize( (size_t)win.xsize*win.ysize );
+    if( Upsampler.ReadWindow( win,Buffer.data() ) != CE_None ) {
+      printf("  \n ERROR (fatal): fused upsampler failed. Exiting ... \n");
+      exit(1);
+    }
+  }
+}
+
+static void BenchResample( std::string const& SceneDir,int Repeat,std::vector<BenchResult>& Results ) {
+  /* *************************************************************************
+   * void BenchResample( std::string const&,int,std::vector<BenchResult>& ):
+   *
+   * This function times resampling the red band of a scene onto the pan
+   * grid, in full-width windows: through a warped VRT (GDAL warper), and
+   * with the fused bicubic upsampler if the grids are aligned at an
+   * integer ratio. The GDAL block cache is warm after the first run.
+   *
+   * Args:
+   *   std::string const& : directory of the scene.
+   *   int : number of runs (the best is kept).
+   *   std::vector<BenchResult>& : results, appended to.
+   * Returns:
+   *   None. Void. Exits on failure.
+   */
+  std::string PanFile = ( std::filesystem::path( SceneDir )/SCENE_FILES[0] ).string();
+  std::string RedFile = ( std::filesystem::path( SceneDir )/SCENE_FILES[1] ).string();
+  GDALDatasetH pan = GDALOpen( PanFile.c_str(),GA_ReadOnly );
+  GDALDatasetH red = GDALOpen( RedFile.c_str(),GA_ReadOnly );
+  if( pan == NULL || red == NULL ) {
+    printf("  \n ERROR (fatal): unable to open the scene in %s. Exiting ... \n",SceneDir.c_str());
+    exit(1);
+  }
+  int Cols = GDALGetRasterXSize( pan );
+  int Rows = GDALGetRasterYSize( pan );
+  GDALDataType Type = GDALGetRasterDataType( GDALGetRasterBand( pan,1 ) );
+  int TypeBytes = GDALGetDataTypeSizeBytes( Type );
+  const char* TypeName = GDALGetDataTypeName( Type );
+
+  // full-width windows of about WINDOW_PIXELS pixels
+  // ************************************************
+  int WindowRows = (int)std::max<size_t>( 1,WINDOW_PIXELS/(size_t)Cols );
+  std::vector<Window> Windows;
+  for( int yoff=0; yoff<Rows; yoff+=WindowRows ) {
+    Windows.push_back( { 0,yoff,Cols,std::min( WindowRows,Rows-yoff ) } );
+  }
+  double Pixels = (double)Cols*Rows;
+  double Bytes  = Pixels*TypeBytes
+    + (double)GDALGetRasterXSize( red )*GDALGetRasterYSize( red )*TypeBytes;
+
+  // GDAL warper (warped VRT)
+  // ************************
+  GDALDatasetH VRT = CreateResampledVRT( red,pan );
+  if( VRT == NULL ) {
+    printf("  \n ERROR (fatal): unable to create the warped VRT. Exiting ... \n");
+    exit(1);
+  }
+  std::vector<unsigned char> Buffer( (size_t)Cols*WindowRows*TypeBytes );
+  double Seconds = BestOf( Repeat,[&]() {
+    for( Window const& win : Windows ) {
+      if( GDALRasterIO( GDALGetRasterBand( VRT,1 ),GF_Read,win.xoff,win.yoff,win.xsize,win.ysize,
+            Buffer.data(),win.xsize,win.ysize,Type,0,0 ) != CE_None ) {
+        printf("  \n ERROR (fatal): warped VRT read failed. Exiting ... \n");
+        exit(1);
+      }
+    }
+  });
+  GDALClose( VRT );
+  Results.push_back( { std::string( "resample/" )+TypeName+"/warper",
+    "resample",TypeName,"warper",1,Pixels,Bytes,Seconds } );
+
+  // fused bicubic upsampler (aligned grids at an integer ratio only)
+  // ****************************************************************
+  GridAlignment Grid;
+  if( IntegerRatioAlignment( red,pan,&Grid ) ) {
+    GDALRasterBand* Band = GDALDataset::FromHandle( red )->GetRasterBand( 1 );
+    Seconds = BestOf( Repeat,[&]() {
+      switch( Type ) {
+        case GDT_Byte:    UpsampleBand<unsigned char>( Band,Grid,Windows );  break;
+        case GDT_UInt16:  UpsampleBand<unsigned short>( Band,Grid,Windows ); break;
+        case GDT_Int16:   UpsampleBand<short>( Band,Grid,Windows );          break;
+        case GDT_UInt32:  UpsampleBand<unsigned int>( Band,Grid,Windows );   break;
+        case GDT_Int32:   UpsampleBand<int>( Band,Grid,Windows );            break;
+        case GDT_Float32: UpsampleBand<float>( Band,Grid,Windows );          break;
+        case GDT_Float64: UpsampleBand<double>( Band,Grid,Windows );         break;
+        default:
+          printf("  \n ERROR (fatal): unsupported data type %s. Exiting ... \n",TypeName);
+          exit(1);
+      }
+    });
+    Results.push_back( { std::string( "resample/" )+TypeName+"/fused",
+      "resample",TypeName,"fused",1,Pixels,Bytes,Seconds } );
+  }
+  GDALClose( red );
+  GDALClose( pan );
+}
+
+static void BenchCLI( std::string const& SceneDir,int N_bands,int Threads,int Repeat,
+  std::string const& CLI,std::string const& CLIArgs,std::vector<BenchResult>& Results ) {
+  /* *************************************************************************
+   * void BenchCLI( std::string const&,int,int,int,std::string const&,
+   *   std::string const&,std::vector<BenchResult>& ):
+   *
+   * This function times bin/pansharpen end-to-end on a scene, with outputs
+   * written to a bench_out directory inside of the scene directory. The
+   * bytes are those of the input Geotiffs plus the outputs written.
+   *
+   * Args:
+   *   std::string const& : directory of the scene.
+   *   int : number of bands (-z flag).
+   *   int : number of threads (-j flag).
+   *   int : number of runs (the best is kept).
+   *   std::string const& : path of bin/pansharpen.
+   *   std::string const& : extra arguments of bin/pansharpen.
+   *   std::vector<BenchResult>& : results, appended to.
+   * Returns:
+   *   None. Void. Exits on failure.
+   */
+  std::filesystem::path Scene( SceneDir );
+  std::filesystem::path OutDir = Scene/"bench_out";
+  std::filesystem::create_directories( OutDir );
+
+  static const char* FLAGS[5] = { "-p","-r","-g","-b","-n" };
+  double InputBytes = 0.0;
+  std::string Command = CLI;
+  for( int band=0; band<=N_bands; band++ ) {
+    std::filesystem::path File = Scene/SCENE_FILES[band];
+    InputBytes += (double)std::filesystem::file_size( File );
+    Command += std::string( " " )+FLAGS[band]+" '"+File.string()+"'";
+  }
+  // the CLI requires a NIR image even for 3 output bands
+  if( N_bands == 3 ) Command += " -n '"+( Scene/SCENE_FILES[4] ).string()+"'";
+  Command += " -z "+std::to_string( N_bands )+" -j "+std::to_string( Threads )
+           + " -o '"+OutDir.string()+"' "+CLIArgs+" > /dev/null";
+
+  double Seconds = BestOf( Repeat,[&]() {
+    if( std::system( Command.c_str() ) != 0 ) {
+      printf("  \n ERROR (fatal): command failed: %s. Exiting ... \n",Command.c_str());
+      exit(1);
+    }
+  });
+
+  double OutputBytes = 0.0;
+  for( auto const& Entry : std::filesystem::directory_iterator( OutDir ) ) {
+    if( Entry.is_regular_file() ) OutputBytes += (double)Entry.file_size();
+  }
+  GDALDatasetH pan = GDALOpen( ( Scene/SCENE_FILES[0] ).string().c_str(),GA_ReadOnly );
+  if( pan == NULL ) {
+    printf("  \n ERROR (fatal): unable to open the scene in %s. Exiting ... \n",SceneDir.c_str());
+    exit(1);
+  }
+  double Pixels = (double)GDALGetRasterXSize( pan )*GDALGetRasterYSize( pan );
+  const char* TypeName = GDALGetDataTypeName( GDALGetRasterDataType( GDALGetRasterBand( pan,1 ) ) );
+  Results.push_back( { std::string( "cli/" )+TypeName+"/"+std::to_string( N_bands )+"/j"+std::to_string( Threads ),
+    "cli",TypeName,"cli",N_bands,Pixels,InputBytes+OutputBytes,Seconds } );
+  GDALClose( pan );
+}
+
+static std::string JsonField( std::string const& Line,const char* Key ) {
+  /* *************************************************************************
+   * std::string JsonField( std::string const&,const char* ):
+   *
+   * This function returns the value of a field of a flat JSON object
+   * written by WriteJSON() (string values have no escapes).
+   *
+   * Args:
+   *   std::string const& : one JSON line.
+   *   const char* : name of the field.
+   * Returns:
+   *   std::string : value of the field (without quotes), or "" if absent.
+   */
+  std::string Quoted = std::string( "\"" )+Key+"\":";
+  size_t first = Line.find( Quoted );
+  if( first == std::string::npos ) return "";
+  first = Line.find_first_not_of( ' ',first+Quoted.size() );
+  if( first == std::string::npos ) return "";
+  if( Line[first] == '"' ) {
+    size_t last = Line.find( '"',first+1 );
+    return last == std::string::npos ? "" : Line.substr( first+1,last-first-1 );
+  }
+  size_t last = Line.find_first_of( ",}",first );
+  return Line.substr( first,last == std::string::npos ? std::string::npos : last-first );
+}
+
+static void WriteJSON( const char* Filename,std::vector<BenchResult> const& Results ) {
+  /* *************************************************************************
+   * void WriteJSON( const char*,std::vector<BenchResult> const& ):
+   *
+   * This function writes the results as JSON lines, one flat object per
+   * result, with the kernel ISA and GDAL version of this run in each.
+   *
+   * Args:
+   *   const char* : name of the output file.
+   *   std::vector<BenchResult> const& : results.
+   * Returns:
+   *   None. Void. Exits on failure.
+   */
+  FILE* File = fopen( Filename,"w" );
+  if( File == NULL ) {
+    printf("  \n ERROR (fatal): unable to write %s. Exiting ... \n",Filename);
+    exit(1);
+  }
+  for( BenchResult const& R : Results ) {
+    fprintf( File,"{\"name\": \"%s\", \"stage\": \"%s\", \"type\": \"%s\", \"method\": \"%s\", "
+      "\"bands\": %d, \"pixels\": %.0f, \"bytes\": %.0f, \"seconds\": %.6f, "
+      "\"mpix_per_s\": %.3f, \"gb_per_s\": %.4f, \"isa\": \"%s\", \"gdal\": \"%s\"}\n",
+      R.Name.c_str(),R.Stage.c_str(),R.Type.c_str(),R.Method.c_str(),R.Bands,R.Pixels,R.Bytes,
+      R.Seconds,R.Pixels/R.Seconds/1e6,R.Bytes/R.Seconds/1e9,SharpenKernelISA(),
+      GDALVersionInfo( "RELEASE_NAME" ) );
+  }
+  fclose( File );
+}
+
+static int CompareBaseline( const char* Filename,double Tolerance,std::vector<BenchResult> const& Results ) {
+  /* *************************************************************************
+   * int CompareBaseline( const char*,double,std::vector<BenchResult> const& ):
+   *
+   * This function compares the MPix/s of each result with the result of
+   * the same name in a baseline (JSON lines of an earlier run), and
+   * prints those more than Tolerance percent slower.
+   *
+   * Args:
+   *   const char* : name of the baseline file.
+   *   double : tolerance, in percent.
+   *   std::vector<BenchResult> const& : results.
+   * Returns:
+   *   int : number of regressions.
+   */
+  std::ifstream File( Filename );
+  if( !File ) {
+    printf("  \n ERROR (fatal): unable to read baseline %s. Exiting ... \n",Filename);
+    exit(1);
+  }
+  std::map<std::string,double> Baseline;
+  std::string Line;
+  while( std::getline( File,Line ) ) {
+    std::string Name = JsonField( Line,"name" );
+    if( !Name.empty() ) Baseline[Name] = atof( JsonField( Line,"mpix_per_s" ).c_str() );
+  }
+
+  int Regressions = 0;
+  printf("\n  compared with %s (tolerance %.1f%%):\n",Filename,Tolerance);
+  for( BenchResult const& R : Results ) {
+    auto Base = Baseline.find( R.Name );
+    if( Base == Baseline.end() || Base->second<=0.0 ) continue;
+    double Change = 100.0*( R.Pixels/R.Seconds/1e6/Base->second-1.0 );
+    bool Regression = Change < -Tolerance;
+    if( Regression ) Regressions++;
+    printf("  %-36s %+7.1f%%%s\n",R.Name.c_str(),Change,Regression ? "  REGRESSION" : "");
+  }
+  return Regressions;
+}
+
+int main( int argc, char* argv[] )
+{
+  /* **************************************************************
+   *
+   * This is the main method of the benchmark harness. It runs the
+   * stages asked for (see Usage()), prints a table of results,
+   * and optionally writes them as JSON lines and compares them
+   * with a baseline.
+   *
+   * ************************************************************ */
+  std::string SceneDir,Stages = "kernels,resample,cli";
+  std::string CLI = "bin/pansharpen",CLIArgs;
+  const char* JsonFile = "";
+  const char* BaselineFile = "";
+  double Tolerance = 10.0;
+  int N_bands = 4,Threads = 1,Repeat = 3;
+  size_t KernelPixels = (size_t)1<<22;
+  bool StagesGiven = false;
+
+  enum { OPT_STAGES=256,OPT_REPEAT,OPT_PIXELS,OPT_CLI,OPT_CLI_ARGS,OPT_JSON,
+    OPT_BASELINE,OPT_TOLERANCE };
+  static struct option LongOptions[] = {
+    { "stages",required_argument,nullptr,OPT_STAGES },
+    { "repeat",required_argument,nullptr,OPT_REPEAT },
+    { "pixels",required_argument,nullptr,OPT_PIXELS },
+    { "cli",required_argument,nullptr,OPT_CLI },
+    { "cli-args",required_argument,nullptr,OPT_CLI_ARGS },
+    { "json",required_argument,nullptr,OPT_JSON },
+    { "baseline",required_argument,nullptr,OPT_BASELINE },
+    { "tolerance",required_argument,nullptr,OPT_TOLERANCE },
+    { nullptr,0,nullptr,0 }
+  };
+
+  // get option arguments
+  // ********************
+  int opt = 0;
+  while((opt=getopt_long(argc,argv,":hd:z:j:",LongOptions,nullptr))!=-1) {
+    switch(opt) {
+      case 'd':
+	SceneDir  = optarg;
+	break;
+      case 'z':
+	N_bands   = atoi(optarg);
+	break;
+      case 'j':
+	Threads   = atoi(optarg);
+	break;
+      case OPT_STAGES:
+	Stages    = optarg;
+	StagesGiven = true;
+	break;
+      case OPT_REPEAT:
+	Repeat    = std::max( 1,atoi(optarg) );
+	break;
+      case OPT_PIXELS:
+	KernelPixels = (size_t)std::max( 1ll,atoll(optarg) );
+	break;
+      case OPT_CLI:
+	CLI       = optarg;
+	break;
+      case OPT_CLI_ARGS:
+	CLIArgs   = optarg;
+	break;
+      case OPT_JSON:
+	JsonFile  = optarg;
+	break;
+      case OPT_BASELINE:
+	BaselineFile = optarg;
+	break;
+      case OPT_TOLERANCE:
+	Tolerance = atof(optarg);
+	break;
+      default:
+	Usage();
+    }
+  }
+  if( N_bands != 3 && N_bands != 4 ) {
+    printf("  \n ERROR (fatal): -z should be 3 or 4. Exiting ... \n");
+    exit(1);
+  }
+  if( SceneDir.empty() ) {
+    if( StagesGiven && Stages != "kernels" ) {
+      printf("  \n ERROR (fatal): the resample and cli stages need a scene (-d). Exiting ... \n");
+      exit(1);
+    }
+    Stages = "kernels";
+  }
+  Stages = ","+Stages+",";
+  GDALAllRegister();
+
+  // run the stages
+  // **************
+  std::vector<BenchResult> Results;
+  if( Stages.find( ",kernels," ) != std::string::npos ) {
+    BenchKernels<unsigned char>(  N_bands,KernelPixels,Repeat,Results );
+    BenchKernels<unsigned short>( N_bands,KernelPixels,Repeat,Results );
+    BenchKernels<short>(          N_bands,KernelPixels,Repeat,Results );
+    BenchKernels<unsigned int>(   N_bands,KernelPixels,Repeat,Results );
+    BenchKernels<int>(            N_bands,KernelPixels,Repeat,Results );
+    BenchKernels<float>(          N_bands,KernelPixels,Repeat,Results );
+    BenchKernels<double>(         N_bands,KernelPixels,Repeat,Results );
+  }
+  if( Stages.find( ",resample," ) != std::string::npos ) {
+    BenchResample( SceneDir,Repeat,Results );
+  }
+  if( Stages.find( ",cli," ) != std::string::npos ) {
+    BenchCLI( SceneDir,N_bands,Threads,Repeat,CLI,CLIArgs,Results );
+  }
+
+  // print the results
+  // *****************
+  printf("\n  kernel ISA: %s, GDAL %s, best of %d run(s)\n\n",SharpenKernelISA(),
+    GDALVersionInfo( "RELEASE_NAME" ),Repeat);
+  printf("  %-36s %10s %10s %10s\n","benchmark","seconds","MPix/s","GB/s");
+  for( BenchResult const& R : Results ) {
+    printf("  %-36s %10.4f %10.1f %10.3f\n",R.Name.c_str(),R.Seconds,
+      R.Pixels/R.Seconds/1e6,R.Bytes/R.Seconds/1e9);
+  }
+  if( strlen( JsonFile ) ) WriteJSON( JsonFile,Results );
+
+  int Status = 0;
+  if( strlen( BaselineFile ) ) Status = CompareBaseline( BaselineFile,Tolerance,Results )>0 ? 1 : 0;
+  GDALDestroyDriverManager();
+  return Status;
+}
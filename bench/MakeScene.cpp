@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "gdal.h"
+#include "cpl_string.h"
+#include "ogr_spatialref.h"
+
+// names of the Geotiffs of a synthetic scene: panchromatic first, then
+// the red, green, blue, and NIR bands (as bin/bench expects them)
+// ********************************************************************
+static const char* SCENE_FILES[5] = { "PAN.TIF","RED.TIF","GREEN.TIF","BLUE.TIF","NIR.TIF" };
+
+// name of the Geotiff holding the 4 multispectral bands together (for
+// the --ms and --ms-bands flags of bin/pansharpen)
+// *******************************************************************
+static const char* STACKED_MS_FILE = "MS.TIF";
+
+// pixel size of the panchromatic grid (meters), and the upper-left corner
+// of the scene, in UTM zone 33N (EPSG:32633)
+// ***********************************************************************
+static const double PAN_PIXEL_SIZE = 15.0;
+static const double ORIGIN_X = 500000.0;
+static const double ORIGIN_Y = 4200000.0;
+
+void Usage() {
+  printf("                                                                         \n "
+   " ***************************************************************************** \n "
+   " NAME:                                                                         \n "
+   "  makescene                                                                    \n "
+   " DESCRIPTION:                                                                  \n "
+   "  Writes a synthetic scene for benchmarks (see bin/bench): a panchromatic     \n "
+   "  Geotiff PAN.TIF and red, green, blue, and NIR Geotiffs RED.TIF, GREEN.TIF,  \n "
+   "  BLUE.TIF, and NIR.TIF, whose pixel size is --ratio times that of the pan,   \n "
+   "  and the same 4 bands stacked in one Geotiff MS.TIF (see --ms-bands).        \n "
+   "  The imagery is a smooth pattern plus pseudo-random detail, so that the      \n "
+   "  compressed sizes are realistic. The same options give the same pixels.      \n "
+   " USAGE:                                                                        \n "
+   "  $ bin/makescene -o DIR [--size COLSxROWS] [--type UInt16] [--ratio 2]       \n "
+   "      [--tiled] [--blocksize X[,Y]] [--compress NAME] [--shift] [--seed N]    \n "
+   "      [--ms-bands R,G,B,N]                                                     \n "
+   "                                                                               \n "
+   "  -o DIR        output directory (created if needed)                          \n "
+   "  --size        pan dimensions (default 8192x8192)                            \n "
+   "  --type        Byte,UInt16,Int16,UInt32,Int32,Float32,Float64 (UInt16)       \n "
+   "  --ratio       multispectral to pan pixel size ratio (default 2)             \n "
+   "  --tiled,--blocksize,--compress : GTiff creation options of all 6 images      \n "
+   "  --shift       shift the multispectral grid by half a pan pixel, so that     \n "
+   "                the GDAL warper resamples it instead of the fused upsampler   \n "
+   "  --seed        seed of the pseudo-random detail (default 1)                  \n "
+   "  --ms-bands    bands (1-based) of MS.TIF that hold the red, green, blue, and \n "
+   "                NIR bands (default 1,2,3,4; e.g. 4,3,2,1 for NIR first)       \n "
+   " ***************************************************************************** \n\n");
+  exit(1);
+}
+
+static inline double Noise( uint64_t Seed,uint64_t x,uint64_t y ) {
+  /* *************************************************************************
+   * double Noise( uint64_t,uint64_t,uint64_t ):
+   *
+   * This function hashes a pixel position (splitmix64) into a pseudo-random
+   * value in [-1,1), the same on every run and for every row order.
+   *
+   * Args:
+   *   uint64_t : seed.
+   *   uint64_t : column.
+   *   uint64_t : row.
+   * Returns:
+   *   double : pseudo-random value in [-1,1).
+   */
+  uint64_t z = Seed*0x9E3779B97F4A7C15ull + x*0xBF58476D1CE4E5B9ull + y*0x94D049BB133111EBull;
+  z = ( z^(z>>30) )*0xBF58476D1CE4E5B9ull;
+  z = ( z^(z>>27) )*0x94D049BB133111EBull;
+  z =   z^(z>>31);
+  return (double)( z>>11 )*( 2.0/9007199254740992.0 ) - 1.0;
+}
+
+static inline double SceneValue( int Band,double x,double y,uint64_t Seed,uint64_t col,uint64_t row ) {
+  /* *************************************************************************
+   * double SceneValue( int,double,double,uint64_t,uint64_t,uint64_t ):
+   *
+   * This function gives the reflectance (0 to 1) of the synthetic scene
+   * for band Band (0 = pan, 1..4 = red,green,blue,NIR) at ground position
+   * x,y (in pan pixels): a few smooth "fields" that differ per band, plus
+   * pixel-scale detail hashed from the pixel position col,row.
+   *
+   * Args:
+   *   int : band (0 = pan, 1..4 = red,green,blue,NIR).
+   *   double,double : ground position, in pan pixels.
+   *   uint64_t : seed of the detail.
+   *   uint64_t,uint64_t : pixel position (column,row) on the band's grid.
+   * Returns:
+   *   double : reflectance, 0 to 1.
+   */
+  static const double Gain[5]  = { 0.30,0.25,0.30,0.20,0.40 };
+  static const double Phase[5] = { 0.00,0.70,1.30,2.10,2.90 };
+  double Fields = std::sin( x*0.0031+Phase[Band] )*std::cos( y*0.0027 )
+                + 0.5*std::sin( ( x+y )*0.011+Phase[Band] );
+  double Detail = Band == 0 ? 0.08 : 0.03;
+  double Value  = 0.35 + Gain[Band]*0.5*Fields + Detail*Noise( Seed+Band,col,row );
+  return Value<0.0 ? 0.0 : ( Value>1.0 ? 1.0 : Value );
+}
+
+static void WriteSceneBands( std::string const& Filename,const int* Bands,int N_bands,
+  int Cols,int Rows,double PixelSize,double Shift,GDALDataType Type,char** CreationOptions,
+  const char* Projection,uint64_t Seed ) {
+  /* *************************************************************************
+   * void WriteSceneBands( std::string const&,const int*,int,int,int,double,
+   *   double,GDALDataType,char**,const char*,uint64_t ):
+   *
+   * This function writes one Geotiff of the synthetic scene, band by band
+   * in strips of rows. Pixel values are the reflectance scaled to the 
+   * data type: 0-255 for Byte and 0-4095 (12 bits, like most sensors) 
+   * else. A band has the same pixels in every Geotiff it is written to.
+   *
+   * Args:
+   *   std::string const& : name of the output Geotiff.
+   *   const int* : band of the scene (0 = pan, 1..4 = red,green,blue,
+   *                NIR) that each band of the Geotiff holds.
+   *   int : number of bands of the Geotiff.
+   *   int,int : dimensions (columns,rows).
+   *   double : pixel size, in pan pixels (1 for the pan band).
+   *   double : shift of the grid origin, in pan pixels.
+   *   GDALDataType : data type of the pixels.
+   *   char** : GTiff creation options.
+   *   const char* : projection (WKT).
+   *   uint64_t : seed of the detail.
+   * Returns:
+   *   None. Void. Exits on failure.
+   */
+  GDALDriverH Driver = GDALGetDriverByName( "GTiff" );
+  GDALDatasetH Dataset = GDALCreate( Driver,Filename.c_str(),Cols,Rows,N_bands,Type,CreationOptions );
+  if( Dataset == NULL ) {
+    printf("  \n ERROR (fatal): unable to create %s. Exiting ... \n",Filename.c_str());
+    exit(1);
+  }
+  double gt[6] = { ORIGIN_X+Shift*PAN_PIXEL_SIZE,PixelSize*PAN_PIXEL_SIZE,0.0,
+                   ORIGIN_Y-Shift*PAN_PIXEL_SIZE,0.0,-PixelSize*PAN_PIXEL_SIZE };
+  GDALSetGeoTransform( Dataset,gt );
+  GDALSetProjection( Dataset,Projection );
+
+  // write each band in strips of rows, converted from double by GDAL
+  // (which rounds and clamps to the range of the data type)
+  // *****************************************************************
+  double Scale = Type == GDT_Byte ? 255.0 : 4095.0;
+  const int STRIP_ROWS = 256;
+  std::vector<double> Strip( (size_t)Cols*STRIP_ROWS );
+  for( int band=0; band<N_bands; band++ ) {
+    GDALRasterBandH RasterBand = GDALGetRasterBand( Dataset,band+1 );
+    for( int yoff=0; yoff<Rows; yoff+=STRIP_ROWS ) {
+      int nrows = Rows-yoff<STRIP_ROWS ? Rows-yoff : STRIP_ROWS;
+      for( int row=0; row<nrows; row++ ) {
+        double y = Shift+( yoff+row+0.5 )*PixelSize;
+        double* Line = &Strip[ (size_t)row*Cols ];
+        for( int col=0; col<Cols; col++ ) {
+          double x = Shift+( col+0.5 )*PixelSize;
+          Line[col] = Scale*SceneValue( Bands[band],x,y,Seed,col,yoff+row );
+        }
+      }
+      if( GDALRasterIO( RasterBand,GF_Write,0,yoff,Cols,nrows,Strip.data(),
+            Cols,nrows,GDT_Float64,0,0 ) != CE_None ) {
+        printf("  \n ERROR (fatal): unable to write %s. Exiting ... \n",Filename.c_str());
+        exit(1);
+      }
+    }
+  }
+  GDALClose( Dataset );
+}
+
+int main( int argc, char* argv[] )
+{
+  /* **************************************************************
+   *
+   * This is the main method of the synthetic scene generator. It
+   * writes the 6 Geotiffs of a scene (see Usage()) into -o DIR.
+   *
+   * ************************************************************ */
+  const char* OutDir = "";
+  int Cols = 8192,Rows = 8192,Ratio = 2;
+  GDALDataType Type = GDT_UInt16;
+  bool Shift = false;
+  uint64_t Seed = 1;
+  int MSBands[4] = { 1,2,3,4 };
+  char** CreationOptions = nullptr;
+
+  enum { OPT_SIZE=256,OPT_TYPE,OPT_RATIO,OPT_TILED,OPT_BLOCKSIZE,OPT_COMPRESS,
+    OPT_SHIFT,OPT_SEED,OPT_MS_BANDS };
+  static struct option LongOptions[] = {
+    { "size",required_argument,nullptr,OPT_SIZE },
+    { "type",required_argument,nullptr,OPT_TYPE },
+    { "ratio",required_argument,nullptr,OPT_RATIO },
+    { "tiled",no_argument,nullptr,OPT_TILED },
+    { "blocksize",required_argument,nullptr,OPT_BLOCKSIZE },
+    { "compress",required_argument,nullptr,OPT_COMPRESS },
+    { "shift",no_argument,nullptr,OPT_SHIFT },
+    { "seed",required_argument,nullptr,OPT_SEED },
+    { "ms-bands",required_argument,nullptr,OPT_MS_BANDS },
+    { nullptr,0,nullptr,0 }
+  };
+
+  // get option arguments
+  // ********************
+  int opt = 0;
+  while((opt=getopt_long(argc,argv,":ho:",LongOptions,nullptr))!=-1) {
+    switch(opt) {
+      case 'o':
+	OutDir = optarg;
+	break;
+      case OPT_SIZE:
+	if( sscanf( optarg,"%dx%d",&Cols,&Rows ) != 2 || Cols<1 || Rows<1 ) {
+	  printf("  \n ERROR (fatal): --size should be COLSxROWS (e.g. 8192x8192). Exiting ... \n");
+	  exit(1);
+	}
+	break;
+      case OPT_TYPE:
+	Type = GDALGetDataTypeByName( optarg );
+	if( Type == GDT_Unknown || GDALDataTypeIsComplex( Type ) ) {
+	  printf("  \n ERROR (fatal): --type %s is not a supported data type. Exiting ... \n",optarg);
+	  exit(1);
+	}
+	break;
+      case OPT_RATIO:
+	Ratio = atoi(optarg);
+	if( Ratio<1 ) {
+	  printf("  \n ERROR (fatal): --ratio should be a positive integer. Exiting ... \n");
+	  exit(1);
+	}
+	break;
+      case OPT_TILED:
+	CreationOptions = CSLSetNameValue( CreationOptions,"TILED","YES" );
+	break;
+      case OPT_BLOCKSIZE: {
+	// X or X,Y (square blocks if only X is given)
+	std::string BlockSize( optarg );
+	size_t comma = BlockSize.find( ',' );
+	std::string BlockX = BlockSize.substr( 0,comma );
+	std::string BlockY = comma == std::string::npos ? BlockX : BlockSize.substr( comma+1 );
+	CreationOptions = CSLSetNameValue( CreationOptions,"BLOCKXSIZE",BlockX.c_str() );
+	CreationOptions = CSLSetNameValue( CreationOptions,"BLOCKYSIZE",BlockY.c_str() );
+	break;
+      }
+      case OPT_COMPRESS:
+	CreationOptions = CSLSetNameValue( CreationOptions,"COMPRESS",optarg );
+	break;
+      case OPT_SHIFT:
+	Shift = true;
+	break;
+      case OPT_SEED:
+	Seed = strtoull( optarg,nullptr,10 );
+	break;
+      case OPT_MS_BANDS: {
+	// a permutation of 1,2,3,4: each band of MS.TIF holds one band
+	int Used = 0;
+	if( sscanf( optarg,"%d,%d,%d,%d",&MSBands[0],&MSBands[1],&MSBands[2],&MSBands[3] ) == 4 ) {
+	  for( int band=0; band<4; band++ ) {
+	    if( MSBands[band]>=1 && MSBands[band]<=4 ) Used |= 1<<( MSBands[band]-1 );
+	  }
+	}
+	if( Used != 0xF ) {
+	  printf("  \n ERROR (fatal): --ms-bands %s should be R,G,B,N (a permutation of 1,2,3,4). Exiting ... \n",optarg);
+	  exit(1);
+	}
+	break;
+      }
+      default:
+	Usage();
+    }
+  }
+  if( !strlen( OutDir ) ) Usage();
+  std::filesystem::create_directories( OutDir );
+
+  // projection of the scene (UTM zone 33N)
+  // **************************************
+  GDALAllRegister();
+  OGRSpatialReference SRS;
+  char* Projection = nullptr;
+  SRS.importFromEPSG( 32633 );
+  SRS.exportToWkt( &Projection );
+
+  // the pan band, then the 4 multispectral bands on a grid Ratio times
+  // coarser (rounded up, so that it covers the pan extent), shifted by
+  // half a pan pixel (and one pixel larger) if asked to
+  // ******************************************************************
+  int msCols = ( Cols+Ratio-1 )/Ratio + ( Shift ? 1 : 0 );
+  int msRows = ( Rows+Ratio-1 )/Ratio + ( Shift ? 1 : 0 );
+  for( int band=0; band<5; band++ ) {
+    std::string Filename = ( std::filesystem::path( OutDir )/SCENE_FILES[band] ).string();
+    if( band == 0 ) {
+      WriteSceneBands( Filename,&band,1,Cols,Rows,1.0,0.0,Type,CreationOptions,Projection,Seed );
+    } else {
+      WriteSceneBands( Filename,&band,1,msCols,msRows,(double)Ratio,Shift ? -0.5 : 0.0,Type,
+        CreationOptions,Projection,Seed );
+    }
+    printf("  %s: %d x %d %s\n",Filename.c_str(),band == 0 ? Cols : msCols,
+      band == 0 ? Rows : msRows,GDALGetDataTypeName( Type ));
+  }
+
+  // the 4 multispectral bands stacked in one Geotiff, in the order of
+  // --ms-bands (band MSBands[k] holds red,green,blue,NIR for k=0..3)
+  // *****************************************************************
+  int Stacked[4];
+  for( int band=0; band<4; band++ ) Stacked[ MSBands[band]-1 ] = band+1;
+  std::string Filename = ( std::filesystem::path( OutDir )/STACKED_MS_FILE ).string();
+  WriteSceneBands( Filename,Stacked,4,msCols,msRows,(double)Ratio,Shift ? -0.5 : 0.0,Type,
+    CreationOptions,Projection,Seed );
+  printf("  %s: %d x %d x 4 %s (bands %d,%d,%d,%d: red,green,blue,NIR)\n",Filename.c_str(),
+    msCols,msRows,GDALGetDataTypeName( Type ),MSBands[0],MSBands[1],MSBands[2],MSBands[3]);
+  CPLFree( Projection );
+  CSLDestroy( CreationOptions );
+  GDALDestroyDriverManager();
+  return 0;
+}
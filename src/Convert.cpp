@@ -0,0 +1,88 @@
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include "Convert.h"
+
+template<typename OutT>
+static void StorePixels( const float* in,size_t nPixels,OutT* out,double scale,double offset ) {
+  /* *************************************************************************
+   * void StorePixels<OutT>( const float*,size_t,OutT*,double,double ):
+   *
+   * This function converts pan-sharpened pixels to the output data type.
+   * The stored (raw) value is ( value - offset ) / scale, so that readers
+   * recover value = raw * scale + offset (GDAL's convention). For integer
+   * types the raw value is rounded to the nearest integer (halves away
+   * from zero) and saturated (clamped) to the range of the type; NaN 
+   * becomes zero. The loop is branch-free so the compiler can vectorize.
+   *
+   * Args:
+   *   const float* : pan-sharpened pixels.
+   *   size_t : number of pixels.
+   *   OutT* : output pixels.
+   *   double : scale (non-zero).
+   *   double : offset.
+   * Returns:
+   *   None. Void.
+   */
+  double inverseScale = 1.0/scale;
+  if constexpr ( std::is_integral<OutT>::value ) {
+    const double lo = (double)std::numeric_limits<OutT>::lowest();
+    const double hi = (double)std::numeric_limits<OutT>::max();
+    for( size_t px=0; px<nPixels; px++ ) {
+      double value = ( (double)in[px]-offset )*inverseScale;
+      value = value != value ? 0.0 : value;            // NaN -> 0
+      value = value<lo ? lo : ( value>hi ? hi : value ); // saturate
+      value = value>=0.0 ? std::floor( value+0.5 ) : std::ceil( value-0.5 );
+      out[px] = (OutT)value;
+    }
+  } else {
+    for( size_t px=0; px<nPixels; px++ ) {
+      out[px] = (OutT)( ( (double)in[px]-offset )*inverseScale );
+    }
+  }
+}
+
+void StoreOutputPixels( const float* in,size_t nPixels,void* out,GDALDataType outType,
+  double scale,double offset ) {
+  /* *************************************************************************
+   * void StoreOutputPixels( const float*,size_t,void*,GDALDataType,double,
+   *   double ):
+   *
+   * This function uses a C++ switch{} statement to convert pan-sharpened
+   * (single precision) pixels to the GDAL output data type, with scale and
+   * offset, rounding, and saturation (see StorePixels() above).
+   *
+   * Args:
+   *   const float* : pan-sharpened pixels.
+   *   size_t : number of pixels.
+   *   void* : output pixels, of the output data type.
+   *   GDALDataType : output data type.
+   *   double : scale (non-zero).
+   *   double : offset.
+   * Returns:
+   *   None. Void.
+   */
+  switch( outType ) {
+    case GDT_Byte:
+      StorePixels( in,nPixels,(unsigned char*)out,scale,offset );
+      break;
+    case GDT_UInt16:
+      StorePixels( in,nPixels,(unsigned short*)out,scale,offset );
+      break;
+    case GDT_Int16:
+      StorePixels( in,nPixels,(short*)out,scale,offset );
+      break;
+    case GDT_UInt32:
+      StorePixels( in,nPixels,(unsigned int*)out,scale,offset );
+      break;
+    case GDT_Int32:
+      StorePixels( in,nPixels,(int*)out,scale,offset );
+      break;
+    case GDT_Float64:
+      StorePixels( in,nPixels,(double*)out,scale,offset );
+      break;
+    default:
+      StorePixels( in,nPixels,(float*)out,scale,offset );
+      break;
+  }
+}
@@ -0,0 +1,24 @@
+#ifndef CONVERT_H_
+#define CONVERT_H_
+#include <cstddef>
+#include <type_traits>
+#include "gdal.h"
+
+// define template function returning the GDAL data type of pixel type T
+// **********************************************************************
+template<typename T>
+inline GDALDataType GDALTypeOf() {
+  if constexpr ( std::is_same<T,unsigned char>::value  ) return GDT_Byte;
+  if constexpr ( std::is_same<T,unsigned short>::value ) return GDT_UInt16;
+  if constexpr ( std::is_same<T,short>::value          ) return GDT_Int16;
+  if constexpr ( std::is_same<T,unsigned int>::value   ) return GDT_UInt32;
+  if constexpr ( std::is_same<T,int>::value            ) return GDT_Int32;
+  if constexpr ( std::is_same<T,float>::value          ) return GDT_Float32;
+  if constexpr ( std::is_same<T,double>::value         ) return GDT_Float64;
+  return GDT_Unknown;
+}
+
+// define function prototypes
+// **************************
+void StoreOutputPixels( const float*,size_t,void*,GDALDataType,double,double );
+#endif
@@ -0,0 +1,153 @@
+#include <unistd.h>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "Journal.h"
+
+// first line of a journal (format and version)
+// ********************************************
+static const char* JOURNAL_HEADER = "pansharpen-journal 1";
+
+double CheckpointSeconds() {
+  /* *************************************************************************
+   * double CheckpointSeconds():
+   *
+   * This function returns the seconds between checkpoints of a run: 
+   * CHECKPOINT_SECONDS, or the value of the PANSHARPEN_CHECKPOINT_SECONDS
+   * environment variable (e.g. 0 to commit every window, as make check
+   * does to test --resume).
+   *
+   * Args:
+   *   None.
+   * Returns:
+   *   double : seconds between checkpoints.
+   */
+  const char* Requested = getenv( "PANSHARPEN_CHECKPOINT_SECONDS" );
+  if( Requested == nullptr ) return CHECKPOINT_SECONDS;
+  double Seconds = atof( Requested );
+  return Seconds>0.0 ? Seconds : 0.0;
+}
+
+Journal::~Journal() {
+  /* *************************************************************************
+   * Journal::~Journal():
+   *
+   * This destructor closes the journal file, leaving it on disk (so that a
+   * run that failed part of the way can be resumed, see Remove()).
+   */
+  if( File != nullptr ) fclose( File );
+}
+
+size_t Journal::Open( std::string const& Name,std::string const& Layout,bool Resume,
+  size_t N_windows,int Outputs ) {
+  /* *************************************************************************
+   * size_t Journal::Open( std::string const&,std::string const&,bool,size_t,
+   *   int ):
+   *
+   * This function opens the journal of a run. With Resume, an existing 
+   * journal with the same layout is continued, and its committed windows
+   * are returned; otherwise (or if there is no such journal) a new one is
+   * written. The layout is one line describing everything that decides 
+   * which pixels a window holds (see WritePansharpenedImagery()).
+   *
+   * Args:
+   *   std::string const& : name of the journal file.
+   *   std::string const& : layout of the run (one line).
+   *   bool : whether to resume from an existing journal (--resume flag).
+   *   size_t : number of windows of the sharpen pass.
+   *   int : number of outputs each window is written to.
+   * Returns:
+   *   size_t : number of committed windows (the first ones, in window
+   *   order), which need not be computed again. Windows are not journaled
+   *   (0 is returned) if the journal cannot be written.
+   */
+  Filename  = Name;
+  N_outputs = Outputs;
+  Committed = 0;
+
+  // a crash after the given number of committed windows, for testing
+  // --resume (PANSHARPEN_KILL_AFTER_COMMITS environment variable, see
+  // test/check.sh)
+  // ****************************************************************
+  const char* KillAfterCommits = getenv( "PANSHARPEN_KILL_AFTER_COMMITS" );
+  KillAfter = KillAfterCommits ? (size_t)strtoull( KillAfterCommits,nullptr,10 ) : 0;
+
+  // the committed windows of an existing journal of the same layout:
+  // the last "committed" line that was written in full
+  // ****************************************************************
+  if( Resume ) {
+    std::ifstream In( Filename );
+    std::string Header,RunLayout,Line;
+    if( std::getline( In,Header ) && Header == JOURNAL_HEADER &&
+        std::getline( In,RunLayout ) && RunLayout == Layout ) {
+      while( std::getline( In,Line ) ) {
+        unsigned long long Windows;
+        if( In.eof() ) break; // last line cut short
+        if( sscanf( Line.c_str(),"committed %llu",&Windows ) == 1 && Windows<=N_windows ) {
+          Committed = (size_t)Windows;
+        }
+      }
+    }
+  }
+
+  // rewrite the journal with the layout and the committed windows, and
+  // keep it open for appending
+  // ******************************************************************
+  File = fopen( Filename.c_str(),"w" );
+  if( File == nullptr ) {
+    Committed = 0;
+    return 0;
+  }
+  fprintf( File,"%s\n%s\ncommitted %llu\n",JOURNAL_HEADER,Layout.c_str(),(unsigned long long)Committed );
+  fflush( File );
+  fsync( fileno( File ) );
+  FlushedOutputs.assign( N_windows,0 );
+  for( size_t window=0; window<Committed; window++ ) FlushedOutputs[window] = N_outputs;
+  return Committed;
+}
+
+void Journal::Flushed( std::vector<size_t> const& Windows ) {
+  /* *************************************************************************
+   * void Journal::Flushed( std::vector<size_t> const& ):
+   *
+   * This function records that one output has flushed the given windows 
+   * to disk. Windows that every output has flushed are committed once all
+   * the windows before them are: if that moves the committed prefix, then
+   * it is appended to the journal, and synced to disk.
+   *
+   * Args:
+   *   std::vector<size_t> const& : windows (indices in the sharpen pass).
+   * Returns:
+   *   None. Void.
+   */
+  std::lock_guard<std::mutex> Guard( Lock );
+  if( File == nullptr ) return;
+  for( size_t window : Windows ) FlushedOutputs[window]++;
+  size_t Prefix = Committed;
+  while( Prefix<FlushedOutputs.size() && FlushedOutputs[Prefix] == N_outputs ) Prefix++;
+  if( Prefix == Committed ) return;
+  Committed = Prefix;
+  fprintf( File,"committed %llu\n",(unsigned long long)Committed );
+  fflush( File );
+  fsync( fileno( File ) );
+  if( KillAfter>0 && Committed>=KillAfter ) raise( SIGKILL );
+}
+
+void Journal::Remove() {
+  /* *************************************************************************
+   * void Journal::Remove():
+   *
+   * This function closes and deletes the journal file (once the run has 
+   * succeeded, or has failed for good).
+   *
+   * Args:
+   *   None.
+   * Returns:
+   *   None. Void.
+   */
+  std::lock_guard<std::mutex> Guard( Lock );
+  if( File != nullptr ) fclose( File );
+  File = nullptr;
+  if( !Filename.empty() ) std::remove( Filename.c_str() );
+}
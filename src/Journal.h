@@ -0,0 +1,44 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// seconds between checkpoints of the outputs of a run: every writer
+// flushes its output, and the windows it had written are committed
+// (the PANSHARPEN_CHECKPOINT_SECONDS environment variable overrides
+// it, see CheckpointSeconds())
+// *****************************************************************
+const double CHECKPOINT_SECONDS = 10.0;
+
+// define C++ class holding the journal of a run that writes Geotiffs: a
+// small sidecar text file recording how many windows of the sharpen pass
+// (in window order) are committed, i.e. flushed to every output. A run 
+// that is interrupted (e.g. preempted) leaves its journal and partial 
+// outputs behind, and a run with --resume and the same layout (size,
+// windows, bands, methods, ...) goes on from the committed windows.
+// Writer threads report the windows they have flushed (Flushed()); the
+// journal appends a line (and syncs it to disk) whenever the committed
+// prefix grows.
+// **********************************************************************
+class Journal {
+  private:
+    std::mutex Lock;
+    FILE *File = nullptr;
+    std::string Filename;
+    int N_outputs = 0;
+    std::vector<int> FlushedOutputs; // outputs that flushed each window
+    size_t Committed = 0;            // windows 0..Committed-1 are committed
+    size_t KillAfter = 0;            // simulated crash (0 for none, see Open())
+  public:
+    ~Journal();
+    size_t Open( std::string const&,std::string const&,bool,size_t,int );
+    void Flushed( std::vector<size_t> const& );
+    void Remove();
+};
+
+// define function prototypes
+// **************************
+double CheckpointSeconds();
+#endif
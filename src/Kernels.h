@@ -0,0 +1,232 @@
+#ifndef KERNELS_H_
+#define KERNELS_H_
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include "Methods.h"
+
+// define C++ structure holding the parameters of the component 
+// substitution kernels (Gram-Schmidt, PCA, and weighted or matched
+// FIHS), derived from band statistics (see Statistics.h). For each
+// pixel:
+//   I      = sum_j Weights[j]*band_j            (intensity component)
+//   out_k  = band_k + Gains[k]*( PanGain*pan + PanBias - I )
+// where PanGain and PanBias match the pan band to the mean and 
+// standard deviation of the intensity component.
+// ****************************************************************
+struct SharpenParams {
+  float Weights[4];
+  float Gains[4];
+  float PanGain;
+  float PanBias;
+};
+
+// define C++ structure holding the arguments of a pan-sharpening kernel:
+// nPixels panchromatic pixels (of type P) and the matching resampled
+// multispectral pixels (red,green,blue, and NIR, of type T) in, and the pan-sharpened pixels of
+// output band k (0-based) out at out[k*bandStride+i]. Params is only
+// used by the component substitution kernels, and panSubstitute (the
+// pan values to substitute) only by KERNEL_CS_PANF.
+// **********************************************************************
+template<typename P,typename T>
+struct SharpenArgs {
+  const P *pan;
+  const T *ms[4];
+  size_t nPixels;
+  double NoDataValue;
+  float *out;
+  size_t bandStride;
+  const SharpenParams *Params;
+  const float *panSubstitute;
+};
+
+// define pointer type of a kernel for pan pixel type P and multispectral
+// pixel type T
+// **********************************************************************
+template<typename P,typename T>
+using SharpenKernel = void (*)( SharpenArgs<P,T> const& );
+
+// define the (panchromatic, multispectral) pixel type pairs that have
+// their own kernels and pan-sharpening engine, with no per-pixel 
+// conversion of either image (see Pansharpen::PansharpenImagery()): one
+// data type for all of the imagery, or a floating-point pan image (e.g.
+// from a calibration step) with multispectral images of any other type.
+// PAIR( P,T ) is expanded once for each pair.
+// **********************************************************************
+#define PIXEL_TYPE_PAIRS( PAIR ) \
+  PAIR( unsigned char,unsigned char ) \
+  PAIR( unsigned short,unsigned short ) \
+  PAIR( short,short ) \
+  PAIR( unsigned int,unsigned int ) \
+  PAIR( int,int ) \
+  PAIR( float,float ) \
+  PAIR( double,double ) \
+  PAIR( float,unsigned char ) \
+  PAIR( float,unsigned short ) \
+  PAIR( float,short ) \
+  PAIR( float,unsigned int ) \
+  PAIR( float,int ) \
+  PAIR( float,double ) \
+  PAIR( double,unsigned char ) \
+  PAIR( double,unsigned short ) \
+  PAIR( double,short ) \
+  PAIR( double,unsigned int ) \
+  PAIR( double,int ) \
+  PAIR( double,float )
+
+template<typename P,typename T,int NB,int K>
+inline void SharpenScalar( SharpenArgs<P,T> const& Args ) {
+  /* *************************************************************************
+   * void SharpenScalar<P,T,NB,K>( SharpenArgs<P,T> const& ):
+   *
+   * This is the scalar (reference) kernel of type K (see Methods.h) 
+   * for NB output bands (3 for RGB, 4 for RGB/NIR). For each pixel:
+   *   L      = ( red+green+blue[+NIR] )/NB
+   *   FIHS   = band + ( pan - L )
+   *   Brovey = ( band / ( red+green+blue[+NIR] ) ) * pan
+   *   CS     = band + Gains[band]*( PanGain*pan + PanBias - I )
+   * computed in single precision (see SharpenParams for I). Pixels where the panchromatic value is
+   * less than zero (and not equal to the NoData value) are set to zero.
+   * The kernel type is chosen at compile time, so there are no per-pixel
+   * branches on it. The SIMD kernels (see KernelsSIMD.cpp) give 
+   * bit-identical results.
+   *
+   * Args:
+   *   SharpenArgs<P,T> const& : input and output pixels (see above).
+   * Returns:
+   *   None. Void.
+   */
+  for( size_t px=0; px<Args.nPixels; px++ ) {
+    float pan_value = (float)Args.pan[px];
+    float ms_value[NB];
+    float sum_pixels = (float)Args.ms[0][px];
+    ms_value[0] = sum_pixels;
+    for( int band=1; band<NB; band++ ) {
+      ms_value[band] = (float)Args.ms[band][px];
+      sum_pixels    += ms_value[band];
+    }
+    [[maybe_unused]] float L = sum_pixels/NB;
+
+    // component substitution: difference of the matched pan value and
+    // the intensity component (same order of operations as the SIMD 
+    // kernels, so that the results are bit-identical)
+    // ***************************************************************
+    [[maybe_unused]] float detail = 0.0f;
+    if constexpr ( IsSubstitutionKernel( K ) ) {
+      const SharpenParams& Params = *Args.Params;
+      float I = ms_value[0]*Params.Weights[0];
+      for( int band=1; band<NB; band++ ) {
+        I += ms_value[band]*Params.Weights[band];
+      }
+      float pan_substitute = pan_value;
+      if constexpr ( K == KERNEL_CS_PANF ) pan_substitute = Args.panSubstitute[px];
+      detail = ( pan_substitute*Params.PanGain+Params.PanBias ) - I;
+    }
+
+    // if the panchromatic value is NoData or less than zero, just
+    // set the out pixel value(s) to zero for all pan-sharpened bands
+    // **************************************************************
+    bool sharpen = !(pan_value<0.0) || pan_value == Args.NoDataValue;
+    for( int band=0; band<NB; band++ ) {
+      float value;
+      if constexpr ( K == KERNEL_FIHS ) {
+        value = ms_value[band] + ( pan_value - L );
+      } else if constexpr ( IsSubstitutionKernel( K ) ) {
+        value = ms_value[band] + Args.Params->Gains[band]*detail;
+      } else {
+        value = ( ms_value[band] / sum_pixels ) * pan_value;
+      }
+      Args.out[band*Args.bandStride+px] = sharpen ? value : 0.0f;
+    }
+  }
+}
+
+// define C++ structure holding the arguments of a fixed-point kernel:
+// nPixels panchromatic and resampled multispectral pixels, all of one 
+// unsigned integer type T (see HasFixedKernels()), in, and the 
+// pan-sharpened pixels of output band k, of that same type, out at
+// out[k*bandStride+i].
+// *********************************************************************
+template<typename T>
+struct FixedSharpenArgs {
+  const T *pan;
+  const T *ms[4];
+  size_t nPixels;
+  T *out;
+  size_t bandStride;
+};
+
+// define pointer type of a fixed-point kernel for pixel type T
+// ************************************************************
+template<typename T>
+using FixedSharpenKernel = void (*)( FixedSharpenArgs<T> const& );
+
+// pixel types with fixed-point (integer) FIHS and Brovey kernels: Byte
+// and UInt16 imagery. The FIHS sums fit in 32-bit integers, but the
+// Brovey product 2*band*pan does not for UInt16 (up to about 8.6e9): 
+// the scalar kernel uses 64-bit integers, and the SIMD kernels stay
+// exact by estimating the quotient from the reciprocal of the sum and
+// correcting it with the remainder, which is small even though the
+// 32-bit product it is taken from wraps. Do not replace either with a
+// plain 32-bit product and division.
+// *********************************************************************
+template<typename T>
+constexpr bool HasFixedKernels() {
+  return std::is_same<T,unsigned char>::value || std::is_same<T,unsigned short>::value;
+}
+
+template<typename T,int NB,int K>
+inline void SharpenFixedScalar( FixedSharpenArgs<T> const& Args ) {
+  /* *************************************************************************
+   * void SharpenFixedScalar<T,NB,K>( FixedSharpenArgs<T> const& ):
+   *
+   * This is the scalar (reference) fixed-point kernel of type K (FIHS or
+   * Brovey) for NB output bands and unsigned integer pixel type T. It
+   * computes the formulas of SharpenScalar() exactly, in integers, and
+   * stores each value rounded to the nearest integer (halves up) and 
+   * saturated to the range of T:
+   *   FIHS   = ( NB*( band+pan ) - sum + NB/2 ) / NB    (0 if negative)
+   *   Brovey = ( 2*band*pan + sum ) / ( 2*sum )         (0 if sum is 0)
+   * with sum = red+green+blue[+NIR]. This is the rounding of the
+   * conversion to an integer output data type (see StoreOutputPixels()),
+   * applied to the exact value rather than to a single precision one, so
+   * the two can differ by one in the last unit. Pan values are never
+   * negative, so no pixel is set to zero for NoData. The SIMD kernels 
+   * (see KernelsSIMD.cpp) give bit-identical results.
+   *
+   * Args:
+   *   FixedSharpenArgs<T> const& : input and output pixels (see above).
+   * Returns:
+   *   None. Void.
+   */
+  const int64_t MaxValue = std::numeric_limits<T>::max();
+  for( size_t px=0; px<Args.nPixels; px++ ) {
+    int64_t pan_value = Args.pan[px];
+    int64_t ms_value[NB];
+    int64_t sum_pixels = 0;
+    for( int band=0; band<NB; band++ ) {
+      ms_value[band] = Args.ms[band][px];
+      sum_pixels    += ms_value[band];
+    }
+    for( int band=0; band<NB; band++ ) {
+      int64_t value;
+      if constexpr ( K == KERNEL_FIHS ) {
+        int64_t num = NB*( ms_value[band]+pan_value )-sum_pixels+NB/2;
+        value = num>0 ? num/NB : 0;
+      } else {
+        value = sum_pixels>0 ? ( 2*ms_value[band]*pan_value+sum_pixels )/( 2*sum_pixels ) : 0;
+      }
+      Args.out[band*Args.bandStride+px] = (T)( value<MaxValue ? value : MaxValue );
+    }
+  }
+}
+
+// define function prototypes
+// **************************
+template<typename P,typename T>
+SharpenKernel<P,T> SelectSharpenKernel( int,int );
+template<typename T>
+FixedSharpenKernel<T> SelectFixedSharpenKernel( int,int );
+const char* SharpenKernelISA();
+#endif
@@ -0,0 +1,816 @@
+#include <cstdlib>
+#include <cstring>
+#include "Kernels.h"
+
+// the SIMD kernels below are only built for x86 processors. Each one
+// is compiled for its own instruction set (function target attributes),
+// so one binary runs on any x86-64 processor and picks the best kernel
+// at runtime with CPUID (see SelectSharpenKernel()).
+// *********************************************************************
+#if defined(__x86_64__) || defined(__i386__)
+#define PANSHARPEN_X86 1
+#include <immintrin.h>
+#endif
+
+// instruction sets, from slowest to fastest
+// *****************************************
+enum { ISA_SCALAR=0,ISA_SSE42,ISA_AVX2,ISA_AVX512 };
+static const char* ISA_NAMES[] = { "scalar","sse4.2","avx2","avx512" };
+
+#ifdef PANSHARPEN_X86
+
+// *************************************************************************
+// SSE4.2: 4 pixels per iteration
+// *************************************************************************
+#define TARGET_SSE42 __attribute__((target("sse4.2")))
+
+// load 4 pixels of each type and widen them to single precision
+// *************************************************************
+TARGET_SSE42 static inline __m128 LoadSSE( const unsigned char* p ) {
+  int v; memcpy( &v,p,4 );
+  return _mm_cvtepi32_ps( _mm_cvtepu8_epi32( _mm_cvtsi32_si128(v) ) );
+}
+TARGET_SSE42 static inline __m128 LoadSSE( const unsigned short* p ) {
+  return _mm_cvtepi32_ps( _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)p ) ) );
+}
+TARGET_SSE42 static inline __m128 LoadSSE( const short* p ) {
+  return _mm_cvtepi32_ps( _mm_cvtepi16_epi32( _mm_loadl_epi64( (const __m128i*)p ) ) );
+}
+TARGET_SSE42 static inline __m128 LoadSSE( const int* p ) {
+  return _mm_cvtepi32_ps( _mm_loadu_si128( (const __m128i*)p ) );
+}
+TARGET_SSE42 static inline __m128 LoadSSE( const unsigned int* p ) {
+  // no unsigned conversion before AVX-512: convert the high and low 16
+  // bits separately. Both are exact, so the sum is rounded only once,
+  // just like the scalar conversion.
+  __m128i v  = _mm_loadu_si128( (const __m128i*)p );
+  __m128  hi = _mm_cvtepi32_ps( _mm_srli_epi32( v,16 ) );
+  __m128  lo = _mm_cvtepi32_ps( _mm_and_si128( v,_mm_set1_epi32( 0xffff ) ) );
+  return _mm_add_ps( _mm_mul_ps( hi,_mm_set1_ps( 65536.0f ) ),lo );
+}
+TARGET_SSE42 static inline __m128 LoadSSE( const float* p ) {
+  return _mm_loadu_ps( p );
+}
+TARGET_SSE42 static inline __m128 LoadSSE( const double* p ) {
+  return _mm_movelh_ps( _mm_cvtpd_ps( _mm_loadu_pd( p ) ),_mm_cvtpd_ps( _mm_loadu_pd( p+2 ) ) );
+}
+
+template<typename P,typename T,int NB,int K>
+TARGET_SSE42 static void SharpenSSE42( SharpenArgs<P,T> const& Args ) {
+  const size_t W = 4;
+  size_t nVec = Args.nPixels-Args.nPixels%W;
+
+  // the NoData test (pan == NoData, in double precision) can only be
+  // true if the NoData value is exactly representable as a float
+  // *****************************************************************
+  float NoData    = (float)Args.NoDataValue;
+  bool  NoDataEq  = ( (double)NoData == Args.NoDataValue );
+  __m128 vZero    = _mm_setzero_ps();
+  __m128 vNoData  = _mm_set1_ps( NoData );
+  __m128 vNB      = _mm_set1_ps( (float)NB );
+
+  // parameters of the component substitution methods
+  // *************************************************
+  [[maybe_unused]] __m128 vWeights[NB],vGains[NB],vPanGain,vPanBias;
+  if constexpr ( IsSubstitutionKernel( K ) ) {
+    for( int band=0; band<NB; band++ ) {
+      vWeights[band] = _mm_set1_ps( Args.Params->Weights[band] );
+      vGains[band]   = _mm_set1_ps( Args.Params->Gains[band] );
+    }
+    vPanGain = _mm_set1_ps( Args.Params->PanGain );
+    vPanBias = _mm_set1_ps( Args.Params->PanBias );
+  }
+
+  for( size_t px=0; px<nVec; px+=W ) {
+    __m128 pan = LoadSSE( Args.pan+px );
+    __m128 ms[NB];
+    ms[0] = LoadSSE( Args.ms[0]+px );
+    __m128 sum = ms[0];
+    for( int band=1; band<NB; band++ ) {
+      ms[band] = LoadSSE( Args.ms[band]+px );
+      sum      = _mm_add_ps( sum,ms[band] );
+    }
+    [[maybe_unused]] __m128 diff = _mm_sub_ps( pan,_mm_div_ps( sum,vNB ) );
+
+    // component substitution: matched pan minus intensity component
+    // *************************************************************
+    [[maybe_unused]] __m128 detail;
+    if constexpr ( IsSubstitutionKernel( K ) ) {
+      __m128 I = _mm_mul_ps( ms[0],vWeights[0] );
+      for( int band=1; band<NB; band++ ) {
+        I = _mm_add_ps( I,_mm_mul_ps( ms[band],vWeights[band] ) );
+      }
+      __m128 panSubstitute = pan;
+      if constexpr ( K == KERNEL_CS_PANF ) panSubstitute = LoadSSE( Args.panSubstitute+px );
+      detail = _mm_sub_ps( _mm_add_ps( _mm_mul_ps( panSubstitute,vPanGain ),vPanBias ),I );
+    }
+
+    // mask of pixels to sharpen: !(pan<0) || pan == NoData
+    // ****************************************************
+    __m128 mask = _mm_cmpnlt_ps( pan,vZero );
+    if( NoDataEq ) mask = _mm_or_ps( mask,_mm_cmpeq_ps( pan,vNoData ) );
+
+    for( int band=0; band<NB; band++ ) {
+      __m128 value;
+      if constexpr ( K == KERNEL_FIHS ) {
+        value = _mm_add_ps( ms[band],diff );
+      } else if constexpr ( IsSubstitutionKernel( K ) ) {
+        value = _mm_add_ps( ms[band],_mm_mul_ps( vGains[band],detail ) );
+      } else {
+        value = _mm_mul_ps( _mm_div_ps( ms[band],sum ),pan );
+      }
+      _mm_storeu_ps( Args.out+band*Args.bandStride+px,_mm_and_ps( mask,value ) );
+    }
+  }
+
+  // left-over pixels
+  // ****************
+  SharpenArgs<P,T> Tail = Args;
+  Tail.pan     += nVec;
+  for( int band=0; band<NB; band++ ) Tail.ms[band] += nVec;
+  Tail.nPixels -= nVec;
+  Tail.out     += nVec;
+  if( K == KERNEL_CS_PANF ) Tail.panSubstitute += nVec;
+  SharpenScalar<P,T,NB,K>( Tail );
+}
+
+// load 4 pixels of an unsigned integer type, widened to 32-bit integers
+// *********************************************************************
+TARGET_SSE42 static inline __m128i LoadIntSSE( const unsigned char* p ) {
+  int v; memcpy( &v,p,4 );
+  return _mm_cvtepu8_epi32( _mm_cvtsi32_si128(v) );
+}
+TARGET_SSE42 static inline __m128i LoadIntSSE( const unsigned short* p ) {
+  return _mm_cvtepu16_epi32( _mm_loadl_epi64( (const __m128i*)p ) );
+}
+
+// store 4 non-negative 32-bit integers, saturated to the pixel type
+// *****************************************************************
+TARGET_SSE42 static inline void StoreIntSSE( unsigned char* p,__m128i v ) {
+  int packed = _mm_cvtsi128_si32( _mm_packus_epi16( _mm_packus_epi32( v,v ),_mm_setzero_si128() ) );
+  memcpy( p,&packed,4 );
+}
+TARGET_SSE42 static inline void StoreIntSSE( unsigned short* p,__m128i v ) {
+  _mm_storel_epi64( (__m128i*)p,_mm_packus_epi32( v,v ) );
+}
+
+// divide 4 non-negative 32-bit integers by NB (3 or 4), rounding down.
+// Division by 3 is a multiplication by 0xAAAAAAAB ( ceil(2^33/3) ) and 
+// a shift by 33, exact for every 32-bit integer.
+// ********************************************************************
+template<int NB>
+TARGET_SSE42 static inline __m128i DivideSSE( __m128i v ) {
+  if constexpr ( NB == 4 ) return _mm_srli_epi32( v,2 );
+  const __m128i Magic = _mm_set1_epi32( (int)0xAAAAAAABu );
+  __m128i even = _mm_srli_epi64( _mm_mul_epu32( v,Magic ),33 );
+  __m128i odd  = _mm_srli_epi64( _mm_mul_epu32( _mm_srli_epi64( v,32 ),Magic ),33 );
+  return _mm_or_si128( even,_mm_slli_epi64( odd,32 ) );
+}
+
+template<typename T,int NB,int K>
+TARGET_SSE42 static void SharpenFixedSSE42( FixedSharpenArgs<T> const& Args ) {
+  const size_t W = 4;
+  size_t nVec = Args.nPixels-Args.nPixels%W;
+  __m128i vZero = _mm_setzero_si128();
+  __m128i vOne  = _mm_set1_epi32( 1 );
+  __m128 vHalf  = _mm_set1_ps( 0.5f );
+
+  for( size_t px=0; px<nVec; px+=W ) {
+    __m128i pan = LoadIntSSE( Args.pan+px );
+    __m128i ms[NB];
+    ms[0] = LoadIntSSE( Args.ms[0]+px );
+    __m128i sum = ms[0];
+    for( int band=1; band<NB; band++ ) {
+      ms[band] = LoadIntSSE( Args.ms[band]+px );
+      sum      = _mm_add_epi32( sum,ms[band] );
+    }
+
+    if constexpr ( K == KERNEL_FIHS ) {
+      // ( NB*( band+pan ) - sum + NB/2 ) / NB, zero if negative
+      // *******************************************************
+      __m128i bias = _mm_sub_epi32( _mm_set1_epi32( NB/2 ),sum );
+      for( int band=0; band<NB; band++ ) {
+        __m128i x   = _mm_add_epi32( ms[band],pan );
+        __m128i num = NB == 4 ? _mm_slli_epi32( x,2 ) : _mm_add_epi32( _mm_slli_epi32( x,1 ),x );
+        num = _mm_max_epi32( _mm_add_epi32( num,bias ),vZero );
+        StoreIntSSE( Args.out+band*Args.bandStride+px,DivideSSE<NB>( num ) );
+      }
+    } else {
+      // band*pan/sum rounded half up: an estimate from the reciprocal of
+      // the sum (one division per pixel, for all bands), within one of
+      // the result, then corrected exactly with the integer remainder
+      // t = band*pan - estimate*sum (a 32-bit product, wrapping)
+      // ****************************************************************
+      __m128i sum1 = _mm_max_epi32( sum,vOne );
+      __m128i negSum1 = _mm_sub_epi32( vZero,sum1 );
+      __m128 scale = _mm_div_ps( _mm_cvtepi32_ps( pan ),_mm_cvtepi32_ps( sum1 ) );
+      for( int band=0; band<NB; band++ ) {
+        __m128i q = _mm_mullo_epi32( ms[band],pan );
+        __m128i r = _mm_cvttps_epi32( _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( ms[band] ),scale ),vHalf ) );
+        __m128i t2 = _mm_slli_epi32( _mm_sub_epi32( q,_mm_mullo_epi32( r,sum1 ) ),1 );
+        r = _mm_add_epi32( r,_mm_cmpgt_epi32( negSum1,t2 ) );                    // 2t < -sum: -1
+        r = _mm_add_epi32( r,_mm_add_epi32( _mm_cmpgt_epi32( sum1,t2 ),vOne ) ); // 2t >= sum: +1
+        StoreIntSSE( Args.out+band*Args.bandStride+px,r );
+      }
+    }
+  }
+
+  // left-over pixels
+  // ****************
+  FixedSharpenArgs<T> Tail = Args;
+  Tail.pan     += nVec;
+  for( int band=0; band<NB; band++ ) Tail.ms[band] += nVec;
+  Tail.nPixels -= nVec;
+  Tail.out     += nVec;
+  SharpenFixedScalar<T,NB,K>( Tail );
+}
+
+// *************************************************************************
+// AVX2: 8 pixels per iteration
+// *************************************************************************
+#define TARGET_AVX2 __attribute__((target("avx2")))
+
+// load 8 pixels of each type and widen them to single precision
+// *************************************************************
+TARGET_AVX2 static inline __m256 LoadAVX2( const unsigned char* p ) {
+  return _mm256_cvtepi32_ps( _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)p ) ) );
+}
+TARGET_AVX2 static inline __m256 LoadAVX2( const unsigned short* p ) {
+  return _mm256_cvtepi32_ps( _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)p ) ) );
+}
+TARGET_AVX2 static inline __m256 LoadAVX2( const short* p ) {
+  return _mm256_cvtepi32_ps( _mm256_cvtepi16_epi32( _mm_loadu_si128( (const __m128i*)p ) ) );
+}
+TARGET_AVX2 static inline __m256 LoadAVX2( const int* p ) {
+  return _mm256_cvtepi32_ps( _mm256_loadu_si256( (const __m256i*)p ) );
+}
+TARGET_AVX2 static inline __m256 LoadAVX2( const unsigned int* p ) {
+  // see LoadSSE( const unsigned int* )
+  __m256i v  = _mm256_loadu_si256( (const __m256i*)p );
+  __m256  hi = _mm256_cvtepi32_ps( _mm256_srli_epi32( v,16 ) );
+  __m256  lo = _mm256_cvtepi32_ps( _mm256_and_si256( v,_mm256_set1_epi32( 0xffff ) ) );
+  return _mm256_add_ps( _mm256_mul_ps( hi,_mm256_set1_ps( 65536.0f ) ),lo );
+}
+TARGET_AVX2 static inline __m256 LoadAVX2( const float* p ) {
+  return _mm256_loadu_ps( p );
+}
+TARGET_AVX2 static inline __m256 LoadAVX2( const double* p ) {
+  return _mm256_insertf128_ps( _mm256_castps128_ps256( _mm256_cvtpd_ps( _mm256_loadu_pd( p ) ) ),
+    _mm256_cvtpd_ps( _mm256_loadu_pd( p+4 ) ),1 );
+}
+
+template<typename P,typename T,int NB,int K>
+TARGET_AVX2 static void SharpenAVX2( SharpenArgs<P,T> const& Args ) {
+  const size_t W = 8;
+  size_t nVec = Args.nPixels-Args.nPixels%W;
+
+  // see SharpenSSE42()
+  // ******************
+  float NoData    = (float)Args.NoDataValue;
+  bool  NoDataEq  = ( (double)NoData == Args.NoDataValue );
+  __m256 vZero    = _mm256_setzero_ps();
+  __m256 vNoData  = _mm256_set1_ps( NoData );
+  __m256 vNB      = _mm256_set1_ps( (float)NB );
+
+  // parameters of the component substitution methods
+  // *************************************************
+  [[maybe_unused]] __m256 vWeights[NB],vGains[NB],vPanGain,vPanBias;
+  if constexpr ( IsSubstitutionKernel( K ) ) {
+    for( int band=0; band<NB; band++ ) {
+      vWeights[band] = _mm256_set1_ps( Args.Params->Weights[band] );
+      vGains[band]   = _mm256_set1_ps( Args.Params->Gains[band] );
+    }
+    vPanGain = _mm256_set1_ps( Args.Params->PanGain );
+    vPanBias = _mm256_set1_ps( Args.Params->PanBias );
+  }
+
+  for( size_t px=0; px<nVec; px+=W ) {
+    __m256 pan = LoadAVX2( Args.pan+px );
+    __m256 ms[NB];
+    ms[0] = LoadAVX2( Args.ms[0]+px );
+    __m256 sum = ms[0];
+    for( int band=1; band<NB; band++ ) {
+      ms[band] = LoadAVX2( Args.ms[band]+px );
+      sum      = _mm256_add_ps( sum,ms[band] );
+    }
+    [[maybe_unused]] __m256 diff = _mm256_sub_ps( pan,_mm256_div_ps( sum,vNB ) );
+
+    // component substitution: matched pan minus intensity component
+    // *************************************************************
+    [[maybe_unused]] __m256 detail;
+    if constexpr ( IsSubstitutionKernel( K ) ) {
+      __m256 I = _mm256_mul_ps( ms[0],vWeights[0] );
+      for( int band=1; band<NB; band++ ) {
+        I = _mm256_add_ps( I,_mm256_mul_ps( ms[band],vWeights[band] ) );
+      }
+      __m256 panSubstitute = pan;
+      if constexpr ( K == KERNEL_CS_PANF ) panSubstitute = LoadAVX2( Args.panSubstitute+px );
+      detail = _mm256_sub_ps( _mm256_add_ps( _mm256_mul_ps( panSubstitute,vPanGain ),vPanBias ),I );
+    }
+
+    // mask of pixels to sharpen: !(pan<0) || pan == NoData
+    // ****************************************************
+    __m256 mask = _mm256_cmp_ps( pan,vZero,_CMP_NLT_UQ );
+    if( NoDataEq ) mask = _mm256_or_ps( mask,_mm256_cmp_ps( pan,vNoData,_CMP_EQ_OQ ) );
+
+    for( int band=0; band<NB; band++ ) {
+      __m256 value;
+      if constexpr ( K == KERNEL_FIHS ) {
+        value = _mm256_add_ps( ms[band],diff );
+      } else if constexpr ( IsSubstitutionKernel( K ) ) {
+        value = _mm256_add_ps( ms[band],_mm256_mul_ps( vGains[band],detail ) );
+      } else {
+        value = _mm256_mul_ps( _mm256_div_ps( ms[band],sum ),pan );
+      }
+      _mm256_storeu_ps( Args.out+band*Args.bandStride+px,_mm256_and_ps( mask,value ) );
+    }
+  }
+
+  // left-over pixels
+  // ****************
+  SharpenArgs<P,T> Tail = Args;
+  Tail.pan     += nVec;
+  for( int band=0; band<NB; band++ ) Tail.ms[band] += nVec;
+  Tail.nPixels -= nVec;
+  Tail.out     += nVec;
+  if( K == KERNEL_CS_PANF ) Tail.panSubstitute += nVec;
+  SharpenScalar<P,T,NB,K>( Tail );
+}
+
+// load 8 pixels of an unsigned integer type, widened to 32-bit integers
+// *********************************************************************
+TARGET_AVX2 static inline __m256i LoadIntAVX2( const unsigned char* p ) {
+  return _mm256_cvtepu8_epi32( _mm_loadl_epi64( (const __m128i*)p ) );
+}
+TARGET_AVX2 static inline __m256i LoadIntAVX2( const unsigned short* p ) {
+  return _mm256_cvtepu16_epi32( _mm_loadu_si128( (const __m128i*)p ) );
+}
+
+// store 8 non-negative 32-bit integers, saturated to the pixel type 
+// (the packs work within 128-bit lanes, so gather the packed halves)
+// *****************************************************************
+TARGET_AVX2 static inline __m128i PackAVX2( __m256i v ) {
+  __m256i packed = _mm256_packus_epi32( v,v );
+  return _mm256_castsi256_si128( _mm256_permute4x64_epi64( packed,0x08 ) );
+}
+TARGET_AVX2 static inline void StoreIntAVX2( unsigned char* p,__m256i v ) {
+  __m128i packed = PackAVX2( v );
+  _mm_storel_epi64( (__m128i*)p,_mm_packus_epi16( packed,packed ) );
+}
+TARGET_AVX2 static inline void StoreIntAVX2( unsigned short* p,__m256i v ) {
+  _mm_storeu_si128( (__m128i*)p,PackAVX2( v ) );
+}
+
+// divide 8 non-negative 32-bit integers by NB (see DivideSSE())
+// *************************************************************
+template<int NB>
+TARGET_AVX2 static inline __m256i DivideAVX2( __m256i v ) {
+  if constexpr ( NB == 4 ) return _mm256_srli_epi32( v,2 );
+  const __m256i Magic = _mm256_set1_epi32( (int)0xAAAAAAABu );
+  __m256i even = _mm256_srli_epi64( _mm256_mul_epu32( v,Magic ),33 );
+  __m256i odd  = _mm256_srli_epi64( _mm256_mul_epu32( _mm256_srli_epi64( v,32 ),Magic ),33 );
+  return _mm256_or_si256( even,_mm256_slli_epi64( odd,32 ) );
+}
+
+template<typename T,int NB,int K>
+TARGET_AVX2 static void SharpenFixedAVX2( FixedSharpenArgs<T> const& Args ) {
+  const size_t W = 8;
+  size_t nVec = Args.nPixels-Args.nPixels%W;
+  __m256i vZero = _mm256_setzero_si256();
+  __m256i vOne  = _mm256_set1_epi32( 1 );
+  __m256 vHalf  = _mm256_set1_ps( 0.5f );
+
+  for( size_t px=0; px<nVec; px+=W ) {
+    __m256i pan = LoadIntAVX2( Args.pan+px );
+    __m256i ms[NB];
+    ms[0] = LoadIntAVX2( Args.ms[0]+px );
+    __m256i sum = ms[0];
+    for( int band=1; band<NB; band++ ) {
+      ms[band] = LoadIntAVX2( Args.ms[band]+px );
+      sum      = _mm256_add_epi32( sum,ms[band] );
+    }
+
+    // see SharpenFixedSSE42()
+    // ***********************
+    if constexpr ( K == KERNEL_FIHS ) {
+      __m256i bias = _mm256_sub_epi32( _mm256_set1_epi32( NB/2 ),sum );
+      for( int band=0; band<NB; band++ ) {
+        __m256i x   = _mm256_add_epi32( ms[band],pan );
+        __m256i num = NB == 4 ? _mm256_slli_epi32( x,2 ) : _mm256_add_epi32( _mm256_slli_epi32( x,1 ),x );
+        num = _mm256_max_epi32( _mm256_add_epi32( num,bias ),vZero );
+        StoreIntAVX2( Args.out+band*Args.bandStride+px,DivideAVX2<NB>( num ) );
+      }
+    } else {
+      __m256i sum1 = _mm256_max_epi32( sum,vOne );
+      __m256i negSum1 = _mm256_sub_epi32( vZero,sum1 );
+      __m256 scale = _mm256_div_ps( _mm256_cvtepi32_ps( pan ),_mm256_cvtepi32_ps( sum1 ) );
+      for( int band=0; band<NB; band++ ) {
+        __m256i q = _mm256_mullo_epi32( ms[band],pan );
+        __m256i r = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( _mm256_cvtepi32_ps( ms[band] ),scale ),vHalf ) );
+        __m256i t2 = _mm256_slli_epi32( _mm256_sub_epi32( q,_mm256_mullo_epi32( r,sum1 ) ),1 );
+        r = _mm256_add_epi32( r,_mm256_cmpgt_epi32( negSum1,t2 ) );
+        r = _mm256_add_epi32( r,_mm256_add_epi32( _mm256_cmpgt_epi32( sum1,t2 ),vOne ) );
+        StoreIntAVX2( Args.out+band*Args.bandStride+px,r );
+      }
+    }
+  }
+
+  // left-over pixels
+  // ****************
+  FixedSharpenArgs<T> Tail = Args;
+  Tail.pan     += nVec;
+  for( int band=0; band<NB; band++ ) Tail.ms[band] += nVec;
+  Tail.nPixels -= nVec;
+  Tail.out     += nVec;
+  SharpenFixedScalar<T,NB,K>( Tail );
+}
+
+// *************************************************************************
+// AVX-512 (AVX512F): 16 pixels per iteration, masked NoData handling
+// *************************************************************************
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+// GCC's AVX-512 headers start from an "undefined" register in their
+// widening conversions, which -Wmaybe-uninitialized wrongly reports
+// *****************************************************************
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// load 16 pixels of each type and widen them to single precision
+// **************************************************************
+TARGET_AVX512 static inline __m512 LoadAVX512( const unsigned char* p ) {
+  return _mm512_cvtepi32_ps( _mm512_cvtepu8_epi32( _mm_loadu_si128( (const __m128i*)p ) ) );
+}
+TARGET_AVX512 static inline __m512 LoadAVX512( const unsigned short* p ) {
+  return _mm512_cvtepi32_ps( _mm512_cvtepu16_epi32( _mm256_loadu_si256( (const __m256i*)p ) ) );
+}
+TARGET_AVX512 static inline __m512 LoadAVX512( const short* p ) {
+  return _mm512_cvtepi32_ps( _mm512_cvtepi16_epi32( _mm256_loadu_si256( (const __m256i*)p ) ) );
+}
+TARGET_AVX512 static inline __m512 LoadAVX512( const int* p ) {
+  return _mm512_cvtepi32_ps( _mm512_loadu_si512( p ) );
+}
+TARGET_AVX512 static inline __m512 LoadAVX512( const unsigned int* p ) {
+  return _mm512_cvtepu32_ps( _mm512_loadu_si512( p ) );
+}
+TARGET_AVX512 static inline __m512 LoadAVX512( const float* p ) {
+  return _mm512_loadu_ps( p );
+}
+TARGET_AVX512 static inline __m512 LoadAVX512( const double* p ) {
+  __m256 lo = _mm512_cvtpd_ps( _mm512_loadu_pd( p   ) );
+  __m256 hi = _mm512_cvtpd_ps( _mm512_loadu_pd( p+8 ) );
+  return _mm512_castpd_ps( _mm512_insertf64x4( _mm512_castpd256_pd512( 
+    _mm256_castps_pd( lo ) ),_mm256_castps_pd( hi ),1 ) );
+}
+
+template<typename P,typename T,int NB,int K>
+TARGET_AVX512 static void SharpenAVX512( SharpenArgs<P,T> const& Args ) {
+  const size_t W = 16;
+  size_t nVec = Args.nPixels-Args.nPixels%W;
+
+  // see SharpenSSE42()
+  // ******************
+  float NoData    = (float)Args.NoDataValue;
+  bool  NoDataEq  = ( (double)NoData == Args.NoDataValue );
+  __m512 vZero    = _mm512_setzero_ps();
+  __m512 vNoData  = _mm512_set1_ps( NoData );
+  __m512 vNB      = _mm512_set1_ps( (float)NB );
+
+  // parameters of the component substitution methods
+  // *************************************************
+  [[maybe_unused]] __m512 vWeights[NB],vGains[NB],vPanGain,vPanBias;
+  if constexpr ( IsSubstitutionKernel( K ) ) {
+    for( int band=0; band<NB; band++ ) {
+      vWeights[band] = _mm512_set1_ps( Args.Params->Weights[band] );
+      vGains[band]   = _mm512_set1_ps( Args.Params->Gains[band] );
+    }
+    vPanGain = _mm512_set1_ps( Args.Params->PanGain );
+    vPanBias = _mm512_set1_ps( Args.Params->PanBias );
+  }
+
+  for( size_t px=0; px<nVec; px+=W ) {
+    __m512 pan = LoadAVX512( Args.pan+px );
+    __m512 ms[NB];
+    ms[0] = LoadAVX512( Args.ms[0]+px );
+    __m512 sum = ms[0];
+    for( int band=1; band<NB; band++ ) {
+      ms[band] = LoadAVX512( Args.ms[band]+px );
+      sum      = _mm512_add_ps( sum,ms[band] );
+    }
+    [[maybe_unused]] __m512 diff = _mm512_sub_ps( pan,_mm512_div_ps( sum,vNB ) );
+
+    // component substitution: matched pan minus intensity component
+    // *************************************************************
+    [[maybe_unused]] __m512 detail;
+    if constexpr ( IsSubstitutionKernel( K ) ) {
+      __m512 I = _mm512_mul_ps( ms[0],vWeights[0] );
+      for( int band=1; band<NB; band++ ) {
+        I = _mm512_add_ps( I,_mm512_mul_ps( ms[band],vWeights[band] ) );
+      }
+      __m512 panSubstitute = pan;
+      if constexpr ( K == KERNEL_CS_PANF ) panSubstitute = LoadAVX512( Args.panSubstitute+px );
+      detail = _mm512_sub_ps( _mm512_add_ps( _mm512_mul_ps( panSubstitute,vPanGain ),vPanBias ),I );
+    }
+
+    // mask of pixels to sharpen: !(pan<0) || pan == NoData
+    // ****************************************************
+    __mmask16 mask = _mm512_cmp_ps_mask( pan,vZero,_CMP_NLT_UQ );
+    if( NoDataEq ) mask |= _mm512_cmp_ps_mask( pan,vNoData,_CMP_EQ_OQ );
+
+    for( int band=0; band<NB; band++ ) {
+      __m512 value;
+      if constexpr ( K == KERNEL_FIHS ) {
+        value = _mm512_add_ps( ms[band],diff );
+      } else if constexpr ( IsSubstitutionKernel( K ) ) {
+        value = _mm512_add_ps( ms[band],_mm512_mul_ps( vGains[band],detail ) );
+      } else {
+        value = _mm512_mul_ps( _mm512_div_ps( ms[band],sum ),pan );
+      }
+      _mm512_storeu_ps( Args.out+band*Args.bandStride+px,_mm512_maskz_mov_ps( mask,value ) );
+    }
+  }
+
+  // left-over pixels
+  // ****************
+  SharpenArgs<P,T> Tail = Args;
+  Tail.pan     += nVec;
+  for( int band=0; band<NB; band++ ) Tail.ms[band] += nVec;
+  Tail.nPixels -= nVec;
+  Tail.out     += nVec;
+  if( K == KERNEL_CS_PANF ) Tail.panSubstitute += nVec;
+  SharpenScalar<P,T,NB,K>( Tail );
+}
+
+// load 16 pixels of an unsigned integer type, widened to 32-bit integers
+// **********************************************************************
+TARGET_AVX512 static inline __m512i LoadIntAVX512( const unsigned char* p ) {
+  return _mm512_cvtepu8_epi32( _mm_loadu_si128( (const __m128i*)p ) );
+}
+TARGET_AVX512 static inline __m512i LoadIntAVX512( const unsigned short* p ) {
+  return _mm512_cvtepu16_epi32( _mm256_loadu_si256( (const __m256i*)p ) );
+}
+
+// store 16 non-negative 32-bit integers, saturated to the pixel type
+// ******************************************************************
+TARGET_AVX512 static inline void StoreIntAVX512( unsigned char* p,__m512i v ) {
+  _mm_storeu_si128( (__m128i*)p,_mm512_cvtusepi32_epi8( v ) );
+}
+TARGET_AVX512 static inline void StoreIntAVX512( unsigned short* p,__m512i v ) {
+  _mm256_storeu_si256( (__m256i*)p,_mm512_cvtusepi32_epi16( v ) );
+}
+
+// divide 16 non-negative 32-bit integers by NB (see DivideSSE())
+// **************************************************************
+template<int NB>
+TARGET_AVX512 static inline __m512i DivideAVX512( __m512i v ) {
+  if constexpr ( NB == 4 ) return _mm512_srli_epi32( v,2 );
+  const __m512i Magic = _mm512_set1_epi32( (int)0xAAAAAAABu );
+  __m512i even = _mm512_srli_epi64( _mm512_mul_epu32( v,Magic ),33 );
+  __m512i odd  = _mm512_srli_epi64( _mm512_mul_epu32( _mm512_srli_epi64( v,32 ),Magic ),33 );
+  return _mm512_or_si512( even,_mm512_slli_epi64( odd,32 ) );
+}
+
+template<typename T,int NB,int K>
+TARGET_AVX512 static void SharpenFixedAVX512( FixedSharpenArgs<T> const& Args ) {
+  const size_t W = 16;
+  size_t nVec = Args.nPixels-Args.nPixels%W;
+  __m512i vZero = _mm512_setzero_si512();
+  __m512i vOne  = _mm512_set1_epi32( 1 );
+  __m512 vHalf  = _mm512_set1_ps( 0.5f );
+
+  for( size_t px=0; px<nVec; px+=W ) {
+    __m512i pan = LoadIntAVX512( Args.pan+px );
+    __m512i ms[NB];
+    ms[0] = LoadIntAVX512( Args.ms[0]+px );
+    __m512i sum = ms[0];
+    for( int band=1; band<NB; band++ ) {
+      ms[band] = LoadIntAVX512( Args.ms[band]+px );
+      sum      = _mm512_add_epi32( sum,ms[band] );
+    }
+
+    // see SharpenFixedSSE42()
+    // ***********************
+    if constexpr ( K == KERNEL_FIHS ) {
+      __m512i bias = _mm512_sub_epi32( _mm512_set1_epi32( NB/2 ),sum );
+      for( int band=0; band<NB; band++ ) {
+        __m512i x   = _mm512_add_epi32( ms[band],pan );
+        __m512i num = NB == 4 ? _mm512_slli_epi32( x,2 ) : _mm512_add_epi32( _mm512_slli_epi32( x,1 ),x );
+        num = _mm512_max_epi32( _mm512_add_epi32( num,bias ),vZero );
+        StoreIntAVX512( Args.out+band*Args.bandStride+px,DivideAVX512<NB>( num ) );
+      }
+    } else {
+      __m512i sum1 = _mm512_max_epi32( sum,vOne );
+      __m512i negSum1 = _mm512_sub_epi32( vZero,sum1 );
+      __m512 scale = _mm512_div_ps( _mm512_cvtepi32_ps( pan ),_mm512_cvtepi32_ps( sum1 ) );
+      for( int band=0; band<NB; band++ ) {
+        __m512i q = _mm512_mullo_epi32( ms[band],pan );
+        __m512i r = _mm512_cvttps_epi32( _mm512_add_ps( _mm512_mul_ps( _mm512_cvtepi32_ps( ms[band] ),scale ),vHalf ) );
+        __m512i t2 = _mm512_slli_epi32( _mm512_sub_epi32( q,_mm512_mullo_epi32( r,sum1 ) ),1 );
+        r = _mm512_mask_sub_epi32( r,_mm512_cmpgt_epi32_mask( negSum1,t2 ),r,vOne );
+        r = _mm512_mask_add_epi32( r,_mm512_cmpge_epi32_mask( t2,sum1 ),r,vOne );
+        StoreIntAVX512( Args.out+band*Args.bandStride+px,r );
+      }
+    }
+  }
+
+  // left-over pixels
+  // ****************
+  FixedSharpenArgs<T> Tail = Args;
+  Tail.pan     += nVec;
+  for( int band=0; band<NB; band++ ) Tail.ms[band] += nVec;
+  Tail.nPixels -= nVec;
+  Tail.out     += nVec;
+  SharpenFixedScalar<T,NB,K>( Tail );
+}
+#pragma GCC diagnostic pop
+#endif
+
+static int DetectISA() {
+  /* *************************************************************************
+   * int DetectISA():
+   *
+   * This function returns the fastest instruction set supported by this
+   * processor (CPUID). The PANSHARPEN_ISA environment variable (scalar,
+   * sse4.2, avx2, or avx512) can lower it, e.g. to compare kernels.
+   *
+   * Args:
+   *   None.
+   * Returns:
+   *   int : one of ISA_SCALAR,ISA_SSE42,ISA_AVX2, or ISA_AVX512.
+   */
+  int isa = ISA_SCALAR;
+#ifdef PANSHARPEN_X86
+  __builtin_cpu_init();
+  if( __builtin_cpu_supports( "avx512f" ) ) {
+    isa = ISA_AVX512;
+  } else if( __builtin_cpu_supports( "avx2" ) ) {
+    isa = ISA_AVX2;
+  } else if( __builtin_cpu_supports( "sse4.2" ) ) {
+    isa = ISA_SSE42;
+  }
+#endif
+  const char* Requested = getenv( "PANSHARPEN_ISA" );
+  if( Requested != nullptr ) {
+    for( int candidate=ISA_SCALAR; candidate<isa; candidate++ ) {
+      if( strcmp( Requested,ISA_NAMES[candidate] ) == 0 ) isa = candidate;
+    }
+  }
+  return isa;
+}
+
+static int SelectedISA() {
+  static const int isa = DetectISA();
+  return isa;
+}
+
+const char* SharpenKernelISA() {
+  /* *************************************************************************
+   * const char* SharpenKernelISA():
+   *
+   * Returns:
+   *   const char* : name of the instruction set of the selected kernels.
+   */
+  return ISA_NAMES[ SelectedISA() ];
+}
+
+template<typename P,typename T,int NB,int K>
+static SharpenKernel<P,T> KernelForISA( int isa ) {
+  /* *************************************************************************
+   * SharpenKernel<P,T> KernelForISA<P,T,NB,K>( int ):
+   *
+   * This function returns the kernel of type K for pan pixel type P,
+   * multispectral pixel type T, and NB output bands, compiled for the
+   * given instruction set.
+   *
+   * Args:
+   *   int : instruction set (ISA_SCALAR,ISA_SSE42,ISA_AVX2, or ISA_AVX512).
+   * Returns:
+   *   SharpenKernel<P,T> : pointer to the kernel.
+   */
+  switch( isa ) {
+#ifdef PANSHARPEN_X86
+    case ISA_AVX512:
+      return SharpenAVX512<P,T,NB,K>;
+    case ISA_AVX2:
+      return SharpenAVX2<P,T,NB,K>;
+    case ISA_SSE42:
+      return SharpenSSE42<P,T,NB,K>;
+#endif
+    default:
+      return SharpenScalar<P,T,NB,K>;
+  }
+}
+
+template<typename P,typename T,int NB>
+static SharpenKernel<P,T> KernelForType( int Kernel,int isa ) {
+  /* *************************************************************************
+   * SharpenKernel<P,T> KernelForType<P,T,NB>( int,int ):
+   *
+   * This function returns the kernel of a kernel type (see Methods.h) for
+   * pan pixel type P, multispectral pixel type T, and NB output bands, 
+   * compiled for the given instruction set.
+   *
+   * Args:
+   *   int : kernel type (see SharpenKernelType).
+   *   int : instruction set.
+   * Returns:
+   *   SharpenKernel<P,T> : pointer to the kernel.
+   */
+  switch( Kernel ) {
+    case KERNEL_BROVEY:
+      return KernelForISA<P,T,NB,KERNEL_BROVEY>( isa );
+    case KERNEL_CS:
+      return KernelForISA<P,T,NB,KERNEL_CS>( isa );
+    case KERNEL_CS_PANF:
+      return KernelForISA<P,T,NB,KERNEL_CS_PANF>( isa );
+    default:
+      return KernelForISA<P,T,NB,KERNEL_FIHS>( isa );
+  }
+}
+
+template<typename P,typename T>
+SharpenKernel<P,T> SelectSharpenKernel( int N_bands,int Kernel ) {
+  /* *************************************************************************
+   * SharpenKernel<P,T> SelectSharpenKernel<P,T>( int,int ):
+   *
+   * This function returns the fastest kernel of a kernel type (see 
+   * Methods.h) for pan pixel type P, multispectral pixel type T, and 
+   * N_bands output bands (3 or 4) that this processor supports.
+   *
+   * Args:
+   *   int : number of output bands (3 or 4).
+   *   int : kernel type (see SharpenKernelType).
+   * Returns:
+   *   SharpenKernel<P,T> : pointer to the kernel.
+   */
+  if( N_bands == 4 ) {
+    return KernelForType<P,T,4>( Kernel,SelectedISA() );
+  }
+  return KernelForType<P,T,3>( Kernel,SelectedISA() );
+}
+
+// explicit instantiations for each pair of pixel types of the 
+// pan-sharpening (see PIXEL_TYPE_PAIRS)
+// ************************************************************
+#define INSTANTIATE_KERNELS( P,T ) \
+  template SharpenKernel<P,T> SelectSharpenKernel<P,T>( int,int );
+PIXEL_TYPE_PAIRS( INSTANTIATE_KERNELS )
+
+template<typename T,int NB,int K>
+static FixedSharpenKernel<T> FixedKernelForISA( int isa ) {
+  /* *************************************************************************
+   * FixedSharpenKernel<T> FixedKernelForISA<T,NB,K>( int ):
+   *
+   * This function returns the fixed-point kernel of type K (FIHS or 
+   * Brovey) for pixel type T and NB output bands, compiled for the given
+   * instruction set.
+   *
+   * Args:
+   *   int : instruction set (ISA_SCALAR,ISA_SSE42,ISA_AVX2, or ISA_AVX512).
+   * Returns:
+   *   FixedSharpenKernel<T> : pointer to the kernel.
+   */
+  switch( isa ) {
+#ifdef PANSHARPEN_X86
+    case ISA_AVX512:
+      return SharpenFixedAVX512<T,NB,K>;
+    case ISA_AVX2:
+      return SharpenFixedAVX2<T,NB,K>;
+    case ISA_SSE42:
+      return SharpenFixedSSE42<T,NB,K>;
+#endif
+    default:
+      return SharpenFixedScalar<T,NB,K>;
+  }
+}
+
+template<typename T>
+FixedSharpenKernel<T> SelectFixedSharpenKernel( int N_bands,int Kernel ) {
+  /* *************************************************************************
+   * FixedSharpenKernel<T> SelectFixedSharpenKernel<T>( int,int ):
+   *
+   * This function returns the fastest fixed-point kernel of a kernel type
+   * for pixel type T (see HasFixedKernels()) and N_bands output bands (3
+   * or 4) that this processor supports. Only FIHS and Brovey have 
+   * fixed-point kernels; the component substitution kernels, with their
+   * real-valued weights and gains, stay in single precision.
+   *
+   * Args:
+   *   int : number of output bands (3 or 4).
+   *   int : kernel type (see SharpenKernelType).
+   * Returns:
+   *   FixedSharpenKernel<T> : pointer to the kernel, or nullptr if the 
+   *   kernel type has no fixed-point kernel.
+   */
+  int isa = SelectedISA();
+  switch( Kernel ) {
+    case KERNEL_FIHS:
+      return N_bands == 4 ? FixedKernelForISA<T,4,KERNEL_FIHS>( isa ) : FixedKernelForISA<T,3,KERNEL_FIHS>( isa );
+    case KERNEL_BROVEY:
+      return N_bands == 4 ? FixedKernelForISA<T,4,KERNEL_BROVEY>( isa ) : FixedKernelForISA<T,3,KERNEL_BROVEY>( isa );
+    default:
+      return nullptr;
+  }
+}
+template FixedSharpenKernel<unsigned char>  SelectFixedSharpenKernel<unsigned char>( int,int );
+template FixedSharpenKernel<unsigned short> SelectFixedSharpenKernel<unsigned short>( int,int );
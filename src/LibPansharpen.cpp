@@ -0,0 +1,123 @@
+#include <map>
+#include <string>
+#include "LibPansharpen.h"
+typedef std::string String;
+
+// keys and names of the multispectral rasters, in the order of the
+// output bands (red,green,blue, and NIR)
+// ****************************************************************
+static const char* MS_KEYS[4]  = { "red","green","blue","nir" };
+static const char* MS_NAMES[4] = { "red","green","blue","NIR" };
+
+static void CheckRaster( PansharpenRaster const& Raster,const String& Name,int Bands ) {
+  /* *************************************************************************
+   * void CheckRaster( PansharpenRaster const&,const String&,int ):
+   *
+   * This function makes sure that a raster held in memory has pixels, a
+   * size, a supported (real) data type, and at least Bands bands.
+   *
+   * Args:
+   *   PansharpenRaster const& : raster to check.
+   *   const String& : name of the raster (for error messages).
+   *   int : number of bands needed.
+   * Returns:
+   *   None. Void. Throws PansharpenError if the raster is not valid.
+   */
+  if( Raster.Data == nullptr || Raster.Cols<1 || Raster.Rows<1 ) {
+    throw PansharpenError( Name+" raster has no pixels." );
+  }
+  if( Raster.Type == GDT_Unknown || GDALDataTypeIsComplex( Raster.Type ) ) {
+    throw PansharpenError( Name+" raster has an unsupported data type." );
+  }
+  if( Raster.Bands<Bands ) {
+    throw PansharpenError( Name+" raster should have "+std::to_string( Bands )+" bands." );
+  }
+}
+
+void PansharpenBuffers( PansharpenRaster const& Pan,const PansharpenRaster* MS,int N_bands,
+  const PansharpenRaster* Outputs,PansharpenOptions const& Options ) {
+  /* *************************************************************************
+   * void PansharpenBuffers( PansharpenRaster const&,const PansharpenRaster*,
+   *   int,const PansharpenRaster*,PansharpenOptions const& ):
+   *
+   * This function pan-sharpens imagery held in memory by the caller: a
+   * panchromatic raster, and N_bands multispectral rasters (red,green,
+   * blue, and NIR for 4 bands) of the same data type at any resolution.
+   * The panchromatic raster has that data type too, or a floating-point
+   * one (see PIXEL_TYPE_PAIRS). A multispectral raster without a geotransform is taken to cover the
+   * same extent as the panchromatic raster. Each selected method (see 
+   * Options.Methods) writes its N_bands pan-sharpened bands into its 
+   * output raster, Outputs[method], of the size of the panchromatic 
+   * raster (or of its region of interest, see Options.RegionWindow and
+   * Options.RegionBBox); all of them must have the same data type.
+   *
+   * Args:
+   *   PansharpenRaster const& : panchromatic raster.
+   *   const PansharpenRaster* : multispectral rasters (N_bands of them).
+   *   int : number of bands (3 for RGB, 4 for RGB/NIR).
+   *   const PansharpenRaster* : output rasters, indexed by method (see
+   *     SharpenMethod); only those of the selected methods are used.
+   *   PansharpenOptions const& : options of the pan-sharpening.
+   * Returns:
+   *   None. Void. Throws PansharpenError if the rasters are not valid or
+   *   the pan-sharpening fails.
+   */
+  GDALAllRegister();
+  if( N_bands != 3 && N_bands != 4 ) {
+    throw PansharpenError( "number of bands should be 3 or 4." );
+  }
+  if( Options.Methods == 0 ) {
+    throw PansharpenError( "no pan-sharpening method selected." );
+  }
+
+  // the panchromatic and multispectral rasters, with the same keys as
+  // the image filenames of bin/pansharpen. The grid of a multispectral
+  // raster without a geotransform spans the panchromatic extent.
+  // *****************************************************************
+  CheckRaster( Pan,"panchromatic",1 );
+  std::map<String,PansharpenRaster> Imagery;
+  Imagery[ "pan" ] = Pan;
+  for( int band=0; band<N_bands; band++ ) {
+    PansharpenRaster Raster = MS[band];
+    CheckRaster( Raster,MS_NAMES[band],1 );
+    if( Raster.Type != MS[0].Type ) {
+      throw PansharpenError( String( MS_NAMES[band] )+" raster should have the data type of the red raster." );
+    }
+    if( !Raster.HasGeoTransform ) {
+      Raster.GeoTransform[0] = Pan.GeoTransform[0];
+      Raster.GeoTransform[1] = Pan.GeoTransform[1]*Pan.Cols/Raster.Cols;
+      Raster.GeoTransform[2] = 0.0;
+      Raster.GeoTransform[3] = Pan.GeoTransform[3];
+      Raster.GeoTransform[4] = 0.0;
+      Raster.GeoTransform[5] = Pan.GeoTransform[5]*Pan.Rows/Raster.Rows;
+      Raster.Projection      = Pan.Projection;
+    }
+    Imagery[ MS_KEYS[band] ] = Raster;
+  }
+
+  // output rasters of the selected methods: the size of the pan raster
+  // (the size of a region of interest is checked once it is resolved),
+  // and one data type (the output data type)
+  // *******************************************************************
+  bool HasRegion = Options.HasRegionWindow || Options.HasRegionBBox;
+  PansharpenOptions MemoryOptions = Options;
+  MemoryOptions.OutputType = GDT_Unknown;
+  for( int method=0; method<N_METHODS; method++ ) {
+    if( !( Options.Methods & ( 1u<<method ) ) ) continue;
+    PansharpenRaster const& Output = Outputs[method];
+    String Name = String( SHARPEN_METHODS[method].Label )+" output";
+    CheckRaster( Output,Name,N_bands );
+    if( !HasRegion && ( Output.Cols != Pan.Cols || Output.Rows != Pan.Rows ) ) {
+      throw PansharpenError( Name+" raster should have the size of the panchromatic raster." );
+    }
+    if( MemoryOptions.OutputType != GDT_Unknown && Output.Type != MemoryOptions.OutputType ) {
+      throw PansharpenError( "output rasters should all have the same data type." );
+    }
+    MemoryOptions.OutputType = Output.Type;
+  }
+  MemoryOptions.ResampleToDisk = false;
+  MemoryOptions.CreationOptions.clear();
+
+  Pansharpen PansharpenObj( Imagery,Outputs,MemoryOptions );
+  PansharpenObj.PansharpenImagery( N_bands,"" );
+}
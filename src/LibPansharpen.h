@@ -0,0 +1,31 @@
+#ifndef LIBPANSHARPEN_H_
+#define LIBPANSHARPEN_H_
+#include "Pansharpen.h"
+
+// public API of libpansharpen (lib/libpansharpen.a, lib/libpansharpen.so):
+// pan-sharpening of imagery that the caller already holds in memory. The
+// caller owns every buffer; the library neither copies the inputs (beyond
+// the window buffers of the pipeline, and not even those for packed rows 
+// already on the panchromatic grid) nor allocates the outputs. The options
+// are those of bin/pansharpen (see PansharpenOptions), except that there
+// are no files: resampling to disk and GTiff creation options do not apply,
+// and the output data type is that of the output rasters. Errors are 
+// thrown as PansharpenError.
+//
+//   PansharpenRaster Pan,MS[4],Outputs[N_METHODS];
+//   Pan.Data = panPixels;  Pan.Type = GDT_UInt16;
+//   Pan.Cols = 8000;       Pan.Rows = 8000;
+//   ... MS[0..2] (red,green,blue) of 4000 x 4000 pixels ...
+//   Outputs[METHOD_BROVEY].Data  = sharpened; // 3 bands of 8000 x 8000
+//   Outputs[METHOD_BROVEY].Type  = GDT_Float32;
+//   Outputs[METHOD_BROVEY].Bands = 3; ...
+//   PansharpenOptions Options;
+//   Options.Methods = 1u<<METHOD_BROVEY;
+//   PansharpenBuffers( Pan,MS,3,Outputs,Options );
+// *************************************************************************
+
+// define function prototypes
+// **************************
+void PansharpenBuffers( PansharpenRaster const&,const PansharpenRaster*,int,
+  const PansharpenRaster*,PansharpenOptions const& );
+#endif
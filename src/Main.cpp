@@ -3,12 +3,24 @@
 #include <stdlib.h>
 #include <filesystem>
 #include <map>
+#include <memory>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <string>
+#include <getopt.h>
+#include <strings.h>
 #include "gdal.h"
 #include "cpl_conv.h"
 #include "Resample.h"
 #include "Pansharpen.h"
+#include "Parallel.h"
+#include "Manifest.h"
+#include "Memory.h"
+#include "Timing.h"
+#include "Shard.h"
+#include "Preview.h"
 
 void Usage() {
   printf("                                                                         \n "
@@ -28,7 +40,8 @@ void Usage() {
    "   Data from five 1-band Geotiffs are necessary to run this program.           \n "
    "   These Geotiffs are a panchromatic image file (high-res.) and the            \n "
    "   Geotiffs holding pixel data for the red, green, blue, and NIR bands.        \n "
-   "   All input images should have same data-type (e.g. short).                   \n "
+   "   All input images should have same data-type (e.g. short), except that       \n "
+   "   the panchromatic image may be floating-point (Float32, Float64).            \n "
    " OUTPUTS:                                                                      \n "
    "   Two 4-band Geotiff image files holding the pan-sharpened image bands        \n "
    "   for the pan-sharpened red, green, blue, and NIR bands. Their geotransform   \n "
@@ -45,6 +58,57 @@ void Usage() {
    "     -b blue.tif                                                               \n "
    "     -z 3                                                                      \n "
    "     -o $(pwd)                                                                 \n "
+   "   multi-band multispectral Geotiff (instead of -r,-g,-b,-n):                  \n "
+   "     [--ms FILE]           one Geotiff holding the multispectral bands         \n "
+   "     [--ms-bands R,G,B[,N]]  its bands (1-based) that are the red, green,      \n "
+   "                           blue, and NIR bands (default: 1,2,3,4)              \n "
+   "     [-w rows]  window height in rows (rounded up to block multiples)          \n "
+   "     [-t cols]  window (tile) width in columns (default: full width)           \n "
+   "     [-j N]     number of worker threads (default 1, 0 for all cores)          \n "
+   "     [--resample-to-disk] write resampled *_resampled.tif files (fallback)     \n "
+   "     [--no-fused-upsample] always use the generic GDAL warper to resample      \n "
+   "     [--resume] go on from the windows an interrupted run committed            \n "
+   "     [--preview SIZE|ovK]  quick-look at most SIZE pixels wide/high, or at     \n "
+   "                           overview level K, into sharpened_*.preview.tif      \n "
+   "     [--method LIST]  methods to run: fihs, brovey, gs (Gram-Schmidt), pca,  \n "
+   "                      or all (default: fihs,brovey)                          \n "
+   "     [--fihs-weights R,G,B[,N]]  FIHS intensity weights (default: equal)    \n "
+   "     [--pan-match MODE]  match pan to the FIHS intensity: none (default),    \n "
+   "                      meanstd, or histogram                                 \n "
+   "     [--ot TYPE]   output data type: Float32 (default), Byte, UInt16, Int16,   \n "
+   "                   UInt32, Int32, Float64, or native (input data type)         \n "
+   "     [--scale S]   stored value = (value - offset) / S (default 1)             \n "
+   "     [--offset O]  (default 0); integer outputs are rounded and saturated      \n "
+   "   output Geotiff (GTiff) creation options:                                    \n "
+   "     [--co NAME=VALUE]     any GTiff creation option (may be repeated)         \n "
+   "     [--tiled]             tiled output (TILED=YES)                            \n "
+   "     [--blocksize X[,Y]]   block (tile) size (BLOCKXSIZE/BLOCKYSIZE)           \n "
+   "     [--compress ALG]      DEFLATE, ZSTD, LZW, LERC, ... (COMPRESS)            \n "
+   "     [--predictor N]       1, 2, or 3 (PREDICTOR)                              \n "
+   "     [--bigtiff MODE]      YES, NO, IF_NEEDED, IF_SAFER (BIGTIFF)              \n "
+   "     [--num-threads N]     threads for compression, or ALL_CPUS (NUM_THREADS)  \n "
+   "   batch mode (instead of -p,-r,-g,-b,-n,-o):                                  \n "
+   "     [--batch FILE]        manifest of scenes, one per line: CSV                \n "
+   "                           pan,red,green,blue,nir,output (optional header row) \n "
+   "                           or JSON {\"pan\":..,\"red\":..,..,\"output\":..}      \n "
+   "     [--batch-jobs N]      scenes at a time, sharing the -j threads            \n "
+   "                           (default: one scene per thread)                     \n "
+   "     [--gdal-cache MB]     GDAL block cache size for the whole process         \n "
+   "   memory:                                                                     \n "
+   "     [--max-memory MB]     memory budget: sizes the GDAL cache (1/4 unless     \n "
+   "                           --gdal-cache), windows, queue depths, and threads   \n "
+   "   region of interest (only it is resampled and pan-sharpened):                \n "
+   "     [--window XOFF,YOFF,XSIZE,YSIZE]  window in pixels of the pan image       \n "
+   "     [--bbox MINX,MINY,MAXX,MAXY [SRS]]  bounding box, in the SRS of the pan   \n "
+   "                           image or in SRS (e.g. EPSG:4326)                    \n "
+   "   sharding a scene over processes or nodes (same options for every shard):    \n "
+   "     [--shard I/N]         sharpen shard I of N (rows of windows) into partial \n "
+   "                           outputs sharpened_*.shard-I-of-N.tif                \n "
+   "     [--merge-shards N]    stitch the N partial outputs in -o into             \n "
+   "                           sharpened_*.vrt (no recompression), and exit        \n "
+   "   instrumentation:                                                            \n "
+   "     [--stats-json FILE]   write wall and CPU time, bytes, and pixels of each  \n "
+   "                           stage and thread (per scene) as a JSON report       \n "
    "                                                                                \n"
    " AUTHOR:                                                                        \n"
   "   Gerasimos 'Geri'  Michalitsianos                                              \n"
@@ -94,6 +158,216 @@ bool CheckImageFileName( const char* input) {
   return true;
 }
 
+/* ***************************************************************************
+ * void PansharpenScene( std::map<std::string,std::string>,int,const char*,
+ *   PansharpenOptions const& ):
+ *   Function to pan-sharpen one set of imagery (a scene): open each image
+ *   once (see Scene), make sure the data-types of the images are 
+ *   supported (see PIXEL_TYPE_PAIRS), resample the multispectral images
+ *   to disk if asked to (--resample-to-disk), and write the pan-sharpened Geotiffs into the
+ *   output directory. For a preview (--preview), the imagery is read at
+ *   reduced resolution and pan-sharpened in memory instead.
+ *
+ * Args:
+ *   std::map<std::string,std::string> : image filenames (pan,red,...).
+ *   int : number of output bands (3 or 4).
+ *   const char* : output directory.
+ *   PansharpenOptions const& : options of the pan-sharpening.
+ * Returns:
+ *   None. Void. Throws PansharpenError if the scene fails.
+ */
+void PansharpenScene( std::map<std::string,std::string> Imagery,int n_bands,
+  const char* OutDir,PansharpenOptions const& Options ) {
+
+  // open every image once; all of the stages below share the handles
+  // and metadata (dimensions, geotransform, data type, ...)
+  // *****************************************************************
+  ThreadTiming *Timing = Options.Timing ? Options.Timing->Thread( "main",0 ) : nullptr;
+  StageTimer OpenTimer( Timing,STAGE_OPEN );
+  Scene Inputs( Imagery );
+  OpenTimer.Stop();
+
+  // make sure the multispectral images have the same data-type, and
+  // the panchromatic image that data-type or a floating-point one
+  // ****************************************************************
+  StageTimer CheckTimer( Timing,STAGE_CHECK_TYPES );
+  if( !Pansharpen::ImageryHasSupportedDataTypes( Inputs ) ) {
+    throw PansharpenError( "multispectral images should have ONE data type, and the "
+      "panchromatic image that data type or a floating-point one (Float32, Float64)." );
+  }
+  CheckTimer.Stop();
+
+  // a preview (--preview) reads the imagery from its overviews (or
+  // decimated) into memory, and pan-sharpens that: the time it takes
+  // goes with the size of the preview, not that of the scene
+  // ****************************************************************
+  if( HasPreview( Options ) ) {
+    StageTimer PreviewTimer( Timing,STAGE_PREVIEW );
+    PreviewImagery Preview;
+    ReadPreviewImagery( Inputs,n_bands,Options,&Preview );
+    uint64_t Bytes = 0;
+    for( auto const& Pixels : Preview.Pixels ) Bytes += Pixels.size();
+    PreviewTimer.Count( (uint64_t)Preview.Cols*Preview.Rows,Bytes,0 );
+    PreviewTimer.Stop();
+    printf("  preview: %d x %d pixels \n",Preview.Cols,Preview.Rows);
+    Pansharpen PreviewObj( Preview.Rasters,Options );
+    PreviewObj.PansharpenImagery( n_bands,OutDir );
+    return;
+  }
+
+  // by default, each RGB,NIR Geotiff is resampled to the same dimensions
+  // as the panchromatic image on the fly, while it is pan-sharpened. As
+  // a fallback (--resample-to-disk), use image filename-hash to resample
+  // them to *_resampled.tif files first.
+  // ********************************************************************
+  // With a region of interest (--window or --bbox), only the region is
+  // resampled.
+  // ********************************************************************
+  if( Options.ResampleToDisk ) {
+    StageTimer ResampleTimer( Timing,STAGE_RESAMPLE );
+    Window Region;
+    bool HasRegion = Options.HasRegionWindow || Options.HasRegionBBox;
+    if( HasRegion ) {
+      Region = Pansharpen::RegionOfInterest( Inputs.Image( "pan" ).Dataset,Options );
+    }
+    std::map<std::string,std::string> ResampledImagery = 
+      ResampleImageGeotiffs( Inputs,HasRegion ? &Region : nullptr,Options.Resume );
+    uint64_t Bytes = 0;
+    for( auto const& [ImgKey,ImgFileName] : ResampledImagery ) {
+      std::error_code ec;
+      uintmax_t Size = std::filesystem::file_size( ImgFileName,ec );
+      if( !ec && Imagery.count( ImgKey ) == 0 ) Bytes += Size;
+    }
+    ResampleTimer.Count( 0,0,Bytes );
+  }
+
+  // perform the pansharpening of the various resampled 
+  // image files
+  // **************************************************
+  Pansharpen PansharpenObj( Inputs,Options );
+  PansharpenObj.PansharpenImagery( n_bands,OutDir );
+}
+
+/* ***************************************************************************
+ * int PansharpenBatch( std::vector<ManifestScene> const&,int,
+ *   PansharpenOptions const&,int,const char* ):
+ *   Function to pan-sharpen every scene of a batch manifest (--batch).
+ *   The -j threads are shared by the scenes: Jobs scenes (--batch-jobs,
+ *   by default one per thread) are pan-sharpened at a time, each with 
+ *   its share of the threads, and a scene that finishes early makes way
+ *   for the next one. A scene that fails (e.g. a missing or unreadable 
+ *   image, or a manifest line that is not a valid scene) is reported
+ *   and does not stop the others. The output directory of a scene is
+ *   created if it does not exist.
+ *
+ * Args:
+ *   std::vector<ManifestScene> const& : scenes (see ReadManifest()).
+ *   int : number of output bands (3 or 4).
+ *   PansharpenOptions const& : options of the pan-sharpening.
+ *   int : number of scenes at a time (0 for one per thread).
+ *   const char* : timing report to write (--stats-json), or "" for none.
+ * Returns:
+ *   int: 0 if all scenes succeeded, or 1 if any scene failed.
+ */
+int PansharpenBatch( std::vector<ManifestScene> const& Scenes,int n_bands,
+  PansharpenOptions const& Options,int Jobs,const char* StatsJson ) {
+
+  // split the threads among the scenes that run at a time
+  // *****************************************************
+  int nThreads = ThreadCount( Options.Threads,SIZE_MAX );
+  int nJobs    = ThreadCount( Jobs>0 ? Jobs : nThreads,Scenes.size() );
+  PansharpenOptions SceneOptions = Options;
+  SceneOptions.Threads   = nThreads/nJobs>1 ? nThreads/nJobs : 1;
+  SceneOptions.MaxMemory = Options.MaxMemory/nJobs;
+  printf("  batch: %zu scene(s), %d at a time with %d thread(s) each \n",
+    Scenes.size(),nJobs,SceneOptions.Threads);
+
+  // one timing (--stats-json) per scene
+  // ************************************
+  auto RunStart = std::chrono::steady_clock::now();
+  std::vector<std::unique_ptr<SceneTiming>> Timings( strlen( StatsJson ) ? Scenes.size() : 0 );
+
+  std::atomic<int> nDone( 0 ),nFailed( 0 );
+  ParallelFor( nJobs,Scenes.size(),[&]( int worker,size_t scene ) {
+    ManifestScene const& Scene = Scenes[scene];
+    std::string Pan = Scene.Imagery.count( "pan" ) ? Scene.Imagery.at( "pan" ) : "";
+    auto Start = std::chrono::steady_clock::now();
+    std::string Message;
+    PansharpenOptions ThisSceneOptions = SceneOptions;
+    if( !Timings.empty() ) {
+      Timings[scene].reset( new SceneTiming );
+      Timings[scene]->Pan    = Pan;
+      Timings[scene]->Output = Scene.OutDir;
+      ThisSceneOptions.Timing = Timings[scene].get();
+    }
+    try {
+      // a manifest line that is not a valid scene fails as it is
+      // ********************************************************
+      if( !Scene.Error.empty() ) throw PansharpenError( Scene.Error );
+
+      // verify filenames as Geotiff files (e.g. .tif, .TIF extension)
+      // *************************************************************
+      for( auto const& [ImgKey,ImgFileName] : Scene.Imagery ) {
+        if( !CheckImageFileName( ImgFileName.c_str() ) ) {
+          throw PansharpenError( ImgKey+" file should be geotiff (e.g. .TIF,.tif): "+ImgFileName );
+        }
+      }
+      std::error_code ec;
+      std::filesystem::create_directories( Scene.OutDir,ec );
+      if( !std::filesystem::is_directory( Scene.OutDir ) ) {
+        throw PansharpenError( "Unable to create output directory "+Scene.OutDir+": "+ec.message() );
+      }
+      PansharpenScene( Scene.Imagery,n_bands,Scene.OutDir.c_str(),ThisSceneOptions );
+    } catch( std::exception const& Error ) {
+      Message = Error.what();
+    }
+    if( !Timings.empty() ) Timings[scene]->Finish( Message );
+
+    // report the scene as soon as it is done
+    // **************************************
+    double Seconds = std::chrono::duration<double>( std::chrono::steady_clock::now()-Start ).count();
+    int Done = ++nDone;
+    if( Message.empty() ) {
+      printf("  [%d/%zu] OK      line %d -> %s (%.1f s) \n",
+        Done,Scenes.size(),Scene.Line,Scene.OutDir.c_str(),Seconds);
+    } else {
+      ++nFailed;
+      printf("  [%d/%zu] FAILED  line %d (%s): %s \n",
+        Done,Scenes.size(),Scene.Line,Pan.empty() ? "no scene" : Pan.c_str(),Message.c_str());
+    }
+    fflush( stdout );
+  });
+
+  printf("  batch: %zu of %zu scene(s) succeeded, %d failed \n",
+    Scenes.size()-nFailed,Scenes.size(),(int)nFailed);
+  if( !Timings.empty() ) {
+    std::vector<SceneTiming*> Reports;
+    for( auto const& Timing : Timings ) Reports.push_back( Timing.get() );
+    double Seconds = std::chrono::duration<double>( std::chrono::steady_clock::now()-RunStart ).count();
+    if( !WriteTimingReport( StatsJson,Reports,nThreads,Seconds ) ) {
+      printf("  WARNING: unable to write --stats-json report %s \n",StatsJson);
+    }
+  }
+  return nFailed>0 ? 1 : 0;
+}
+
+/* ***************************************************************************
+ * void ReportMemory( int ):
+ *   Function to print the peak memory (resident set size) of the run,
+ *   against the memory budget (--max-memory flag), if there is one.
+ *
+ * Args:
+ *   int : memory budget in MB (0 for no budget).
+ * Returns:
+ *   None. Void.
+ */
+void ReportMemory( int MaxMemoryMB ) {
+  if( MaxMemoryMB<=0 ) return;
+  size_t Peak = PeakResidentMemory();
+  printf("  memory: peak resident %zu MB of %d MB budget%s \n",Peak>>20,MaxMemoryMB,
+    Peak>( (size_t)MaxMemoryMB<<20 ) ? " (EXCEEDED)" : "");
+}
+
 int main( int argc, char* argv[] ) 
 {
   /* **************************************************************
@@ -118,11 +392,60 @@ int main( int argc, char* argv[] )
   const char* green_filename = "";  
   const char* N_out_bands    = ""; // default value: RGB
   const char* OutDir         = ""; // output directory
+  const char* BatchManifest  = ""; // manifest of scenes (--batch)
+  int BatchJobs              = 0;  // scenes at a time (--batch-jobs)
+  int GDALCacheMB            = 0;  // GDAL block cache (--gdal-cache)
+  int MaxMemoryMB            = 0;  // memory budget (--max-memory)
+  const char* StatsJson      = ""; // timing report (--stats-json)
+  int MergeShardCount        = 0;  // shards to stitch (--merge-shards)
+  const char* ms_filename    = ""; // multi-band multispectral image (--ms)
+  PansharpenOptions Options;        // e.g. window sizes
+
+  // long-only options (e.g. --resample-to-disk) are given
+  // values above 255 so that they do not clash with short options
+  // *************************************************************
+  enum { OPT_RESAMPLE_TO_DISK=256,OPT_NO_FUSED_UPSAMPLE,OPT_CO,OPT_TILED,
+    OPT_BLOCKSIZE,OPT_COMPRESS,OPT_PREDICTOR,OPT_BIGTIFF,OPT_NUM_THREADS,
+    OPT_OT,OPT_SCALE,OPT_OFFSET,OPT_METHOD,OPT_FIHS_WEIGHTS,OPT_PAN_MATCH,
+    OPT_BATCH,OPT_BATCH_JOBS,OPT_GDAL_CACHE,OPT_MAX_MEMORY,OPT_STATS_JSON,
+    OPT_WINDOW,OPT_BBOX,OPT_SHARD,OPT_MERGE_SHARDS,OPT_RESUME,OPT_MS,OPT_MS_BANDS,
+    OPT_PREVIEW };
+  static struct option LongOptions[] = {
+    { "resample-to-disk",no_argument,nullptr,OPT_RESAMPLE_TO_DISK },
+    { "no-fused-upsample",no_argument,nullptr,OPT_NO_FUSED_UPSAMPLE },
+    { "co",required_argument,nullptr,OPT_CO },
+    { "tiled",no_argument,nullptr,OPT_TILED },
+    { "blocksize",required_argument,nullptr,OPT_BLOCKSIZE },
+    { "compress",required_argument,nullptr,OPT_COMPRESS },
+    { "predictor",required_argument,nullptr,OPT_PREDICTOR },
+    { "bigtiff",required_argument,nullptr,OPT_BIGTIFF },
+    { "num-threads",required_argument,nullptr,OPT_NUM_THREADS },
+    { "ot",required_argument,nullptr,OPT_OT },
+    { "scale",required_argument,nullptr,OPT_SCALE },
+    { "offset",required_argument,nullptr,OPT_OFFSET },
+    { "method",required_argument,nullptr,OPT_METHOD },
+    { "fihs-weights",required_argument,nullptr,OPT_FIHS_WEIGHTS },
+    { "pan-match",required_argument,nullptr,OPT_PAN_MATCH },
+    { "batch",required_argument,nullptr,OPT_BATCH },
+    { "batch-jobs",required_argument,nullptr,OPT_BATCH_JOBS },
+    { "gdal-cache",required_argument,nullptr,OPT_GDAL_CACHE },
+    { "max-memory",required_argument,nullptr,OPT_MAX_MEMORY },
+    { "stats-json",required_argument,nullptr,OPT_STATS_JSON },
+    { "window",required_argument,nullptr,OPT_WINDOW },
+    { "bbox",required_argument,nullptr,OPT_BBOX },
+    { "shard",required_argument,nullptr,OPT_SHARD },
+    { "merge-shards",required_argument,nullptr,OPT_MERGE_SHARDS },
+    { "resume",no_argument,nullptr,OPT_RESUME },
+    { "ms",required_argument,nullptr,OPT_MS },
+    { "ms-bands",required_argument,nullptr,OPT_MS_BANDS },
+    { "preview",required_argument,nullptr,OPT_PREVIEW },
+    { nullptr,0,nullptr,0 }
+  };
 
   // get option arguments
   // ********************
   int opt = 0;  
-  while((opt=getopt(argc,argv,":h:p:n:r:g:b:z:o:"))!=-1) {
+  while((opt=getopt_long(argc,argv,":h:p:n:r:g:b:z:o:w:t:j:",LongOptions,nullptr))!=-1) {
     switch(opt) {
       case 'h':
         Usage();
@@ -147,6 +470,181 @@ int main( int argc, char* argv[] )
       case 'o':
 	OutDir         = optarg;
 	break;
+      case 'w':
+	Options.WindowRows = atoi(optarg);
+	break;
+      case 't':
+	Options.WindowCols = atoi(optarg);
+	break;
+      case 'j':
+	Options.Threads    = atoi(optarg);
+	break;
+      case OPT_RESAMPLE_TO_DISK:
+	Options.ResampleToDisk = true;
+	break;
+      case OPT_NO_FUSED_UPSAMPLE:
+	Options.FusedUpsample  = false;
+	break;
+      case OPT_RESUME:
+	Options.Resume         = true;
+	break;
+      case OPT_MS:
+	ms_filename    = optarg;
+	break;
+      case OPT_MS_BANDS: {
+	// bands of the --ms image that are the red,green,blue[,NIR] bands
+	int* B = Options.MSBands;
+	char End;
+	int n = sscanf( optarg,"%d,%d,%d,%d%c",&B[0],&B[1],&B[2],&B[3],&End );
+	if( (n != 3 && n != 4) || B[0]<1 || B[1]<1 || B[2]<1 || (n == 4 && B[3]<1) ) {
+	  printf("  \n ERROR (fatal): --ms-bands %s should be R,G,B[,N] (1-based band numbers). Exiting ... \n",optarg);
+	  exit(1);
+	}
+	if( n == 3 ) B[3] = 0; // no NIR band: 3-band output only
+	break;
+      }
+      case OPT_CO:
+	Options.CreationOptions.push_back( optarg );
+	break;
+      case OPT_TILED:
+	Options.CreationOptions.push_back( "TILED=YES" );
+	break;
+      case OPT_BLOCKSIZE: {
+	// X or X,Y (square blocks if only X is given)
+	std::string BlockSize( optarg );
+	size_t comma = BlockSize.find( ',' );
+	std::string BlockX = BlockSize.substr( 0,comma );
+	std::string BlockY = comma == std::string::npos ? BlockX : BlockSize.substr( comma+1 );
+	Options.CreationOptions.push_back( "BLOCKXSIZE="+BlockX );
+	Options.CreationOptions.push_back( "BLOCKYSIZE="+BlockY );
+	break;
+      }
+      case OPT_COMPRESS:
+	Options.CreationOptions.push_back( std::string( "COMPRESS=" )+optarg );
+	break;
+      case OPT_PREDICTOR:
+	Options.CreationOptions.push_back( std::string( "PREDICTOR=" )+optarg );
+	break;
+      case OPT_BIGTIFF:
+	Options.CreationOptions.push_back( std::string( "BIGTIFF=" )+optarg );
+	break;
+      case OPT_NUM_THREADS:
+	Options.CreationOptions.push_back( std::string( "NUM_THREADS=" )+optarg );
+	break;
+      case OPT_OT:
+	// output data type name (e.g. UInt16), or native (input data type)
+	if( strcasecmp( optarg,"native" ) == 0 ) {
+	  Options.OutputType = GDT_Unknown;
+	} else {
+	  Options.OutputType = GDALGetDataTypeByName( optarg );
+	  if( Options.OutputType == GDT_Unknown || GDALDataTypeIsComplex( Options.OutputType ) ) {
+	    printf("  \n ERROR (fatal): --ot %s is not a supported output data type. Exiting ... \n",optarg);
+	    exit(1);
+	  }
+	}
+	break;
+      case OPT_SCALE:
+	Options.OutputScale  = atof(optarg);
+	if( Options.OutputScale == 0.0 ) {
+	  printf("  \n ERROR (fatal): --scale must be non-zero. Exiting ... \n");
+	  exit(1);
+	}
+	break;
+      case OPT_OFFSET:
+	Options.OutputOffset = atof(optarg);
+	break;
+      case OPT_METHOD:
+	// comma-separated list of methods (e.g. fihs,brovey), or all
+	Options.Methods = ParseMethods( optarg );
+	if( Options.Methods == 0 ) {
+	  printf("  \n ERROR (fatal): --method %s is not a list of fihs, brovey, gs, pca, or all. Exiting ... \n",optarg);
+	  exit(1);
+	}
+	break;
+      case OPT_FIHS_WEIGHTS: {
+	// comma-separated weights of red,green,blue[,NIR] in the intensity
+	std::string Weights( optarg );
+	size_t first = 0;
+	Options.IntensityWeights.clear();
+	while( first<=Weights.size() ) {
+	  size_t comma = Weights.find( ',',first );
+	  if( comma == std::string::npos ) comma = Weights.size();
+	  Options.IntensityWeights.push_back( atof( Weights.substr( first,comma-first ).c_str() ) );
+	  first = comma+1;
+	}
+	break;
+      }
+      case OPT_PAN_MATCH:
+	Options.PanMatch = ParsePanMatch( optarg );
+	if( Options.PanMatch<0 ) {
+	  printf("  \n ERROR (fatal): --pan-match %s should be none, meanstd, or histogram. Exiting ... \n",optarg);
+	  exit(1);
+	}
+	break;
+      case OPT_BATCH:
+	BatchManifest = optarg;
+	break;
+      case OPT_BATCH_JOBS:
+	BatchJobs     = atoi(optarg);
+	break;
+      case OPT_GDAL_CACHE:
+	GDALCacheMB   = atoi(optarg);
+	break;
+      case OPT_MAX_MEMORY:
+	MaxMemoryMB   = atoi(optarg);
+	break;
+      case OPT_STATS_JSON:
+	StatsJson     = optarg;
+	break;
+      case OPT_WINDOW: {
+	// xoff,yoff,xsize,ysize in pixels of the panchromatic image
+	Window& W = Options.RegionWindow;
+	char End;
+	if( sscanf( optarg,"%d,%d,%d,%d%c",&W.xoff,&W.yoff,&W.xsize,&W.ysize,&End ) != 4 ||
+	    W.xoff<0 || W.yoff<0 || W.xsize<1 || W.ysize<1 ) {
+	  printf("  \n ERROR (fatal): --window %s should be xoff,yoff,xsize,ysize (pixels). Exiting ... \n",optarg);
+	  exit(1);
+	}
+	Options.HasRegionWindow = true;
+	break;
+      }
+      case OPT_BBOX: {
+	// minx,miny,maxx,maxy, optionally followed by their SRS (e.g. 
+	// EPSG:4326; by default the SRS of the panchromatic image)
+	double* B = Options.RegionBBox;
+	char End;
+	if( sscanf( optarg,"%lf,%lf,%lf,%lf%c",&B[0],&B[1],&B[2],&B[3],&End ) != 4 ||
+	    !( B[0]<B[2] ) || !( B[1]<B[3] ) ) {
+	  printf("  \n ERROR (fatal): --bbox %s should be minx,miny,maxx,maxy. Exiting ... \n",optarg);
+	  exit(1);
+	}
+	if( optind<argc && argv[optind][0] != '-' ) {
+	  Options.RegionSRS = argv[optind++];
+	}
+	Options.HasRegionBBox = true;
+	break;
+      }
+      case OPT_SHARD:
+	// i/N: this process sharpens shard i (1 to N) of N
+	if( !ParseShard( optarg,&Options.ShardIndex,&Options.ShardCount ) ) {
+	  printf("  \n ERROR (fatal): --shard %s should be i/N with 1 <= i <= N. Exiting ... \n",optarg);
+	  exit(1);
+	}
+	break;
+      case OPT_PREVIEW:
+	// largest dimension of the preview in pixels, or ovK for an overview level
+	if( !ParsePreview( optarg,&Options.PreviewSize,&Options.PreviewLevel ) ) {
+	  printf("  \n ERROR (fatal): --preview %s should be a size in pixels or ovK (K >= 1). Exiting ... \n",optarg);
+	  exit(1);
+	}
+	break;
+      case OPT_MERGE_SHARDS:
+	MergeShardCount = atoi(optarg);
+	if( MergeShardCount<1 ) {
+	  printf("  \n ERROR (fatal): --merge-shards %s should be the number of shards. Exiting ... \n",optarg);
+	  exit(1);
+	}
+	break;
       default:
 	Usage();
     }    
@@ -184,6 +682,90 @@ int main( int argc, char* argv[] )
     n_bands = 3;
   }
 
+  // make sure there is one FIHS intensity weight per output band
+  // ************************************************************
+  if( !Options.IntensityWeights.empty() && (int)Options.IntensityWeights.size() != n_bands ) {
+    printf("  \n ERROR (fatal): --fihs-weights should have %d weights (one per output band). Exiting ... \n",n_bands);
+    exit(1);
+  }
+
+  // the region of interest is a pixel window or a bounding box, not both
+  // ********************************************************************
+  if( Options.HasRegionWindow && Options.HasRegionBBox ) {
+    printf("  \n ERROR (fatal): use either --window or --bbox, not both. Exiting ... \n");
+    exit(1);
+  }
+
+  // every shard reads the resampled imagery of the whole image, so the
+  // shards cannot each write their own *_resampled.tif files
+  // *******************************************************************
+  if( Options.ShardCount>0 && Options.ResampleToDisk ) {
+    printf("  \n ERROR (fatal): --shard cannot be used with --resample-to-disk. Exiting ... \n");
+    exit(1);
+  }
+
+  // a preview is a quick-look of the whole scene (or of --bbox) in 
+  // memory: it has no pixel window of the full-resolution pan image, no
+  // shards, and nothing to resample to disk
+  // *******************************************************************
+  if( HasPreview( Options ) && ( Options.HasRegionWindow || Options.ShardCount>0 || Options.ResampleToDisk ) ) {
+    printf("  \n ERROR (fatal): --preview cannot be used with --window, --shard, or --resample-to-disk. Exiting ... \n");
+    exit(1);
+  }
+
+  // with a memory budget (--max-memory), a quarter of it goes to the 
+  // GDAL block cache (unless --gdal-cache sets the cache), and the rest
+  // to the window buffers and threads (see FitMemoryBudget())
+  // *******************************************************************
+  if( MaxMemoryMB>0 ) {
+    if( GDALCacheMB<=0 ) GDALCacheMB = MaxMemoryMB/4>0 ? MaxMemoryMB/4 : 1;
+    if( GDALCacheMB>=MaxMemoryMB ) {
+      printf("  \n ERROR (fatal): --gdal-cache should be less than --max-memory. Exiting ... \n");
+      exit(1);
+    }
+    Options.MaxMemory = (size_t)( MaxMemoryMB-GDALCacheMB )<<20;
+  }
+
+  // register the GDAL drivers once, and set the size of the GDAL block
+  // cache. There is one cache for the whole process, so in batch mode it
+  // is one budget shared by all the scenes.
+  // ********************************************************************
+  GDALAllRegister();
+  if( GDALCacheMB>0 ) {
+    GDALSetCacheMax64( (GIntBig)GDALCacheMB*1024*1024 );
+  }
+
+  // merge mode: stitch the partial outputs of the shards of a run in
+  // the output directory (--merge-shards N), and exit
+  // ****************************************************************
+  if( MergeShardCount>0 ) {
+    try {
+      MergeShards( OutDir,Options.Methods,MergeShardCount );
+    } catch( PansharpenError const& Error ) {
+      printf("  \n ERROR (fatal): %s Exiting ... \n",Error.what());
+      exit(1);
+    }
+    GDALDestroyDriverManager();
+    return 0;
+  }
+
+  // batch mode: pan-sharpen every scene of the manifest, and exit with
+  // status 1 if any of them failed
+  // ******************************************************************
+  if( strlen( BatchManifest ) ) {
+    std::vector<ManifestScene> Scenes;
+    try {
+      Scenes = ReadManifest( BatchManifest );
+    } catch( PansharpenError const& Error ) {
+      printf("  \n ERROR (fatal): %s Exiting ... \n",Error.what());
+      exit(1);
+    }
+    int Status = PansharpenBatch( Scenes,n_bands,Options,BatchJobs,StatsJson );
+    ReportMemory( MaxMemoryMB );
+    GDALDestroyDriverManager();
+    return Status;
+  }
+
   // make sure for each input argument (name of geotiffs
   // for panchromatic, NIR, red, green, blue bands ... that a file
   // was indeed passed-in
@@ -192,6 +774,12 @@ int main( int argc, char* argv[] )
     printf( "  \n  ERROR (fatal): panchromatic image file not passed in (-p flag). \n"        );
     printf( "   \n    Exiting ... \n"                                                         );
     Usage();
+  } else if( strlen( ms_filename )) {
+    // one multi-band multispectral image: no per-band images
+    if( n_bands == 4 && Options.MSBands[3]<1 ) {
+      printf("  \n ERROR (fatal): -z 4 needs a NIR band in --ms-bands (R,G,B,N). Exiting ... \n");
+      exit(1);
+    }
   } else if( !strlen( nir_filename )) {
     printf( "  \n  ERROR (fatal): NIR (near-infrared) image file not passed in (-p flag). \n" );
     printf("   \n    Exiting ... \n"                                                          );
@@ -215,10 +803,14 @@ int main( int argc, char* argv[] )
   // ***************************************
   std::map<std::string,std::string> Imagery;
   Imagery[ "pan"   ] = (std::string)pan_filename;
-  Imagery[ "red"   ] = (std::string)red_filename;
-  Imagery[ "green" ] = (std::string)green_filename;
-  Imagery[ "blue"  ] = (std::string)blue_filename;
-  Imagery[ "nir"   ] = (std::string)nir_filename;
+  if( strlen( ms_filename )) {
+    Imagery[ "ms"    ] = (std::string)ms_filename;
+  } else {
+    Imagery[ "red"   ] = (std::string)red_filename;
+    Imagery[ "green" ] = (std::string)green_filename;
+    Imagery[ "blue"  ] = (std::string)blue_filename;
+    Imagery[ "nir"   ] = (std::string)nir_filename;
+  }
 
   // verify filenames as Geotiff files (e.g. .tif, .TIF extension
   // ************************************************************
@@ -230,26 +822,34 @@ int main( int argc, char* argv[] )
     } 
   } 
 
-  // make sure all images have the same data-type
-  // ********************************************
-  bool ImagesHaveOneDataType = Pansharpen::ImageryHasOneDataType( Imagery );
-  if(!ImagesHaveOneDataType){
-    printf( "  \n  ERROR (fatal): all images should have ONE data type ... "                );
-    printf("   \n    Exiting ... \n"                                                        );
-    Usage();
-  }  
-
-  // use image filename-hash to resample each RGB,NIR Geotiff
-  // to the same dimensions as the panchromatic image
-  // ********************************************************
-  std::map<std::string,std::string> ResampledImagery;
-  ResampledImagery = ResampleImageGeotiffs( Imagery );
+  // perform the pansharpening of the imagery, timing it if asked to
+  // (--stats-json); the report is written whether or not it succeeds
+  // ****************************************************************
+  SceneTiming Timing;
+  Timing.Pan    = pan_filename;
+  Timing.Output = strlen( OutDir ) ? OutDir : ".";
+  if( strlen( StatsJson ) ) Options.Timing = &Timing;
+  std::string Message;
+  try {
+    PansharpenScene( Imagery,n_bands,OutDir,Options );
+  } catch( std::exception const& Error ) {
+    Message = Error.what();
+  }
+  if( strlen( StatsJson ) ) {
+    Timing.Finish( Message );
+    if( !WriteTimingReport( StatsJson,{ &Timing },ThreadCount( Options.Threads,SIZE_MAX ),Timing.WallTime ) ) {
+      printf("  WARNING: unable to write --stats-json report %s \n",StatsJson);
+    }
+  }
+  if( !Message.empty() ) {
+    printf("  \n ERROR (fatal): %s Exiting ... \n",Message.c_str());
+    exit(1);
+  }
+  ReportMemory( MaxMemoryMB );
 
-  // perform the pansharpening of the various resampled 
-  // image files
-  // **************************************************
-  Pansharpen PansharpenObj( ResampledImagery  );
-  PansharpenObj.PansharpenImagery( n_bands,OutDir );
+  // close GDAL drivers
+  // ******************
+  GDALDestroyDriverManager();
 
   // return success of 0 to the operating system
   // *******************************************
@@ -0,0 +1,257 @@
+#include <cctype>
+#include <fstream>
+#include <string>
+#include <strings.h>
+#include "Manifest.h"
+#include "Pansharpen.h"
+typedef std::string String;
+
+// columns of a manifest scene, in the order of a CSV line without a
+// header row, and the names (and short names) that identify them
+// *****************************************************************
+static const int N_COLUMNS = 6;
+static const char* COLUMN_KEYS[ N_COLUMNS ]  = { "pan","red","green","blue","nir","output" };
+static const char* COLUMN_SHORT[ N_COLUMNS ] = { "p","r","g","b","n","o" };
+
+static int ColumnIndex( String const& Name ) {
+  /* *************************************************************************
+   * int ColumnIndex( String const& ):
+   *
+   * This function returns the index (in COLUMN_KEYS) of a manifest column
+   * name, e.g. "red" or "r" (case-insensitive).
+   *
+   * Args:
+   *   String const& : column name.
+   * Returns:
+   *   int : column index, or -1 if the name is not recognized.
+   */
+  for( int column=0; column<N_COLUMNS; column++ ) {
+    if( strcasecmp( Name.c_str(),COLUMN_KEYS[column] ) == 0 ||
+        strcasecmp( Name.c_str(),COLUMN_SHORT[column] ) == 0 ) return column;
+  }
+  return -1;
+}
+
+static String Trim( String const& Text ) {
+  /* *************************************************************************
+   * String Trim( String const& ):
+   *
+   * This function strips leading and trailing white space (including a
+   * carriage return of a DOS line ending) and one pair of surrounding
+   * double quotes.
+   *
+   * Args:
+   *   String const& : text to trim.
+   * Returns:
+   *   String : trimmed text.
+   */
+  size_t first = 0,last = Text.size();
+  while( first<last && isspace( (unsigned char)Text[first] ) ) first++;
+  while( last>first && isspace( (unsigned char)Text[last-1] ) ) last--;
+  if( last-first>=2 && Text[first] == '"' && Text[last-1] == '"' ) {
+    first++;
+    last--;
+  }
+  return Text.substr( first,last-first );
+}
+
+static std::vector<String> SplitCSV( String const& Line ) {
+  /* *************************************************************************
+   * std::vector<String> SplitCSV( String const& ):
+   *
+   * This function splits one CSV line into trimmed fields. Commas inside
+   * double quotes do not split fields.
+   *
+   * Args:
+   *   String const& : CSV line.
+   * Returns:
+   *   std::vector<String> : fields of the line.
+   */
+  std::vector<String> Fields;
+  String Field;
+  bool Quoted = false;
+  for( char c : Line ) {
+    if( c == '"' ) Quoted = !Quoted;
+    if( c == ',' && !Quoted ) {
+      Fields.push_back( Trim( Field ) );
+      Field.clear();
+    } else {
+      Field += c;
+    }
+  }
+  Fields.push_back( Trim( Field ) );
+  return Fields;
+}
+
+static void SkipSpace( String const& Line,size_t& pos ) {
+  // move pos past any white space
+  while( pos<Line.size() && isspace( (unsigned char)Line[pos] ) ) pos++;
+}
+
+static bool ParseJSONString( String const& Line,size_t& pos,String& Value ) {
+  /* *************************************************************************
+   * bool ParseJSONString( String const&,size_t&,String& ):
+   *
+   * This function parses a JSON string that starts at Line[pos] (after
+   * any white space), and moves pos past it. The escapes \" \\ \/ \t
+   * and \n are decoded.
+   *
+   * Args:
+   *   String const& : JSON line.
+   *   size_t& : position in the line.
+   *   String& : decoded string.
+   * Returns:
+   *   bool : false if there is no (terminated) string at pos.
+   */
+  SkipSpace( Line,pos );
+  if( pos>=Line.size() || Line[pos] != '"' ) return false;
+  Value.clear();
+  for( pos++; pos<Line.size(); pos++ ) {
+    char c = Line[pos];
+    if( c == '"' ) {
+      pos++;
+      return true;
+    }
+    if( c == '\\' && pos+1<Line.size() ) {
+      c = Line[++pos];
+      if( c == 't' ) c = '\t';
+      if( c == 'n' ) c = '\n';
+    }
+    Value += c;
+  }
+  return false;
+}
+
+static std::map<String,String> ParseJSONObject( String const& Line ) {
+  /* *************************************************************************
+   * std::map<String,String> ParseJSONObject( String const& ):
+   *
+   * This function parses one JSON line holding a flat object of string
+   * values, e.g. {"pan": "pan.tif", "red": "red.tif", ...}.
+   *
+   * Args:
+   *   String const& : JSON line.
+   * Returns:
+   *   std::map<String,String> : keys and values of the object. Throws
+   *   PansharpenError if the line is not such an object.
+   */
+  std::map<String,String> Object;
+  size_t pos = Line.find( '{' )+1;
+  SkipSpace( Line,pos );
+  if( pos<Line.size() && Line[pos] == '}' ) return Object;
+  while( true ) {
+    String Key,Value;
+    if( !ParseJSONString( Line,pos,Key ) ) {
+      throw PansharpenError( "expected a quoted key (a flat JSON object of strings)." );
+    }
+    SkipSpace( Line,pos );
+    if( pos>=Line.size() || Line[pos] != ':' ) throw PansharpenError( "expected ':' after \""+Key+"\"." );
+    pos++;
+    if( !ParseJSONString( Line,pos,Value ) ) {
+      throw PansharpenError( "expected a quoted value for \""+Key+"\"." );
+    }
+    Object[Key] = Value;
+    SkipSpace( Line,pos );
+    if( pos<Line.size() && Line[pos] == ',' ) {
+      pos++;
+      continue;
+    }
+    if( pos<Line.size() && Line[pos] == '}' ) break;
+    throw PansharpenError( "expected ',' or '}' after \""+Key+"\"." );
+  }
+  return Object;
+}
+
+std::vector<ManifestScene> ReadManifest( const char* FileName ) {
+  /* *************************************************************************
+   * std::vector<ManifestScene> ReadManifest( const char* ):
+   *
+   * This function reads a batch manifest: one scene per line, either as
+   * a JSON object, e.g.
+   *   {"pan": "p.tif", "red": "r.tif", "green": "g.tif", "blue": "b.tif",
+   *    "nir": "n.tif", "output": "out/scene1"}
+   * or as a CSV line. CSV lines hold pan,red,green,blue,nir,output in 
+   * that order, unless the first CSV line is a header row naming the 
+   * columns (pan,red,green,blue,nir,output, or p,r,g,b,n,o). Lines of 
+   * both kinds may be mixed. Blank lines and lines starting with # are
+   * skipped. Every scene needs all six columns; a line that is not a
+   * valid scene is kept as a scene with its error (see ManifestScene),
+   * so that one bad line does not stop the rest of the batch.
+   *
+   * Args:
+   *   const char* : manifest filename.
+   * Returns:
+   *   std::vector<ManifestScene> : scenes, in manifest order. Throws 
+   *   PansharpenError if the manifest cannot be read.
+   */
+  std::ifstream Manifest( FileName );
+  if( !Manifest ) {
+    throw PansharpenError( String( "Unable to open batch manifest " )+FileName+"." );
+  }
+
+  // column index of each CSV field (positional until a header row)
+  // **************************************************************
+  std::vector<int> CSVColumns;
+  for( int column=0; column<N_COLUMNS; column++ ) CSVColumns.push_back( column );
+  bool FirstCSVLine = true;
+
+  std::vector<ManifestScene> Scenes;
+  String Line;
+  int LineNumber = 0;
+  while( std::getline( Manifest,Line ) ) {
+    LineNumber++;
+    String Text = Trim( Line );
+    if( Text.empty() || Text[0] == '#' ) continue;
+    ManifestScene Scene;
+    Scene.Line = LineNumber;
+    try {
+
+      // gather the columns of this line, by column index
+      // ************************************************
+      String Values[ N_COLUMNS ];
+      if( Text[0] == '{' ) {
+        std::map<String,String> Object = ParseJSONObject( Text );
+        for( auto const& [Key,Value] : Object ) {
+          int column = ColumnIndex( Key );
+          if( column<0 ) throw PansharpenError( "unknown key \""+Key+"\"." );
+          Values[column] = Value;
+        }
+      } else {
+        std::vector<String> Fields = SplitCSV( Text );
+        if( FirstCSVLine ) {
+          FirstCSVLine = false;
+          bool Header = true;
+          for( String const& Field : Fields ) Header = Header && ColumnIndex( Field )>=0;
+          if( Header ) {
+            CSVColumns.clear();
+            for( String const& Field : Fields ) CSVColumns.push_back( ColumnIndex( Field ) );
+            continue;
+          }
+        }
+        if( Fields.size() != CSVColumns.size() ) {
+          throw PansharpenError( "expected "+std::to_string( CSVColumns.size() )+
+            " comma-separated fields." );
+        }
+        for( size_t field=0; field<Fields.size(); field++ ) {
+          Values[ CSVColumns[field] ] = Fields[field];
+        }
+      }
+
+      // every scene needs the five images and an output directory
+      // *********************************************************
+      for( int column=0; column<N_COLUMNS; column++ ) {
+        if( Values[column].empty() ) {
+          throw PansharpenError( String( "missing \"" )+COLUMN_KEYS[column]+"\"." );
+        }
+        if( column<N_COLUMNS-1 ) Scene.Imagery[ COLUMN_KEYS[column] ] = Values[column];
+      }
+      Scene.OutDir = Values[N_COLUMNS-1];
+    } catch( PansharpenError const& Error ) {
+      Scene.Imagery.clear();
+      Scene.OutDir.clear();
+      Scene.Error = String( "invalid line of " )+FileName+": "+Error.what();
+    }
+    Scenes.push_back( Scene );
+  }
+  return Scenes;
+}
@@ -0,0 +1,24 @@
+#ifndef MANIFEST_H_
+#define MANIFEST_H_
+#include <map>
+#include <string>
+#include <vector>
+
+// define C++ structure holding one scene of a batch manifest (--batch
+// flag): the image filenames, keyed like the map built from the -p,-r,
+// -g,-b, and -n flags (pan,red,green,blue,nir), the output directory,
+// and the manifest line it was read from (for reporting). A line that
+// is not a valid scene has no imagery, and why in Error; the batch 
+// reports it as a failed scene.
+// ********************************************************************
+struct ManifestScene {
+  std::map<std::string,std::string> Imagery;
+  std::string OutDir;
+  int Line = 0;
+  std::string Error;
+};
+
+// define function prototypes
+// **************************
+std::vector<ManifestScene> ReadManifest( const char* );
+#endif
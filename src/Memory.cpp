@@ -0,0 +1,118 @@
+#include <sys/resource.h>
+#include "Memory.h"
+
+// memory estimates that do not depend on the window size: the program
+// itself (GDAL drivers, statistics, histogram samples), and each reader
+// and compute thread (stack, upsampler rows, warper and scratch buffers)
+// **********************************************************************
+static const size_t FIXED_MEMORY  = (size_t)32<<20;
+static const size_t THREAD_MEMORY = (size_t)8<<20;
+
+// windows are not made smaller than this while the pipeline can be 
+// made shallower or narrower instead
+// *****************************************************************
+static const size_t MIN_WINDOW_PIXELS = (size_t)1<<16;
+
+MemoryBudget FitMemoryBudget( size_t MaxMemory,size_t PixelBytes,size_t ExtraBytes,
+  int Threads,int winCols,int winRows,int unitX,int unitY,int N_COLS ) {
+  /* *************************************************************************
+   * MemoryBudget FitMemoryBudget( size_t,size_t,size_t,int,int,int,int,int,
+   *   int ):
+   *
+   * This function sizes a run to stay within MaxMemory bytes (not counting
+   * the GDAL block cache, which is sized separately). Each window buffer
+   * pair (input and output) takes PixelBytes bytes per window pixel, and
+   * there are Buffers pairs. Starting from Threads threads, 2*Threads
+   * buffers, and a window of winCols by winRows pixels, it:
+   *   1. makes the pipeline shallower (Threads+1 buffers), then drops
+   *      threads, while a window that fits would hold fewer than
+   *      MIN_WINDOW_PIXELS pixels (or less than one alignment unit);
+   *   2. shrinks the window height, in whole units of unitY rows;
+   *   3. if a single unit of rows is still too large (a very wide scene),
+   *      narrows the window into tiles of whole units of unitX columns.
+   * The window never gets larger than requested.
+   *
+   * Args:
+   *   size_t : memory budget in bytes (0 for no budget).
+   *   size_t : bytes per window pixel of one input and output buffer pair.
+   *   size_t : other memory of the run that does not depend on the window.
+   *   int : number of threads wanted.
+   *   int : window width in columns (as requested or by default).
+   *   int : window height in rows (as requested or by default).
+   *   int : alignment unit of the window width (see AlignmentUnit()).
+   *   int : alignment unit of the window height.
+   *   int : number of columns in the image.
+   * Returns:
+   *   MemoryBudget : threads, buffers, and window size of the run.
+   */
+  MemoryBudget Budget;
+  Budget.Threads    = Threads>0 ? Threads : 1;
+  Budget.Buffers    = 2*Budget.Threads;
+  Budget.WindowCols = winCols;
+  Budget.WindowRows = winRows;
+  auto Estimate = [&]( int threads,int buffers,size_t pixels ) {
+    return FIXED_MEMORY+ExtraBytes+threads*THREAD_MEMORY+buffers*PixelBytes*pixels;
+  };
+  auto WindowPixels = [&]( int threads,int buffers ) {
+    size_t Overhead = Estimate( threads,0,0 );
+    if( MaxMemory<=Overhead ) return (size_t)0;
+    return ( MaxMemory-Overhead )/( buffers*PixelBytes );
+  };
+  if( MaxMemory == 0 ) {
+    Budget.Bytes = Estimate( Budget.Threads,Budget.Buffers,(size_t)winCols*winRows );
+    return Budget;
+  }
+
+  // 1. shallower pipeline, then fewer threads, before small windows
+  // ***************************************************************
+  // (but never smaller than one alignment unit, the smallest window)
+  size_t Wanted = (size_t)winCols*winRows;
+  if( Wanted>MIN_WINDOW_PIXELS ) Wanted = MIN_WINDOW_PIXELS;
+  size_t Smallest = (size_t)( unitX<winCols ? unitX : winCols )*( unitY<winRows ? unitY : winRows );
+  if( Wanted<Smallest ) Wanted = Smallest;
+  while( WindowPixels( Budget.Threads,Budget.Buffers )<Wanted ) {
+    if( Budget.Buffers>Budget.Threads+1 ) {
+      Budget.Buffers = Budget.Threads+1;
+    } else if( Budget.Threads>1 ) {
+      Budget.Threads--;
+      Budget.Buffers = Budget.Threads+1;
+    } else {
+      break;
+    }
+  }
+  size_t MaxPixels = WindowPixels( Budget.Threads,Budget.Buffers );
+
+  // 2. fewer rows per window, and 3. tiles for very wide scenes
+  // ***********************************************************
+  if( (size_t)winCols*winRows>MaxPixels ) {
+    int Rows = (int)( MaxPixels/winCols/unitY )*unitY;
+    if( Rows>=unitY ) {
+      Budget.WindowRows = Rows;
+    } else {
+      Budget.WindowRows = unitY<winRows ? unitY : winRows;
+      int Cols = (int)( MaxPixels/Budget.WindowRows/unitX )*unitX;
+      if( Cols<unitX ) Cols = unitX;
+      if( Cols<Budget.WindowCols ) Budget.WindowCols = Cols;
+      if( Budget.WindowCols>N_COLS ) Budget.WindowCols = N_COLS;
+    }
+  }
+  Budget.Bytes = Estimate( Budget.Threads,Budget.Buffers,
+    (size_t)Budget.WindowCols*Budget.WindowRows );
+  if( Budget.Bytes>MaxMemory ) Budget.Fits = false;
+  return Budget;
+}
+
+size_t PeakResidentMemory() {
+  /* *************************************************************************
+   * size_t PeakResidentMemory():
+   *
+   * This function returns the peak resident set size (RSS) of this 
+   * process so far, in bytes.
+   *
+   * Returns:
+   *   size_t : peak resident memory in bytes.
+   */
+  struct rusage Usage;
+  if( getrusage( RUSAGE_SELF,&Usage ) != 0 ) return 0;
+  return (size_t)Usage.ru_maxrss*1024; // kilobytes on Linux
+}
@@ -0,0 +1,24 @@
+#ifndef MEMORY_H_
+#define MEMORY_H_
+#include <cstddef>
+
+// define C++ structure holding how a run is sized to fit a memory budget
+// (--max-memory flag): the number of reader and compute threads, the 
+// number of window buffers in each pool (the pipeline queue depth), and
+// the window size. Fits is false if even the smallest configuration 
+// (one thread, one block-aligned window unit) exceeds the budget.
+// **********************************************************************
+struct MemoryBudget {
+  int Threads    = 1;
+  int Buffers    = 2;
+  int WindowCols = 0;
+  int WindowRows = 0;
+  size_t Bytes   = 0; // estimated memory of the run
+  bool Fits      = true;
+};
+
+// define function prototypes
+// **************************
+MemoryBudget FitMemoryBudget( size_t,size_t,size_t,int,int,int,int,int,int );
+size_t PeakResidentMemory();
+#endif
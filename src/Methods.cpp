@@ -0,0 +1,64 @@
+#include <string>
+#include <strings.h>
+#include "Methods.h"
+
+// registry of the pan-sharpening methods, in the order of SharpenMethod
+// *********************************************************************
+const SharpenMethodInfo SHARPEN_METHODS[ N_METHODS ] = {
+  { "fihs",  "FIHS",        "sharpened_FIHS.tif",  KERNEL_FIHS,  false },
+  { "brovey","Brovey",      "sharpened_Brovey.tif",KERNEL_BROVEY,false },
+  { "gs",    "Gram-Schmidt","sharpened_GS.tif",    KERNEL_CS,    true  },
+  { "pca",   "PCA",         "sharpened_PCA.tif",   KERNEL_CS,    true  },
+};
+
+unsigned ParseMethods( const char* List ) {
+  /* *************************************************************************
+   * unsigned ParseMethods( const char* ):
+   *
+   * This function parses a comma-separated list of method names (e.g.
+   * "fihs,gs", case-insensitive), or "all", into a bit mask of 
+   * methods (bit m set for method m of SharpenMethod).
+   *
+   * Args:
+   *   const char* : comma-separated list of method names.
+   * Returns:
+   *   unsigned : bit mask of methods, or 0 if a name is not recognized.
+   */
+  unsigned Methods = 0;
+  std::string Names( List );
+  size_t first = 0;
+  while( first<=Names.size() ) {
+    size_t comma = Names.find( ',',first );
+    if( comma == std::string::npos ) comma = Names.size();
+    std::string Name = Names.substr( first,comma-first );
+    first = comma+1;
+
+    unsigned Method = 0;
+    if( strcasecmp( Name.c_str(),"all" ) == 0 ) Method = ALL_METHODS;
+    for( int method=0; method<N_METHODS; method++ ) {
+      if( strcasecmp( Name.c_str(),SHARPEN_METHODS[method].Name ) == 0 ) Method = 1u<<method;
+    }
+    if( Method == 0 ) return 0;
+    Methods |= Method;
+  }
+  return Methods;
+}
+
+int ParsePanMatch( const char* Mode ) {
+  /* *************************************************************************
+   * int ParsePanMatch( const char* ):
+   *
+   * This function parses the pan matching mode of FIHS (--pan-match flag):
+   * none, meanstd, or histogram (case-insensitive).
+   *
+   * Args:
+   *   const char* : name of the mode.
+   * Returns:
+   *   int : PAN_MATCH_NONE,PAN_MATCH_MEANSTD, or PAN_MATCH_HISTOGRAM, or
+   *         -1 if the name is not recognized.
+   */
+  if( strcasecmp( Mode,"none" ) == 0 )      return PAN_MATCH_NONE;
+  if( strcasecmp( Mode,"meanstd" ) == 0 )   return PAN_MATCH_MEANSTD;
+  if( strcasecmp( Mode,"histogram" ) == 0 ) return PAN_MATCH_HISTOGRAM;
+  return -1;
+}
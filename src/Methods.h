@@ -0,0 +1,79 @@
+#ifndef METHODS_H_
+#define METHODS_H_
+
+// define the pan-sharpening methods (algorithms). Each method runs a
+// kernel (see Kernels.h and KernelsSIMD.cpp), specialized at compile
+// time on the pixel type, the number of bands, and the kernel type, and
+// writes its own output Geotiff. To add a method: add it to this enum
+// and to SHARPEN_METHODS (Methods.cpp), and if no kernel type below 
+// computes it, add a kernel type and its formula to the kernels.
+// *********************************************************************
+enum SharpenMethod { 
+  METHOD_FIHS = 0,
+  METHOD_BROVEY,
+  METHOD_GS,  // Gram-Schmidt
+  METHOD_PCA, // principal component analysis
+  N_METHODS
+};
+
+// define the kernel types (formulas). FIHS and Brovey have their own
+// kernels. The component substitution kernel:
+//   out_k = band_k + Gains[k]*( PanGain*pan + PanBias - I )
+// with intensity I = sum_j Weights[j]*band_j (see SharpenParams) serves
+// Gram-Schmidt, PCA, and FIHS with intensity weights or a matched pan.
+// KERNEL_CS_PANF substitutes pan values given as a float buffer (e.g.
+// histogram-matched) instead of the panchromatic pixels.
+// *********************************************************************
+enum SharpenKernelType {
+  KERNEL_FIHS = 0,
+  KERNEL_BROVEY,
+  KERNEL_CS,
+  KERNEL_CS_PANF,
+  N_KERNELS
+};
+
+constexpr bool IsSubstitutionKernel( int Kernel ) {
+  return Kernel == KERNEL_CS || Kernel == KERNEL_CS_PANF;
+}
+
+// define how the pan band is matched to the intensity component of
+// FIHS (--pan-match flag): not at all, to its mean and standard 
+// deviation, or to its histogram
+// ****************************************************************
+enum PanMatchMode {
+  PAN_MATCH_NONE = 0,
+  PAN_MATCH_MEANSTD,
+  PAN_MATCH_HISTOGRAM
+};
+
+// define C++ structure describing a method: its name (--method flag),
+// the name used in messages, the file name of its output Geotiff, its
+// kernel type, and whether it needs global band statistics (a first
+// pass over the imagery, see Statistics.h)
+// *******************************************************************
+struct SharpenMethodInfo {
+  const char *Name;
+  const char *Label;
+  const char *OutputFile;
+  int Kernel;
+  bool NeedsStatistics;
+};
+extern const SharpenMethodInfo SHARPEN_METHODS[ N_METHODS ];
+
+// bit mask of every method, and of the methods run by default
+// ************************************************************
+const unsigned ALL_METHODS     = ( 1u<<N_METHODS )-1;
+const unsigned DEFAULT_METHODS = ( 1u<<METHOD_FIHS ) | ( 1u<<METHOD_BROVEY );
+
+// component substitution methods (Gram-Schmidt and PCA) derive the
+// weights and gains of their kernel from the band statistics 
+// **************************************************************
+constexpr bool IsComponentSubstitution( int Method ) {
+  return Method == METHOD_GS || Method == METHOD_PCA;
+}
+
+// define function prototypes
+// **************************
+unsigned ParseMethods( const char* );
+int ParsePanMatch( const char* );
+#endif
@@ -1,13 +1,23 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
 #include "Pansharpen.h"
+#include "Parallel.h"
+#include "Pipeline.h"
+#include "Resample.h"
+#include "Upsampler.h"
+#include "Kernels.h"
+#include "Convert.h"
+#include "Statistics.h"
+#include "Memory.h"
+#include "Timing.h"
+#include "Shard.h"
+#include "Journal.h"
+#include "Preview.h"
 typedef std::string String;
 
-// include external C source file. This is how
-// we can call C from C++
-// *******************************************
-extern "C" {
-  #include "GeotiffUtil.c"
-};
-
 // constructor with no arguments
 // *****************************
 Pansharpen::Pansharpen() {};
@@ -18,98 +28,368 @@ Pansharpen::Pansharpen( std::map<String,String> Imagery ) {
   ImageryFileNames = Imagery;	  
 }
 
-bool Pansharpen::ImageryHasOneDataType( std::map<String,String>& Imgs ) {
+// constructor that takes in std::map<String,String> and 
+// options (e.g. window size) for the pan-sharpening
+// *****************************************************
+Pansharpen::Pansharpen( std::map<String,String> Imagery,PansharpenOptions Opts ) {
+  ImageryFileNames = Imagery;
+  Options          = Opts;
+}
+
+// constructor that takes in imagery held in memory by the caller
+// (keys as for the filenames), one output raster per method (only
+// those of the selected methods are used), and options
+// ***************************************************************
+Pansharpen::Pansharpen( std::map<String,PansharpenRaster> Imagery,const PansharpenRaster* Outputs,
+  PansharpenOptions Opts ) {
+  MemoryImagery = Imagery;
+  for( int method=0; method<N_METHODS; method++ ) MemoryOutputs[method] = Outputs[method];
+  Options  = Opts;
+  InMemory = true;
+}
+
+// constructor that takes in imagery held in memory (keys as for the
+// filenames) and options, with the outputs written to Geotiff files 
+// (e.g. a preview read at reduced resolution, see ReadPreviewImagery())
+// *********************************************************************
+Pansharpen::Pansharpen( std::map<String,PansharpenRaster> Imagery,PansharpenOptions Opts ) {
+  MemoryImagery = Imagery;
+  Options       = Opts;
+}
+
+// constructor that takes in imagery already opened by the caller (see
+// Scene), which must outlive the object, and options
+// *******************************************************************
+Pansharpen::Pansharpen( Scene& Inputs,PansharpenOptions Opts ) {
+  ImageryFileNames = Inputs.FileNames();
+  Options          = Opts;
+  SharedScene      = &Inputs;
+}
+
+static GDALDataset* WrapRaster( PansharpenRaster const& Raster,int Bands ) {
+  /* *************************************************************************
+   * GDALDataset* WrapRaster( PansharpenRaster const&,int ):
+   *
+   * This function wraps the first Bands bands of a raster held in memory
+   * by the caller in a GDAL in-memory (MEM) dataset, without copying the
+   * pixels: the bands point at the caller's pixels (DATAPOINTER), with the
+   * caller's strides. Reads and writes of the dataset go straight to the
+   * caller's memory, which must outlive the dataset.
+   *
+   * Args:
+   *   PansharpenRaster const& : raster to wrap.
+   *   int : number of bands to wrap.
+   * Returns:
+   *   GDALDataset* : MEM dataset (close with GDALClose()), or nullptr.
+   */
+  GDALDriver *driverMem = GetGDALDriverManager()->GetDriverByName( "MEM" );
+  if( driverMem == nullptr ) return nullptr;
+  GDALDataset *Dataset = driverMem->Create( "",Raster.Cols,Raster.Rows,0,Raster.Type,nullptr );
+  if( Dataset == nullptr ) return nullptr;
+
+  GSpacing PixelStride = Raster.PixelStride ? Raster.PixelStride : GDALGetDataTypeSizeBytes( Raster.Type );
+  GSpacing LineStride  = Raster.LineStride  ? Raster.LineStride  : PixelStride*Raster.Cols;
+  GSpacing BandStride  = Raster.BandStride  ? Raster.BandStride  : LineStride*Raster.Rows;
+  for( int band=0; band<Bands; band++ ) {
+    char Pointer[64];
+    Pointer[ CPLPrintPointer( Pointer,(char*)Raster.Data+band*BandStride,sizeof(Pointer)-1 ) ] = '\0';
+    char **papszBandOptions = nullptr;
+    papszBandOptions = CSLAddString( papszBandOptions,( String( "DATAPOINTER=" )+Pointer ).c_str() );
+    papszBandOptions = CSLAddString( papszBandOptions,( "PIXELOFFSET="+std::to_string( PixelStride ) ).c_str() );
+    papszBandOptions = CSLAddString( papszBandOptions,( "LINEOFFSET="+std::to_string( LineStride ) ).c_str() );
+    CPLErr e_Band = Dataset->AddBand( Raster.Type,papszBandOptions );
+    CSLDestroy( papszBandOptions );
+    if( !(e_Band == 0) ) {
+      GDALClose( Dataset );
+      return nullptr;
+    }
+    if( Raster.HasNoData ) Dataset->GetRasterBand( band+1 )->SetNoDataValue( Raster.NoDataValue );
+  }
+  Dataset->SetGeoTransform( (double*)Raster.GeoTransform );
+  if( !Raster.Projection.empty() ) Dataset->SetProjection( Raster.Projection.c_str() );
+  return Dataset;
+}
+
+static GDALDataset* ReopenPartialOutput( String const& Filename,int Cols,int Rows,int Bands,
+  GDALDataType Type ) {
+  /* *********************************************************************
+   * GDALDataset* ReopenPartialOutput( String const&,int,int,int,
+   *   GDALDataType ):
+   *
+   * This function opens the partial output Geotiff of an interrupted run
+   * for update (--resume flag), if it exists and has the expected size,
+   * number of bands, and data type.
+   *
+   * Args:
+   *   String const& : name of the partial output.
+   *   int : expected number of columns.
+   *   int : expected number of rows.
+   *   int : expected number of bands.
+   *   GDALDataType : expected data type.
+   * Returns:
+   *   GDALDataset* : dataset opened for update, or nullptr.
+   */
+  if( !std::filesystem::exists( Filename ) ) return nullptr;
+  GDALDataset *Dataset = (GDALDataset*) GDALOpen( Filename.c_str(),GA_Update );
+  if( Dataset == nullptr ) return nullptr;
+  if( Dataset->GetRasterXSize() != Cols || Dataset->GetRasterYSize() != Rows ||
+      Dataset->GetRasterCount() != Bands || Dataset->GetRasterBand(1)->GetRasterDataType() != Type ) {
+    GDALClose( Dataset );
+    return nullptr;
+  }
+  return Dataset;
+}
+
+static ThreadTiming* ThreadTimingOf( PansharpenOptions const& Options,const char* Role,int Index ) {
+  /* *********************************************************************
+   * ThreadTiming* ThreadTimingOf( PansharpenOptions const&,const char*,
+   *   int ):
+   *
+   * This function returns the timing counters of a thread of the run
+   * (see SceneTiming::Thread()), or nullptr if the run is not timed.
+   *
+   * Args:
+   *   PansharpenOptions const& : options of the run.
+   *   const char* : role of the thread (main, reader, compute, writer).
+   *   int : index of the thread within its role.
+   * Returns:
+   *   ThreadTiming* : counters of the thread, or nullptr.
+   */
+  return Options.Timing ? Options.Timing->Thread( Role,Index ) : nullptr;
+}
+
+Scene& Pansharpen::OpenScene() {
+  /* *************************************************************************
+   * Scene& Pansharpen::OpenScene():
+   *
+   * This function returns the opened imagery of the object: the scene of
+   * the caller, or else a scene of its own, opened the first time (each
+   * file, or raster in memory, opened once, see Scene).
+   *
+   * Args:
+   *   None.
+   * Returns:
+   *   Scene& : the opened imagery. Throws PansharpenError if an image
+   *   cannot be opened.
+   */
+  if( SharedScene != nullptr ) return *SharedScene;
+  if( OwnScene == nullptr ) {
+    std::unique_ptr<Scene> Inputs( new Scene( ImageryFileNames ) );
+    for( auto const& [Key,Raster] : MemoryImagery ) {
+      GDALDataset *Dataset = WrapRaster( Raster,1 );
+      if( Dataset == nullptr ) {
+        throw PansharpenError( "Unable to open "+Key+" raster in memory." );
+      }
+      Inputs->Add( Key,Dataset,"" );
+    }
+    OwnScene = std::move( Inputs );
+  }
+  return *OwnScene;
+}
+
+bool Pansharpen::HasImage( String const& Key ) const {
+  // is there an image (file or raster in memory) under this key?
+  return ImageryFileNames.count( Key )>0 || MemoryImagery.count( Key )>0;
+}
+
+GDALDataset* Pansharpen::OpenImage( String const& Key ) const {
+  /* *************************************************************************
+   * GDALDataset* Pansharpen::OpenImage( String const& ):
+   *
+   * This function opens one of the images (e.g. "pan", "red", or 
+   * "red_resampled") as a read-only GDAL dataset: the Geotiff file of
+   * that key, or a MEM dataset wrapping the caller's raster (see 
+   * WrapRaster()). Each call opens a new dataset, so that each thread 
+   * can own its own handle.
+   *
+   * Args:
+   *   String const& : key of the image.
+   * Returns:
+   *   GDALDataset* : dataset (close with GDALClose()), or nullptr.
+   */
+  auto Memory = MemoryImagery.find( Key );
+  if( Memory != MemoryImagery.end() ) return WrapRaster( Memory->second,1 );
+  auto File = ImageryFileNames.find( Key );
+  if( File == ImageryFileNames.end() ) return nullptr;
+  return (GDALDataset*) GDALOpen( File->second.c_str(),GA_ReadOnly );
+}
+
+// define C++ structure holding one entry of the table of pan-sharpening
+// engines: WritePansharpenedImagery() instantiated for one (pan, 
+// multispectral) pixel type pair of PIXEL_TYPE_PAIRS (see Kernels.h)
+// **********************************************************************
+struct SharpenEngine {
+  GDALDataType PanType;
+  GDALDataType MSType;
+  void (Pansharpen::*Write)( int,const char* );
+};
+#define SHARPEN_ENGINE( P,T ) { GDALTypeOf<P>(),GDALTypeOf<T>(),&Pansharpen::WritePansharpenedImagery<P,T> },
+static const SharpenEngine SHARPEN_ENGINES[] = { PIXEL_TYPE_PAIRS( SHARPEN_ENGINE ) };
+#undef SHARPEN_ENGINE
+
+static const SharpenEngine* FindSharpenEngine( GDALDataType PanType,GDALDataType MSType ) {
+  // engine of a (pan, multispectral) data type pair, or nullptr if the
+  // pair has no engine
+  for( SharpenEngine const& Engine : SHARPEN_ENGINES ) {
+    if( Engine.PanType == PanType && Engine.MSType == MSType ) return &Engine;
+  }
+  return nullptr;
+}
+
+static GDALDataType MultispectralDataType( Scene const& Imgs ) {
+  // data type of the multispectral imagery of a scene (of its first 
+  // multispectral image, resampled or not), or GDT_Unknown if it has none
+  for( const char* Key : { "ms_resampled","ms","red_resampled","red" } ) {
+    if( Imgs.Has( Key ) ) return Imgs.Image( Key ).Type;
+  }
+  return GDT_Unknown;
+}
+
+bool Pansharpen::ImageryHasSupportedDataTypes( Scene const& Imgs ) {
   /* ******************************************************************************
-   * bool Pansharpen::ImageryHasOneDataType( std::map<String,String>& ):
+   * bool Pansharpen::ImageryHasSupportedDataTypes( Scene const& ):
    *
    * This function returns a boolean True or False to determine if
-   * each of the geotiffs for the Red,Green,Blue, NIR, and 
-   * panchromatic bands all have the same data-type (as indicated
-   * by a GDAL data-type integer). To this end, the data-types of
-   * each of these 5 images is stored into a C++ integer array.
-   *
-   * Then, the standard deviation of this array is computed.
-   * If the standard deviation is grater than zero, then the imput
-   * imagery (geotiffs) have more than one data-type, so this 
-   * function returns false; otherwise, this function returns
-   * true if the standard deviation is zero. 
+   * the imagery of a scene can be pan-sharpened without converting
+   * it: every band of the Red,Green,Blue, and NIR images (or of a
+   * multi-band multispectral image) should have the same data-type,
+   * and the panchromatic image should have either that data-type or
+   * a floating-point one (e.g. a calibrated Float32 pan image with
+   * UInt16 multispectral imagery), i.e. a pair of PIXEL_TYPE_PAIRS.
    *
    * Args:
-   *   std::map<std::string,std::string>& : reference to map with image filenames.
+   *   Scene const& : reference to the scene (opened imagery).
    * Returns:
    *   bool: true or false.
    */
 
-  // 5 element array. because there are 5 images:
-  //   red,green,blue,NIR, and panchromatic images (5 files)
-  // *******************************************************
-  GDALAllRegister();
-  long ImageDataTypes[N_IMAGES];
-
-  // iterate through imagery and get the GDAL
-  // data type
-  // ****************************************
-  int ImgCounter  = 0;
-  GDALDataset *ds = nullptr;
-  GDALDataType dtype;
-  
-  for( auto const& [FileNameKey,ImgFileName] : Imgs ) {
-    // open up the dataset as GDAL dataset
-    // ***********************************	 
-    ds = (GDALDataset*) GDALOpen( ImgFileName.c_str(),GA_ReadOnly );
-    dtype = GDALGetRasterDataType( ds->GetRasterBand(1));
-    ImageDataTypes[ImgCounter] = dtype;
-    GDALClose(ds);
-    ++ImgCounter;
-  }
-
-  // compute the standard deviation.
-  //   if std. dev > 0: return false, else return true
-  // *************************************************
-  float stdDev = 0.0;
-  float total  = 0.0;
-  float mean   = 0.0;
-  ImgCounter   = 0;
-
-  // append total
-  // ************
-  while( ImgCounter<N_IMAGES ) {
-    total += ImageDataTypes[ImgCounter];
-    ImgCounter++;
-  }
-
-  // calculate total. reset counter.
-  // *******************************
-  mean = total/((float)N_IMAGES);
-  ImgCounter = 0;
-
-  // compute standard deviation
-  // **************************
-  while( ImgCounter<N_IMAGES ){
-    stdDev += pow( ImageDataTypes[ImgCounter]-mean,2 );
-    ImgCounter++;
+  // iterate through the multispectral imagery and compare each of
+  // their GDAL data types (read when the scene was opened)
+  // ***************************************************************
+  GDALDataType MSType = MultispectralDataType( Imgs );
+  for( auto const& [FileNameKey,ImgFileName] : Imgs.FileNames() ) {
+    if( FileNameKey == "pan" ) continue;
+    for( GDALDataType dtype : Imgs.Image( FileNameKey ).BandTypes ) {
+      if( dtype != MSType ) return false;
+    }
   }
+  if( !Imgs.Has( "pan" ) ) return false;
 
-  // calculate final value of standard deviation
-  // *******************************************
-  stdDev = sqrt( stdDev / (float)N_IMAGES );
-  
-  // if standard deviation of data types > 0, then we have
-  // more than one data type. return false. else, return true.
-  // *********************************************************
-  if( stdDev>0.0 ) {
-    return false;
-  } else {
-    return true;
+  // the (pan, multispectral) pair should have its own engine
+  // ********************************************************
+  return FindSharpenEngine( Imgs.Image( "pan" ).Type,MSType ) != nullptr;
+}
+
+Window Pansharpen::RegionOfInterest( GDALDataset* panDataset,PansharpenOptions const& Options ) {
+  /* ******************************************************************************
+   * Window Pansharpen::RegionOfInterest( GDALDataset*,PansharpenOptions const& ):
+   *
+   * This function returns the region of interest of a run as a window of
+   * the panchromatic grid: the whole image by default, the window given
+   * with the --window flag (which must lie inside of the image), or the
+   * pixels that intersect the bounding box given with the --bbox flag
+   * (clipped to the image). A bounding box in another SRS is transformed
+   * to the SRS of the panchromatic image along its densified edges, so 
+   * that the region covers all of it.
+   *
+   * Args:
+   *   GDALDataset* : panchromatic dataset.
+   *   PansharpenOptions const& : options of the run.
+   * Returns:
+   *   Window : region of interest. Throws PansharpenError if the region is
+   *   invalid, or does not overlap the panchromatic image.
+   */
+  int N_COLS = panDataset->GetRasterXSize();
+  int N_ROWS = panDataset->GetRasterYSize();
+  Window Region = { 0,0,N_COLS,N_ROWS };
+
+  // pixel window: validate it against the panchromatic image
+  // ********************************************************
+  if( Options.HasRegionWindow ) {
+    Window const& W = Options.RegionWindow;
+    if( W.xsize<1 || W.ysize<1 || W.xoff<0 || W.yoff<0 ||
+        (long)W.xoff+W.xsize>N_COLS || (long)W.yoff+W.ysize>N_ROWS ) {
+      throw PansharpenError( "--window "+std::to_string( W.xoff )+","+std::to_string( W.yoff )+","+
+        std::to_string( W.xsize )+","+std::to_string( W.ysize )+" is not inside of the "+
+        std::to_string( N_COLS )+" x "+std::to_string( N_ROWS )+" panchromatic image." );
+    }
+    return W;
+  }
+  if( !Options.HasRegionBBox ) return Region;
+
+  // bounding box: sample its edges (in its own SRS), and transform the
+  // samples to the SRS of the panchromatic image if needed
+  // ******************************************************************
+  double const* B = Options.RegionBBox;
+  if( !( B[0]<B[2] ) || !( B[1]<B[3] ) ) {
+    throw PansharpenError( "--bbox should be minx,miny,maxx,maxy with minx < maxx and miny < maxy." );
+  }
+  const int N_EDGE = 21;
+  std::vector<double> X,Y;
+  for( int i=0; i<N_EDGE; i++ ) {
+    double t = (double)i/( N_EDGE-1 );
+    X.push_back( B[0]+t*( B[2]-B[0] ) ); Y.push_back( B[1] );
+    X.push_back( B[0]+t*( B[2]-B[0] ) ); Y.push_back( B[3] );
+    X.push_back( B[0] ); Y.push_back( B[1]+t*( B[3]-B[1] ) );
+    X.push_back( B[2] ); Y.push_back( B[1]+t*( B[3]-B[1] ) );
+  }
+  if( !Options.RegionSRS.empty() ) {
+    OGRSpatialReference SourceSRS,PanSRS;
+    if( SourceSRS.SetFromUserInput( Options.RegionSRS.c_str() ) != OGRERR_NONE ) {
+      throw PansharpenError( "Unable to interpret --bbox SRS "+Options.RegionSRS+"." );
+    }
+    if( PanSRS.importFromWkt( panDataset->GetProjectionRef() ) != OGRERR_NONE ) {
+      throw PansharpenError( "--bbox has an SRS, but the panchromatic image has no projection." );
+    }
+    SourceSRS.SetAxisMappingStrategy( OAMS_TRADITIONAL_GIS_ORDER );
+    PanSRS.SetAxisMappingStrategy( OAMS_TRADITIONAL_GIS_ORDER );
+    OGRCoordinateTransformation *Transform = OGRCreateCoordinateTransformation( &SourceSRS,&PanSRS );
+    bool Transformed = Transform != nullptr && Transform->Transform( (int)X.size(),X.data(),Y.data() );
+    OGRCoordinateTransformation::DestroyCT( Transform );
+    if( !Transformed ) {
+      throw PansharpenError( "Unable to transform --bbox from "+Options.RegionSRS+
+        " to the SRS of the panchromatic image." );
+    }
   }
+
+  // the pixels of the panchromatic grid that the box touches (a small
+  // tolerance keeps box edges on pixel edges from adding a pixel)
+  // *****************************************************************
+  double gt[6] = { 0.0,1.0,0.0,0.0,0.0,1.0 };
+  double inv[6];
+  panDataset->GetGeoTransform( gt );
+  if( !GDALInvGeoTransform( gt,inv ) ) {
+    throw PansharpenError( "panchromatic image has a geotransform that cannot be inverted." );
+  }
+  double minCol = HUGE_VAL,minRow = HUGE_VAL,maxCol = -HUGE_VAL,maxRow = -HUGE_VAL;
+  for( size_t i=0; i<X.size(); i++ ) {
+    double Col,Row;
+    GDALApplyGeoTransform( inv,X[i],Y[i],&Col,&Row );
+    minCol = std::min( minCol,Col ); maxCol = std::max( maxCol,Col );
+    minRow = std::min( minRow,Row ); maxRow = std::max( maxRow,Row );
+  }
+  const double EPS = 1e-6;
+  double x0 = std::max( 0.0,std::floor( minCol+EPS ) );
+  double y0 = std::max( 0.0,std::floor( minRow+EPS ) );
+  double x1 = std::min( (double)N_COLS,std::ceil( maxCol-EPS ) );
+  double y1 = std::min( (double)N_ROWS,std::ceil( maxRow-EPS ) );
+  if( !( x0<x1 ) || !( y0<y1 ) ) {
+    throw PansharpenError( "--bbox does not overlap the panchromatic image." );
+  }
+  Region.xoff  = (int)x0;
+  Region.yoff  = (int)y0;
+  Region.xsize = (int)( x1-x0 );
+  Region.ysize = (int)( y1-y0 );
+  return Region;
 }
 
 void Pansharpen::PansharpenImagery( int n_out_bands,const char* OutDir ) {
   /* ******************************************************
    * Pansharpen::PansharpenImagery( int n_out_bands ):
    * 
-   * This function uses a C++ switch{} statement to pass the 
-   * approprate C++ data type to the template function 
+   * This function looks up the approprate C++ data types (of
+   * the panchromatic and multispectral imagery) in a table of
+   * instantiations of the template function 
    * WritePansharpenedImagery (see below). This latter
    * function writes out a pair of geotiffs containing
    * pansharpened imagery (with either 3 or 4 bands for
@@ -118,82 +398,393 @@ void Pansharpen::PansharpenImagery( int n_out_bands,const char* OutDir ) {
    * Args:
    *   n_out_bands (int): Integer , should be 3 or 4.
    * Returns:
+   *   None. Void. Throws PansharpenError if the imagery cannot be
+   *   pan-sharpened (e.g. an image file cannot be read).
+   */
+
+  // open up the imagery (once, see Scene) ... get GDAL data-types
+  // of the panchromatic and multispectral imagery.
+  // **************************************************************
+  String PanName   = ImageryFileNames.count( "pan" ) ? ImageryFileNames.at( "pan" ) : String( "(in memory)" );
+  GDALDataType PanType,MSType;
+  {
+    StageTimer Timer( ThreadTimingOf( Options,"main",0 ),STAGE_OPEN );
+    Scene& Inputs = OpenScene();
+    if( !Inputs.Has( "pan" ) ) {
+      throw PansharpenError( "Unable to open panchromatic image "+PanName+"." );
+    }
+    PanType = Inputs.Image( "pan" ).Type;
+    MSType  = MultispectralDataType( Inputs );
+  }
+
+  // clean up resampled imagery (if it was written to disk by
+  // ResampleImageGeotiffs()) once it is no longer needed, 
+  // whether or not the pan-sharpening succeeds
+  // ********************************************************
+  auto RemoveResampledImagery = [this]() {
+    String ResampledSuffix( "_resampled" );
+    for( auto const& [FileNameKey,ImgFileName] : ImageryFileNames ) {
+      if( FileNameKey.size()<ResampledSuffix.size() || FileNameKey.compare( 
+          FileNameKey.size()-ResampledSuffix.size(),ResampledSuffix.size(),ResampledSuffix ) != 0 ) {
+        continue;
+      } else {
+        // remove the bicubic resampled image file ... no longer needed
+        // ************************************************************
+        std::remove( ImgFileName.c_str() );
+      }
+    }
+  };
+
+  try {
+    // look up the engine of the (pan, multispectral) data type pair
+    // *************************************************************
+    if( PanType == GDT_Unknown || MSType == GDT_Unknown ) {
+      throw PansharpenError( "image has unknown pixel data type: "+PanName+"." );
+    }
+    const SharpenEngine* Engine = FindSharpenEngine( PanType,MSType );
+    if( Engine == nullptr ) {
+      throw PansharpenError( String( "panchromatic data type " )+GDALGetDataTypeName( PanType )+
+        " is not supported with multispectral data type "+GDALGetDataTypeName( MSType )+
+        " (the pan should have the same data type, or Float32 or Float64)." );
+    }
+    ( this->*Engine->Write )( n_out_bands,OutDir );
+  } catch( ... ) {
+    RemoveResampledImagery();
+    throw;
+  }
+  RemoveResampledImagery();
+}
+
+// keys (in the map of image filenames), names, and command-line flags
+// of the multispectral images, in the order of the output bands
+// (red,green,blue, and NIR)
+// *******************************************************************
+static const char* MS_KEYS[4]  = { "red","green","blue","nir" };
+static const char* MS_NAMES[4] = { "red","green","blue","NIR" };
+static const char* MS_FLAGS[4] = { "-r","-g","-b","-n" };
+
+// define C++ structure holding, for each multispectral image, whether
+// it is resampled with the fused bicubic upsampler, and if so, how its
+// grid lines up with the panchromatic grid (see IntegerRatioAlignment()).
+// For imagery held in memory by the caller, DirectPan and Direct[k] 
+// point at the caller's pixels when windows can be used in place 
+// (packed rows, full-width windows, already on the panchromatic grid):
+// such images are neither read nor resampled. Windows are laid out on
+// the region of interest, which starts at (XOff,YOff) of the pan grid;
+// resampled Geotiffs written to disk (Resampled[k]) cover just the 
+// region. With a multi-band multispectral image (MultiBand, imagery key
+// "ms"), bands MSBands[k] of it are the output bands, and entry 0 of 
+// Fused, Resampled, and Grid holds the plan of the whole image.
+// **********************************************************************
+typedef struct {
+  bool MultiBand;
+  int MSBands[4];
+  bool Fused[4];
+  bool Resampled[4];
+  GridAlignment Grid[4];
+  int XOff,YOff;
+  const void *DirectPan;
+  const void *Direct[4];
+} ResamplePlan;
+
+// define C++ structure holding the state of one reader thread of the
+// pipeline. GDAL dataset handles are not thread-safe, so each reader
+// opens and owns its own handles for the input imagery. The 
+// multispectral image k is resampled to the panchromatic grid either by
+// the fused bicubic Upsampler[k] reading msSource[k] (integer resolution
+// ratio, aligned grids), or through msDataset[k]: a warped VRT of 
+// msSource[k], or a resampled Geotiff written by ResampleImageFile() 
+// (msSource[k] unused). A multi-band multispectral image is opened once,
+// as entry 0, and all of its bands are read together.
+// ***********************************************************************
+template<typename T>
+struct SharpenWorker {
+  GDALDataset *panDataset   = nullptr;
+  GDALDataset *msSource[4]  = { nullptr,nullptr,nullptr,nullptr };
+  GDALDataset *msDataset[4] = { nullptr,nullptr,nullptr,nullptr };
+  BicubicUpsampler<T> *Upsampler[4] = { nullptr,nullptr,nullptr,nullptr };
+  ThreadTiming *Timing = nullptr; // see --stats-json
+};
+
+// define C++ structure holding one window of input imagery (panchromatic
+// and resampled multispectral), passed from the reader to the compute
+// stage of the pipeline. The pixels are read into the buffers of 
+// PanStorage (of the pan data type P) and Storage (red,green,blue, and
+// NIR, of the multispectral data type T), or are used in place from the
+// caller's memory (see ResamplePlan). For a multi-band multispectral 
+// image, Storage[0] holds all of its bands (MSBandStride pixels apart),
+// and Storage[1] to Storage[3] point into it.
+// **********************************************************************
+template<typename P,typename T>
+struct InputWindow {
+  Window win;
+  size_t Task = 0; // index of the window in the sharpen pass
+  const P *pan   = nullptr;
+  const T *ms[4] = { nullptr,nullptr,nullptr,nullptr };
+  P *PanStorage  = nullptr;
+  T *Storage[4]  = { nullptr,nullptr,nullptr,nullptr };
+  size_t MSBandStride = 0;
+};
+
+// define C++ structure holding one window of output bands (of the
+// output data type) for each selected method, passed from the compute
+// stage to the writer stages. Pending counts the writers that have not
+// written it yet; the last one to finish recycles it.
+// ********************************************************************
+struct OutputWindow {
+  Window win;
+  size_t Task = 0;
+  void *out[ N_METHODS ] = { nullptr };
+  std::atomic<int> Pending;
+};
+
+template<typename Queue,typename Item>
+static bool TimedPop( Queue& Q,Item& I,ThreadTiming* Timing ) {
+  // pop from a pipeline queue, timing how long the thread is blocked
+  StageTimer Wait( Timing,STAGE_WAIT );
+  return Q.Pop( I );
+}
+
+template<typename Queue,typename Item>
+static void TimedPush( Queue& Q,Item I,ThreadTiming* Timing ) {
+  // push onto a pipeline queue, timing how long the thread is blocked
+  StageTimer Wait( Timing,STAGE_WAIT );
+  Q.Push( I );
+}
+
+template<typename T>
+static void OpenSharpenWorker( SharpenWorker<T>& Worker,Pansharpen const& Imgs,
+  ResamplePlan const& Plan,int N_bands ) {
+  /* *********************************************************************
+   * void OpenSharpenWorker( SharpenWorker<T>&,Pansharpen const&,
+   *   ResamplePlan const&,int ):
+   *
+   * This function opens the panchromatic Geotiff and the first N_bands
+   * multispectral (Red,Green,Blue, and NIR) Geotiffs as GDAL datasets 
+   * owned by one reader thread. If there is a "<band>_resampled"
+   * Geotiff (written to disk by ResampleImageGeotiffs()), then that file
+   * is read. Otherwise the multispectral Geotiff is resampled on the fly
+   * to the panchromatic grid, by the fused bicubic upsampler if the plan
+   * says so, or else through a warped VRT (see CreateResampledVRT()).
+   * Images held in memory are opened the same way (see OpenImage()),
+   * except for those used in place, which are not opened at all. A 
+   * multi-band multispectral image ("ms", or "ms_resampled") is opened
+   * once, with one upsampler or warped VRT for all of its bands.
+   *
+   * Args:
+   *   SharpenWorker<T>& : worker to open datasets for.
+   *   Pansharpen const& : imagery to open (files or memory).
+   *   ResamplePlan const& : how each multispectral image is resampled.
+   *   int : number of output bands (3 or 4).
+   * Returns:
+   *   None. Void. Throws PansharpenError if any of the imagery cannot be
+   *   opened (datasets opened so far are closed by CloseSharpenWorker()).
+   */
+  StageTimer Timer( Worker.Timing,STAGE_OPEN );
+  Worker.panDataset = Imgs.OpenImage( "pan" );
+  if( Worker.panDataset == nullptr ) {
+    throw PansharpenError( "Unable to open panchromatic image file (e.g. using -p flag)." );
+  }
+
+  if( Plan.MultiBand ) {
+    int BandMap[4];
+    std::copy( Plan.MSBands,Plan.MSBands+4,BandMap );
+    if( Imgs.HasImage( "ms_resampled" ) ) {
+      Worker.msDataset[0] = Imgs.OpenImage( "ms_resampled" );
+    } else {
+      Worker.msSource[0]  = Imgs.OpenImage( "ms" );
+      if( Worker.msSource[0] != nullptr && Plan.Fused[0] ) {
+        Worker.Upsampler[0] = new BicubicUpsampler<T>( 
+          Worker.msSource[0],N_bands,BandMap,Plan.Grid[0] );
+      } else if( Worker.msSource[0] != nullptr ) {
+        Worker.msDataset[0] = (GDALDataset*) CreateResampledVRT( 
+          Worker.msSource[0],Worker.panDataset,N_bands,BandMap );
+      }
+    }
+    if( Worker.msDataset[0] == nullptr && Worker.Upsampler[0] == nullptr ) {
+      throw PansharpenError( "Unable to open or resample multispectral image file (e.g. using --ms flag)." );
+    }
+    return;
+  }
+
+  for( int band=0; band<N_bands; band++ ) {
+    if( Plan.Direct[band] != nullptr ) continue;
+    String ResampledKey = String( MS_KEYS[band] )+"_resampled";
+    if( Imgs.HasImage( ResampledKey ) ) {
+      Worker.msDataset[band] = Imgs.OpenImage( ResampledKey );
+    } else {
+      Worker.msSource[band]  = Imgs.OpenImage( MS_KEYS[band] );
+      if( Worker.msSource[band] != nullptr && Plan.Fused[band] ) {
+        Worker.Upsampler[band] = new BicubicUpsampler<T>( 
+          Worker.msSource[band]->GetRasterBand(1),Plan.Grid[band] );
+      } else if( Worker.msSource[band] != nullptr ) {
+        Worker.msDataset[band] = (GDALDataset*) CreateResampledVRT( 
+          Worker.msSource[band],Worker.panDataset );
+      }
+    }
+
+    // make sure the (resampled) multispectral image was opened
+    // ********************************************************
+    if( Worker.msDataset[band] == nullptr && Worker.Upsampler[band] == nullptr ) {
+      throw PansharpenError( String( "Unable to open or resample " )+MS_NAMES[band]+
+        " image file (e.g. using "+MS_FLAGS[band]+" flag)." );
+    }
+  }
+}
+
+template<typename T>
+static void CloseSharpenWorker( SharpenWorker<T>& Worker ) {
+  /* *********************************************************************
+   * void CloseSharpenWorker( SharpenWorker<T>& ):
+   *
+   * This function closes the GDAL datasets owned by one reader thread 
+   * (see OpenSharpenWorker()). Warped VRTs are closed before the source
+   * datasets they read from.
+   *
+   * Args:
+   *   SharpenWorker<T>& : worker to close datasets for.
+   * Returns:
    *   None. Void.
    */
+  if( Worker.panDataset == nullptr ) return;
 
-  // open up panchromatic dataset ... get GDAL data-type.
-  // ****************************************************
-  GDALDataset *Pan = nullptr;
-  Pan = (GDALDataset*) GDALOpen( 
-    this->ImageryFileNames[ "pan" ].c_str(),GA_ReadOnly );
-  GDALDataType GDAL_DataType  = GDALGetRasterDataType(Pan->GetRasterBand(1));
-  GDALClose(Pan);
-
-  switch( GDAL_DataType )
-  { // check each of different GDAL imagery data types.
-    case 0:
-      printf("image file has unknown pixel data type: %s. Exiting ...\n",
-        ImageryFileNames["pan"]);
-      exit(1);
-    case 1:
-      // GDAL GDT_Byte (-128 to 127) - unsigned  char
-      WritePansharpenedImagery<unsigned char>( n_out_bands,OutDir );
-      break; 
-    case 2:
-      // GDAL GDT_UInt16 - short
-      WritePansharpenedImagery<unsigned short>( n_out_bands,OutDir );
-      break;
-    case 3:
-      // GDT_Int16
-      WritePansharpenedImagery<short>( n_out_bands,OutDir );
-      break;
-    case 4:
-      // GDT_UInt32
-      WritePansharpenedImagery<unsigned int>( n_out_bands,OutDir );
-      break;
-    case 5:
-      // GDT_Int32
-      WritePansharpenedImagery<int>( n_out_bands,OutDir );
-      break;
-    case 6:
-      // GDT_Float32
-      WritePansharpenedImagery<float>( n_out_bands,OutDir );
-      break;
-    case 7:
-      // GDT_Float64
-      WritePansharpenedImagery<double>( n_out_bands,OutDir );
-      break;
-    default:     
-      printf("ERROR (fatal): unknown GDAL imagery data type. Exiting ...");
-      exit(1);
-  }
-
-  // clean up resampled imagery as it is no longer needed
-  // ****************************************************
-  for( auto const& [FileNameKey,ImgFileName] : ImageryFileNames ) {
-    if( FileNameKey == "pan" ) {
-      continue;
+  // close all Geotiff datasets
+  // **************************
+  for( int band=0; band<4; band++ ) {
+    delete Worker.Upsampler[band];
+    Worker.Upsampler[band] = nullptr;
+    if( Worker.msDataset[band] != nullptr ) GDALClose( Worker.msDataset[band] );
+    if( Worker.msSource[band]  != nullptr ) GDALClose( Worker.msSource[band]  );
+    Worker.msDataset[band] = nullptr;
+    Worker.msSource[band]  = nullptr;
+  }
+  GDALClose( Worker.panDataset );
+  Worker.panDataset = nullptr;
+}
+
+template<typename P,typename T>
+static void ReadWindow( SharpenWorker<T>& Worker,InputWindow<P,T>& In,ResamplePlan const& Plan,
+  int N_bands ) {
+  /* *********************************************************************
+   * void ReadWindow( SharpenWorker<T>&,InputWindow<P,T>&,ResamplePlan const&,
+   *   int ):
+   *
+   * This function reads the window In.win of the panchromatic and 
+   * (resampled) Red,Green,Blue, and NIR imagery into the buffers of In.
+   * The NIR window is only read for 4-band (RGB/NIR) output. The window
+   * is relative to the region of interest (see ResamplePlan). Images 
+   * used in place are not read: In points at the window in the caller's
+   * memory instead. The bands of a multi-band multispectral image are
+   * read with one band-interleaved RasterIO() (or upsampler) call. The
+   * pan is read as data type P, and the multispectral bands as data 
+   * type T.
+   *
+   * Args:
+   *   SharpenWorker<T>& : worker whose datasets are read.
+   *   InputWindow<P,T>& : window to read, and buffers to read it into.
+   *   ResamplePlan const& : how each image is read.
+   *   int : number of output bands (3 or 4).
+   * Returns:
+   *   None. Void. Throws PansharpenError if any of the bands cannot be read.
+   */
+  Window const& win = In.win;
+  GDALDataType panType = GDALTypeOf<P>();
+  GDALDataType msType  = GDALTypeOf<T>();
+  StageTimer Timer( Worker.Timing,STAGE_READ );
+  size_t nPixels = (size_t)win.xsize*(size_t)win.ysize;
+  size_t nBytes = 0; // bytes read (of images not used in place)
+
+  // the window on the panchromatic grid; windows used in place are 
+  // whole rows of packed pixels
+  // ***************************************************************
+  Window panWin = { win.xoff+Plan.XOff,win.yoff+Plan.YOff,win.xsize,win.ysize };
+  size_t Offset = (size_t)panWin.yoff*(size_t)win.xsize;
+
+  // read the window into the dynamically allocated window-buffer,
+  // and make sure we are able to read all bands
+  // *************************************************************
+  CPLErr e_Pan = CE_None;
+  if( Plan.DirectPan != nullptr ) {
+    In.pan = (const P*)Plan.DirectPan+Offset;
+  } else {
+    In.pan = In.PanStorage;
+    nBytes += nPixels*sizeof(P);
+    e_Pan  = Worker.panDataset->GetRasterBand(1)->RasterIO( GF_Read,panWin.xoff,panWin.yoff,
+      win.xsize,win.ysize,In.PanStorage,win.xsize,win.ysize,panType,0,0 );
+  }
+  if( !(e_Pan == 0) ) {
+    throw PansharpenError( "Unable to read band from panchromatic image file (e.g. using -p flag)." );
+  }
+
+  if( Plan.MultiBand ) {
+    CPLErr e_MS = CE_None;
+    for( int band=0; band<N_bands; band++ ) In.ms[band] = In.Storage[band];
+    if( Worker.Upsampler[0] != nullptr ) {
+      e_MS = Worker.Upsampler[0]->ReadWindow( panWin,In.Storage );
     } else {
-      // remove the bicubic resampled image file ... no longer needed
-      // ************************************************************
-      std::remove( ImgFileName.c_str() );
+      // a resampled Geotiff holds every band of the image; a warped VRT
+      // holds the output bands, in order
+      // ***************************************************************
+      int BandMap[4] = { 1,2,3,4 };
+      if( Plan.Resampled[0] ) std::copy( Plan.MSBands,Plan.MSBands+4,BandMap );
+      Window const& msWin = Plan.Resampled[0] ? win : panWin;
+      e_MS = Worker.msDataset[0]->RasterIO( GF_Read,msWin.xoff,msWin.yoff,win.xsize,win.ysize,
+        In.Storage[0],win.xsize,win.ysize,msType,N_bands,BandMap,0,0,
+        (GSpacing)sizeof(T)*In.MSBandStride );
+    }
+    if( !(e_MS == 0) ) {
+      throw PansharpenError( "Unable to read bands from multispectral image file (e.g. using --ms flag)." );
     }
+    Timer.Count( nPixels,nBytes+nPixels*sizeof(T)*N_bands,0 );
+    return;
   }
 
+  for( int band=0; band<N_bands; band++ ) {
+    CPLErr e_MS = CE_None;
+    In.ms[band] = In.Storage[band];
+    if( Plan.Direct[band] != nullptr ) {
+      In.ms[band] = (const T*)Plan.Direct[band]+Offset;
+    } else if( Worker.Upsampler[band] != nullptr ) {
+      nBytes += nPixels*sizeof(T);
+      e_MS = Worker.Upsampler[band]->ReadWindow( panWin,In.Storage[band] );
+    } else {
+      nBytes += nPixels*sizeof(T);
+      Window const& msWin = Plan.Resampled[band] ? win : panWin;
+      e_MS = Worker.msDataset[band]->GetRasterBand(1)->RasterIO( GF_Read,msWin.xoff,msWin.yoff,
+        win.xsize,win.ysize,In.Storage[band],win.xsize,win.ysize,msType,0,0 );
+    }
+    if( !(e_MS == 0) ) {
+      throw PansharpenError( String( "Unable to read band from " )+MS_NAMES[band]+
+        " image file (e.g. using "+MS_FLAGS[band]+" flag)." );
+    }
+  }
+  Timer.Count( nPixels,nBytes,0 );
 }
 
 // template method
-template<typename T>
+template<typename P,typename T>
 void Pansharpen::WritePansharpenedImagery( int N_bands,const char* OutDir ) {
   /* ************************************************************ 
    * void Pansharpen::WritePansharpenedImagery( int N_bands ):
    * 
-   * This function writes out a pair of 3 or 4 band geotiffs
-   * for the pan-sharpened FIHS and Brovey imagery. If these
-   * pan-sharpened Geotiffs have 3 bands, then they are the
-   * Red,Green, and Blue (RGB) pan-sharpened bands. Otherwise,
-   * the Geotiffs contain the Red, Green, Blue, and NIR 
-   * band (or 4 bands).
+   * This function writes out a 3 or 4 band geotiff of the
+   * pan-sharpened imagery for each selected method (by default
+   * FIHS and Brovey, --method flag). If these pan-sharpened 
+   * Geotiffs have 3 bands, then they are the Red,Green, and 
+   * Blue (RGB) pan-sharpened bands. Otherwise, the Geotiffs 
+   * contain the Red, Green, Blue, and NIR band (or 4 bands).
+   *
+   * The imagery is processed in block-aligned windows, which flow
+   * through a pipeline of reader, compute, and writer threads 
+   * (Options.Threads readers and compute threads, -j flag, and one
+   * writer per output). Every window is computed the same way 
+   * regardless of which thread handles it, so the output does not
+   * depend on the number of threads.
+   *
+   * If any stage fails (e.g. a window cannot be read or written), the
+   * other stages stop early, all the datasets and buffers are released,
+   * the incomplete outputs are deleted, and the first error is thrown
+   * (see PansharpenError).
    *
    * Args:
    *   N_bands (int): Number of bands, should be 3 or 4.
@@ -201,253 +792,787 @@ void Pansharpen::WritePansharpenedImagery( int N_bands,const char* OutDir ) {
    *   None. Void.
    */
 
-  // get the name of the panchromatic geotiff, reads its attributes
-  // into a C structure into C++
-  // **************************************************************  
-  std::string PanFileName = this->ImageryFileNames[ "pan" ];
-  Geotiff PanGeotiff = ReadGeotiff( PanFileName.c_str() );
+  // the panchromatic image (Geotiff, or raster in memory), opened once
+  // with the rest of the imagery (see Scene). The main thread's own work
+  // (opening, creating, and closing datasets) is timed as thread "main"
+  // (--stats-json).
+  // *********************************************************************
+  ThreadTiming *MainTiming = ThreadTimingOf( Options,"main",0 );
+  StageTimer OpenTimer( MainTiming,STAGE_OPEN );
+  Scene& Inputs = OpenScene();
+  SceneImage const& Pan   = Inputs.Image( "pan" );
+  GDALDataset *panDataset = Pan.Dataset;
   
-  // read attrributes for panchromatic dataset
-  // *****************************************
-  const char* prj    = (const char*)PanGeotiff.projection;
-  double *gt         = PanGeotiff.geotransform;
-  double NoDataValue = PanGeotiff.NoDataValue;
+  // attrributes of the panchromatic dataset
+  // ***************************************
+  String prj         = Pan.Projection;
+  double gt[6];
+  std::copy( Pan.GeoTransform,Pan.GeoTransform+6,gt );
+  double NoDataValue = Pan.NoDataValue;
   
-  // read the 2d dimensions of the band
-  // **********************************
+  // the 2d dimensions of the band
+  // *****************************
   int N_COLS,N_ROWS;
-  N_COLS = PanGeotiff.xsize; // number of columns
-  N_ROWS = PanGeotiff.ysize; // number of rows
+  N_COLS = Pan.Cols; // number of columns
+  N_ROWS = Pan.Rows; // number of rows
 
-  // initialize GDAL datasets for Red,Green,Blue,NIR, and Panchromatic
-  // Geotiff image datasets.
-  // *****************************************************************
-  GDALDataset *panDataset   = nullptr;
-  GDALDataset *redDataset   = nullptr;
-  GDALDataset *greenDataset = nullptr;
-  GDALDataset *blueDataset  = nullptr;
-  GDALDataset *nirDataset   = nullptr;
-
-  // open up all datasets ... including Red,Green,Blue,Panchromatic,and NIR
-  // geotiffs. Open them as GDAL datasets.
-  // **********************************************************************
-  panDataset   = (GDALDataset*) GDALOpen( 
-    this->ImageryFileNames[ "pan"   ].c_str(),GA_ReadOnly );
-  redDataset   = (GDALDataset*) GDALOpen( 
-    this->ImageryFileNames[ "red_resampled"   ].c_str(),GA_ReadOnly );
-  greenDataset = (GDALDataset*) GDALOpen( 
-    this->ImageryFileNames[ "green_resampled" ].c_str(),GA_ReadOnly );
-  blueDataset  = (GDALDataset*) GDALOpen( 
-    this->ImageryFileNames[ "blue_resampled"  ].c_str(),GA_ReadOnly );
-  nirDataset   = (GDALDataset*) GDALOpen( 
-    this->ImageryFileNames[ "nir_resampled"   ].c_str(),GA_ReadOnly );
+  // the region of interest (--window or --bbox flags; by default the 
+  // whole image): only it is read and pan-sharpened, and the outputs
+  // cover just it, with the geotransform moved to its corner
+  // ****************************************************************
+  Window Region = RegionOfInterest( panDataset,Options );
+  int PAN_COLS = N_COLS;
+  double panGT[6];
+  std::copy( gt,gt+6,panGT );
+  N_COLS = Region.xsize;
+  N_ROWS = Region.ysize;
+  gt[0] += Region.xoff*panGT[1]+Region.yoff*panGT[2];
+  gt[3] += Region.xoff*panGT[4]+Region.yoff*panGT[5];
+  if( Options.Timing ) Options.Timing->Pixels = (uint64_t)N_COLS*(uint64_t)N_ROWS;
+  OpenTimer.Stop();
 
   // create GDAL driver object for writing geotiffs
   // **********************************************
   GDALDriver *driverGeotiff;
   driverGeotiff = GetGDALDriverManager()->GetDriverByName("GTiff");
  
+  // the selected pan-sharpening methods (see Methods.h): only these
+  // are computed, and only their outputs are created
+  // ***************************************************************
+  std::vector<int> Methods;
+  for( int method=0; method<N_METHODS; method++ ) {
+    if( Options.Methods & ( 1u<<method ) ) Methods.push_back( method );
+  }
+  int N_outputs = (int)Methods.size();
+
   // establish output filenames by joining them with the output directory
   // that was passed into this function
   // ********************************************************************
   std::filesystem::path Dir(OutDir);
 
-  std::filesystem::path OutNameFIHS("sharpened_FIHS.tif");
-  std::filesystem::path OutNameBrovey("sharpened_Brovey.tif");
-  
-  std::filesystem::path fullPathFIHS   = Dir / OutNameFIHS;
-  std::filesystem::path fullPathBrovey = Dir / OutNameBrovey; 
+  // file names of the outputs, of the partial outputs of a shard
+  // (--shard flag, see ShardFileName()), or of a preview (--preview
+  // flag, see PreviewFileName()). Outputs are written to 
+  // <name>.partial files, which are renamed once the run has succeeded,
+  // so an output never exists half-written under its own name. The 
+  // journal of the run (see Journal) sits next to them.
+  // *******************************************************************
+  String OutputFiles[ N_METHODS ];
+  String PartialFiles[ N_METHODS ];
+  for( int method=0; method<N_METHODS; method++ ) {
+    OutputFiles[method] = SHARPEN_METHODS[method].OutputFile;
+    if( HasPreview( Options ) ) {
+      OutputFiles[method] = PreviewFileName( SHARPEN_METHODS[method].OutputFile );
+    } else if( Options.ShardCount>0 ) {
+      OutputFiles[method] = ShardFileName( SHARPEN_METHODS[method].OutputFile,
+        Options.ShardIndex,Options.ShardCount );
+    }
+    PartialFiles[method] = OutputFiles[method]+".partial";
+  }
+  String JournalFile = "pansharpen.journal";
+  if( Options.ShardCount>0 ) {
+    JournalFile = ShardFileName( "pansharpen.journal",Options.ShardIndex,Options.ShardCount );
+  }
 
-  // begin to write the FIHS geotiff dataset
-  // ***************************************
-  GDALDataset *fihsDataset;
-  fihsDataset = driverGeotiff->Create( fullPathFIHS.c_str(),N_COLS,N_ROWS,N_bands,GDT_Float32,NULL );
-  fihsDataset->SetGeoTransform(gt);
-  fihsDataset->SetProjection(prj);
-
-  // begin to write Brovey geotiff dataset
-  // *************************************
-  GDALDataset *broveyDataset;
-  broveyDataset = driverGeotiff->Create( fullPathBrovey.c_str(),N_COLS,N_ROWS,N_bands,GDT_Float32,NULL );
-  broveyDataset->SetGeoTransform(gt);
-  broveyDataset->SetProjection(prj);
-
-  // get the band data-type as well as number of bytes
-  // per pixel
-  // *************************************************
-  GDALDataType bandType = GDALGetRasterDataType(
-    panDataset->GetRasterBand(1));
-  int nbytes = GDALGetDataTypeSizeBytes(bandType);
-
-  // allocate row buffers for image scanlines
-  // ****************************************
-  T *rowBuffPan   = (T*) CPLMalloc( nbytes*N_COLS );
-  T *rowBuffRed   = (T*) CPLMalloc( nbytes*N_COLS );
-  T *rowBuffGreen = (T*) CPLMalloc( nbytes*N_COLS );
-  T *rowBuffBlue  = (T*) CPLMalloc( nbytes*N_COLS );
-  T *rowBuffNIR   = (T*) CPLMalloc( nbytes*N_COLS );
-
-  // row buffers for the pan-sharpened, brovey pan-sharpened datasets
-  // **************************************************************** 
-  float *rowBuffFIHS   = (float*) CPLMalloc( nbytes*N_COLS );
-  float *rowBuffBrovey = (float*) CPLMalloc( nbytes*N_COLS );
-
-  // allocate variables for pixel values
-  // ***********************************
-  float pan_value,red_value,green_value,blue_value,NIR_value;
-  float L,sum_pixels;
-  float redSharp_FIHS,greenSharp_FIHS,blueSharp_FIHS,nirSharp_FIHS;
-  float redSharp_Brovey,greenSharp_Brovey,blueSharp_Brovey,nirSharp_Brovey;
-
-  // initialize errors for reading bands (statuses)
-  // **********************************************
-  CPLErr e_Pan,e_Red,e_Green,e_Blue,e_NIR;
-
-  // iterate through fields of view and scanlines
-  // ********************************************
-  int band=1;
-  while( band<N_bands+1 ) {
-    for( int row=0;row<N_ROWS;row++ ) {
-    
-      // read the scanline into the dynamically allocated row-buffer       
-      // ***********************************************************
-      e_Pan = panDataset->GetRasterBand(1)->RasterIO(
-        GF_Read,0,row,N_COLS,1,rowBuffPan,N_COLS,1,bandType,0,0   );
-      e_Red = redDataset->GetRasterBand(1)->RasterIO(
-        GF_Read,0,row,N_COLS,1,rowBuffRed,N_COLS,1,bandType,0,0   );
-      e_Green = greenDataset->GetRasterBand(1)->RasterIO(
-        GF_Read,0,row,N_COLS,1,rowBuffGreen,N_COLS,1,bandType,0,0 );
-      e_Blue = blueDataset->GetRasterBand(1)->RasterIO(
-        GF_Read,0,row,N_COLS,1,rowBuffBlue,N_COLS,1,bandType,0,0  );
-      e_NIR = nirDataset->GetRasterBand(1)->RasterIO(
-        GF_Read,0,row,N_COLS,1,rowBuffNIR,N_COLS,1,bandType,0,0   );
-
-      // check to make sure we are able to read all bands
-      // ************************************************
-      if(!(e_Pan == 0)){
-        printf("  \n ERROR (fatal): Unable to read band from \n");
-        printf("      panchromatic image file (e.g. using -p flag). Exiting ... \n");
-        exit(1);
-      } else if( !(e_Red == 0)) {
-        printf("  \n ERROR (fatal): Unable to read band from \n");
-        printf("      red image file (e.g. using -r flag). Exiting ...          \n");
-        exit(1);
-      } else if( !(e_Green == 0)) {
-        printf("  \n ERROR (fatal): Unable to read band from \n");
-        printf("      green image file (e.g. using -g flag). Exiting ...        \n");
-        exit(1);
-      } else if( !(e_Blue == 0)) {
-        printf("  \n ERROR (fatal): Unable to read band from \n");
-        printf("      blue image file (e.g. using -g flag). Exiting ...         \n");
-        exit(1);
-      } else if( !(e_NIR == 0)) {
-        printf("  \n ERROR (fatal): Unable to read band from \n");
-        printf("      NIR image file (e.g. using -n flag). Exiting ...          \n");
-        exit(1);
-      } else {;}
-
-      // iterate through columns
-      // ***********************
-      for( int col=0; col<N_COLS; col++ ) {
-        pan_value         = (float)rowBuffPan[col];
-        red_value         = (float)rowBuffRed[col];
-        green_value       = (float)rowBuffGreen[col];
-        blue_value        = (float)rowBuffBlue[col];
-        NIR_value         = (float)rowBuffNIR[col];
-
-	// based on number of bands (3 for RGB or 4 for RGB/NIR) then
-	// compute the linear scaling factors for pan-sharpening
-	// **********************************************************
-	if( N_bands == 4 ) {
-          L               = ( red_value+green_value+blue_value+NIR_value )/N_bands;
-          sum_pixels      = ( red_value+green_value+blue_value+NIR_value );
-        } else {
-          L               = ( red_value+green_value+blue_value )/N_bands;
-          sum_pixels      = ( red_value+green_value+blue_value );
-	}
-
-	// if the panchromatic value is NoData or less than zero, just
-	// set the out pixel value(s) to zero for all pan-sharpened bands
-	// **************************************************************
-        if( !(pan_value<0.0) || pan_value == NoDataValue ) {
-          // calculate pan-sharpend FIHS values
-          // ********************************** 
-          redSharp_FIHS     = red_value   + ( pan_value - L );
-          greenSharp_FIHS   = green_value + ( pan_value - L );
-          blueSharp_FIHS    = blue_value  + ( pan_value - L );
-          nirSharp_FIHS     = NIR_value   + ( pan_value - L );
-
-          // calculate pan-sharpened values using Brovey 
-          // *******************************************
-          redSharp_Brovey   = ( red_value   / sum_pixels ) * pan_value;
-          greenSharp_Brovey = ( green_value / sum_pixels ) * pan_value;
-          blueSharp_Brovey  = ( blue_value  / sum_pixels ) * pan_value;
-	  nirSharp_Brovey   = ( NIR_value   / sum_pixels ) * pan_value;
-
-        } else {
-          // calculate pan-sharpend FIHS values
-          // ********************************** 
-          redSharp_FIHS      = 0.0; 
-          greenSharp_FIHS    = 0.0;
-          blueSharp_FIHS     = 0.0;
-          nirSharp_FIHS      = 0.0;
-
-          // calculate pan-sharpened values using Brovey 
-          // *******************************************
-          redSharp_Brovey    = 0.0;
-          greenSharp_Brovey  = 0.0;
-          blueSharp_Brovey   = 0.0;
-	  nirSharp_Brovey    = 0.0;
-	}
-
-	// depending on which band we are currently writing, write out
-	// the pan-sharpened pixel values to the row memory buffers
-	// ***********************************************************
-	if( band == 1 ) {
-          rowBuffFIHS[col]   = redSharp_FIHS;
-          rowBuffBrovey[col] = redSharp_Brovey;
-        } else if( band == 2 ) {
-          rowBuffFIHS[col]   = greenSharp_FIHS;
-          rowBuffBrovey[col] = greenSharp_Brovey;
-	} else if( band == 3 ) {
-          rowBuffFIHS[col]   = blueSharp_FIHS;
-          rowBuffBrovey[col] = blueSharp_Brovey;
-	} else {
-          rowBuffFIHS[col]   = nirSharp_FIHS;
-          rowBuffBrovey[col] = nirSharp_Brovey;
-	}
+  // data type of the outputs: the data type of the multispectral 
+  // imagery (native), or the chosen type. Values other than Float32 (or with
+  // a scale/offset) are rounded and saturated by StoreOutputPixels().
+  // ****************************************************************
+  GDALDataType outType = Options.OutputType;
+  if( outType == GDT_Unknown ) outType = GDALTypeOf<T>();
+  int outBytes    = GDALGetDataTypeSizeBytes( outType );
+  bool ScaleOffset = ( Options.OutputScale != 1.0 || Options.OutputOffset != 0.0 );
+  bool DirectFloat = ( outType == GDT_Float32 && !ScaleOffset );
+
+  // GTiff creation options (e.g. tiling, compression) for the outputs
+  // *****************************************************************
+  char **papszCreateOptions = nullptr;
+  for( String const& CreationOption : Options.CreationOptions ) {
+    papszCreateOptions = CSLAddString( papszCreateOptions,CreationOption.c_str() );
+  }
+
+  // a shard's partial output has the size of the whole output, but only
+  // the blocks of its rows are written: the others take no space
+  // ********************************************************************
+  if( Options.ShardCount>0 ) {
+    papszCreateOptions = CSLSetNameValue( papszCreateOptions,"SPARSE_OK","TRUE" );
+  }
+
+  // begin to write the geotiff dataset of each selected method (or wrap
+  // the caller's output raster in memory), and make sure it was created
+  // (e.g. invalid creation options)
+  // ********************************************************************
+  // (with --resume, the partial outputs of the interrupted run are 
+  // reopened: if any of them cannot be, the run starts over, since its 
+  // new output would lack the committed windows)
+  // ********************************************************************
+  GDALDataset *outDatasets[ N_METHODS ] = { nullptr };
+  bool AllReopened = Options.Resume;
+  for( int Method : Methods ) {
+    StageTimer Timer( MainTiming,STAGE_CREATE );
+    std::filesystem::path fullPath;
+    GDALDataset *outDataset;
+    if( InMemory ) {
+      PansharpenRaster const& Output = MemoryOutputs[Method];
+      bool Fits = Output.Cols == N_COLS && Output.Rows == N_ROWS;
+      outDataset = Fits ? WrapRaster( Output,N_bands ) : nullptr;
+    } else {
+      fullPath   = Dir / PartialFiles[Method];
+      outDataset = nullptr;
+      if( Options.Resume && !HasPreview( Options ) ) {
+        outDataset = ReopenPartialOutput( fullPath.string(),N_COLS,N_ROWS,N_bands,outType );
+      }
+      if( outDataset == nullptr ) {
+        AllReopened = false;
+        outDataset = driverGeotiff->Create( fullPath.c_str(),N_COLS,N_ROWS,N_bands,outType,papszCreateOptions );
       }
+    }
+    if( outDataset == nullptr ) {
+      String Message = "Unable to create output Geotiff "+fullPath.string()+": "+CPLGetLastErrorMsg();
+      if( InMemory ) Message = String( "Unable to wrap " )+SHARPEN_METHODS[Method].Label+
+        " output raster of "+std::to_string( N_COLS )+" x "+std::to_string( N_ROWS )+" pixels.";
+      CSLDestroy( papszCreateOptions );
+      for( int Created : Methods ) {
+        if( outDatasets[Created] == nullptr ) continue;
+        GDALClose( outDatasets[Created] );
+        if( !InMemory ) std::remove( ( Dir / PartialFiles[Created] ).c_str() );
+      }
+      throw PansharpenError( Message );
+    }
+    outDataset->SetGeoTransform(gt);
+    outDataset->SetProjection(prj.c_str());
 
-      // write out band/scaneline
-      // ************************
-      fihsDataset->GetRasterBand(band)->RasterIO(
-        GF_Write,0,row,N_COLS,1,rowBuffFIHS,N_COLS,1,GDT_Float32,0,0);
-      broveyDataset->GetRasterBand(band)->RasterIO(
-        GF_Write,0,row,N_COLS,1,rowBuffBrovey,N_COLS,1,GDT_Float32,0,0);
+    // record the scale and offset of the stored values in the band metadata
+    // *********************************************************************
+    if( ScaleOffset ) {
+      for( int band=1; band<N_bands+1; band++ ) {
+        outDataset->GetRasterBand(band)->SetScale( Options.OutputScale );
+        outDataset->GetRasterBand(band)->SetOffset( Options.OutputOffset );
+      }
     }
-    band++;
+    outDatasets[Method] = outDataset;
   }
+  CSLDestroy( papszCreateOptions );
 
-  // close all Geotiff datasets
-  // **************************
-  GDALClose( panDataset    );
-  GDALClose( redDataset    );
-  GDALClose( greenDataset  );
-  GDALClose( blueDataset   );
-  GDALClose( nirDataset    );
-
-  GDALClose( fihsDataset   );
-  GDALClose( broveyDataset );
-
-  // ***************************
-  // release memory for scanline
-  CPLFree( rowBuffPan   );
-  CPLFree( rowBuffRed   );
-  CPLFree( rowBuffGreen );
-  CPLFree( rowBuffBlue  );
-  CPLFree( rowBuffNIR   );
-
-  // close GDAL drivers
-  // ******************
-  GDALDestroyDriverManager();
+  // query the block layout (e.g. strips or tiles) of the panchromatic
+  // band and of the output bands, and lay out windows whose edges fall
+  // on block boundaries of both. By default windows span the full width
+  // of the image (i.e. a row of blocks) and hold about 1M pixels.
+  // *******************************************************************
+  int panBlockX = Pan.BlockX,panBlockY = Pan.BlockY,outBlockX,outBlockY;
+  outDatasets[ Methods[0] ]->GetRasterBand(1)->GetBlockSize( &outBlockX,&outBlockY );
+
+  // decide how each multispectral image is resampled on the fly: with 
+  // the fused bicubic upsampler when its pixel size is an exact integer
+  // multiple of the pan pixel size on an aligned grid (e.g. Landsat 15 m
+  // pan and 30 m multispectral), and with the generic warper otherwise
+  // ********************************************************************
+  ResamplePlan Plan;
+  Plan.DirectPan = nullptr;
+  Plan.XOff      = Region.xoff;
+  Plan.YOff      = Region.yoff;
+  Plan.MultiBand = HasImage( "ms" ) || HasImage( "ms_resampled" );
+  std::copy( Options.MSBands,Options.MSBands+4,Plan.MSBands );
+
+  // a multi-band multispectral image (--ms flag) must have the bands
+  // of the --ms-bands mapping; it is planned as a whole, as entry 0
+  // ****************************************************************
+  if( Plan.MultiBand ) {
+    int msBands = Inputs.Image( HasImage( "ms" ) ? "ms" : "ms_resampled" ).Bands;
+    for( int band=0; band<N_bands; band++ ) {
+      if( Plan.MSBands[band]>=1 && Plan.MSBands[band]<=msBands ) continue;
+      for( int Method : Methods ) GDALClose( outDatasets[Method] );
+      for( int Method : Methods ) {
+        if( !InMemory ) std::remove( ( Dir / PartialFiles[Method] ).c_str() );
+      }
+      throw PansharpenError( String( "multispectral image has no band " )+
+        std::to_string( Plan.MSBands[band] )+" for the "+MS_NAMES[band]+" band (e.g. using --ms-bands flag)." );
+    }
+  }
+  for( int band=0; band<4; band++ ) {
+    Plan.Fused[band]     = false;
+    Plan.Direct[band]    = nullptr;
+    String Key = Plan.MultiBand ? "ms" : MS_KEYS[band];
+    if( Plan.MultiBand && band>0 ) {
+      Plan.Resampled[band] = Plan.Resampled[0];
+      continue;
+    }
+    Plan.Resampled[band] = HasImage( Key+"_resampled" );
+    if( Plan.Resampled[band] && band<N_bands ) {
+      SceneImage const& Resampled = Inputs.Image( Key+"_resampled" );
+      bool OnRegion = Resampled.Cols == N_COLS && Resampled.Rows == N_ROWS;
+      if( !OnRegion ) {
+        for( int Method : Methods ) GDALClose( outDatasets[Method] );
+        for( int Method : Methods ) {
+          if( !InMemory ) std::remove( ( Dir / PartialFiles[Method] ).c_str() );
+        }
+        throw PansharpenError( String( "resampled " )+( Plan.MultiBand ? "multispectral" : MS_NAMES[band] )+
+          " image does not cover the region of interest." );
+      }
+    }
+    if( band>=N_bands || !Options.FusedUpsample || !HasImage( Key ) ) continue;
+    Plan.Fused[band] = IntegerRatioAlignment( Inputs.Image( Key ).Dataset,panDataset,&Plan.Grid[band] );
+  }
+
+  // pan blocks only line up with windows of a region that starts on
+  // a block boundary
+  // ***************************************************************
+  if( Region.xoff%panBlockX ) panBlockX = 1;
+  if( Region.yoff%panBlockY ) panBlockY = 1;
+  int unitX   = AlignmentUnit( panBlockX,outBlockX,N_COLS );
+  int unitY   = AlignmentUnit( panBlockY,outBlockY,N_ROWS );
+  int winCols = N_COLS;
+  if( Options.WindowCols>0 ) {
+    winCols   = AlignedWindowSize( Options.WindowCols,unitX,N_COLS,0 );
+  }
+  int winRows = AlignedWindowSize( Options.WindowRows,unitY,N_ROWS,winCols );
+
+  // fit the number of threads, the depth of the pipeline (window buffers
+  // per pool), and the window size to the memory budget (--max-memory),
+  // if there is one. A window buffer pair holds the pan and multispectral
+  // pixels and the output bands of every method; histogram matching adds
+  // up to MAX_SAMPLES pairs of samples (held twice while gathered).
+  // *********************************************************************
+  size_t PixelBytes = sizeof(P)+sizeof(T)*N_bands+(size_t)outBytes*N_bands*N_outputs;
+  size_t ExtraBytes = Options.PanMatch == PAN_MATCH_HISTOGRAM ? (size_t)16<<20 : 0;
+  MemoryBudget Budget = FitMemoryBudget( Options.MaxMemory,PixelBytes,ExtraBytes,
+    ThreadCount( Options.Threads,SIZE_MAX ),winCols,winRows,unitX,unitY,N_COLS );
+  winCols = Budget.WindowCols;
+  winRows = Budget.WindowRows;
+  std::vector<Window> Windows = BlockAlignedWindows( N_COLS,N_ROWS,winCols,winRows );
+  size_t winPixels = (size_t)winCols*(size_t)winRows;
+
+  // a shard (--shard i/N) sharpens only its range of rows of windows
+  // (see ShardRows()), but lays out the windows, and runs the statistics
+  // and pan-matching passes, over the whole image, exactly as a single 
+  // run does. So its rows come out identical to those of a single run,
+  // with no seams, and the shards can be stitched (see MergeShards()).
+  // *********************************************************************
+  std::vector<Window> SharpenWindows = Windows;
+  if( Options.ShardCount>0 ) {
+    Window Shard = ShardRows( Windows,Options.ShardIndex,Options.ShardCount );
+    SharpenWindows.clear();
+    for( Window const& win : Windows ) {
+      if( win.yoff>=Shard.yoff && win.yoff<Shard.yoff+Shard.ysize ) SharpenWindows.push_back( win );
+    }
+    String ShardName = std::to_string( Options.ShardIndex )+"/"+std::to_string( Options.ShardCount );
+    String ShardRowRange = std::to_string( Shard.yoff )+","+std::to_string( Shard.ysize );
+    for( int Method : Methods ) {
+      outDatasets[Method]->SetMetadataItem( SHARD_METADATA_SHARD,ShardName.c_str() );
+      outDatasets[Method]->SetMetadataItem( SHARD_METADATA_ROWS,ShardRowRange.c_str() );
+    }
+    if( Options.Timing ) Options.Timing->Pixels = (uint64_t)Shard.xsize*(uint64_t)Shard.ysize;
+  }
+
+  // journal of the run: with --resume and the partial outputs and journal
+  // of an interrupted run with the same layout, the windows it committed
+  // are skipped. Everything that decides the pixels of a window is part
+  // of the layout. (Statistics and pan matching passes still run over 
+  // the whole image, so they come out as in the interrupted run.) A
+  // preview (--preview) is quick to run again, so it has no journal.
+  // *********************************************************************
+  Journal RunJournal;
+  size_t FirstWindow = 0;
+  bool Journaled = !InMemory && !HasPreview( Options );
+  if( Journaled ) {
+    String Layout = "layout pan="+( ImageryFileNames.count( "pan" ) ? ImageryFileNames.at( "pan" ) :
+      String( "(in memory)" ) )+" size="+std::to_string( N_COLS )+"x"+
+      std::to_string( N_ROWS )+" region="+std::to_string( Region.xoff )+","+std::to_string( Region.yoff )+
+      " window="+std::to_string( winCols )+"x"+std::to_string( winRows )+" block="+
+      std::to_string( outBlockX )+"x"+std::to_string( outBlockY )+" bands="+std::to_string( N_bands )+
+      " type="+GDALGetDataTypeName( outType )+" methods="+std::to_string( Options.Methods )+
+      " scale="+std::to_string( Options.OutputScale )+" offset="+std::to_string( Options.OutputOffset )+
+      " pan_match="+std::to_string( Options.PanMatch )+" fused="+std::to_string( Options.FusedUpsample )+
+      " shard="+std::to_string( Options.ShardIndex )+"/"+std::to_string( Options.ShardCount )+" weights=";
+    if( Plan.MultiBand ) {
+      Layout.insert( Layout.find( " size=" ),String( " ms=" )+ImageryFileNames.at( 
+        HasImage( "ms" ) ? "ms" : "ms_resampled" )+" ms_bands="+std::to_string( Plan.MSBands[0] )+
+        ","+std::to_string( Plan.MSBands[1] )+","+std::to_string( Plan.MSBands[2] )+","+
+        std::to_string( Plan.MSBands[3] ) );
+    }
+    for( int band=0; band<N_bands && !Plan.MultiBand; band++ ) {
+      auto File = ImageryFileNames.find( MS_KEYS[band] );
+      if( File == ImageryFileNames.end() ) continue;
+      Layout.insert( Layout.find( " size=" ),String( " " )+MS_KEYS[band]+"="+File->second );
+    }
+    for( double Weight : Options.IntensityWeights ) Layout += std::to_string( Weight )+",";
+    FirstWindow = RunJournal.Open( ( Dir / JournalFile ).string(),Layout,AllReopened,
+      SharpenWindows.size(),N_outputs );
+    if( FirstWindow>0 ) {
+      printf("  resume: %zu of %zu window(s) already committed \n",FirstWindow,SharpenWindows.size());
+    }
+  }
+
+  // with imagery held in memory by the caller and full-width windows
+  // (of a region as wide as the image), windows of packed rows are used
+  // in place: the pan image and the multispectral images already on the
+  // pan grid are not copied, and the kernels write straight into packed
+  // output rasters of the output data type (their writers have nothing
+  // left to do)
+  // *******************************************************************
+  void *DirectOut[ N_METHODS ]     = { nullptr };
+  size_t OutBandStride[ N_METHODS ] = { 0 };
+  if( InMemory && winCols == N_COLS && N_COLS == PAN_COLS ) {
+    auto Packed = [&]( PansharpenRaster const& Raster,GDALDataType Type,int Rows ) {
+      GSpacing Bytes = GDALGetDataTypeSizeBytes( Type );
+      return Raster.Type == Type && Raster.Cols == N_COLS && Raster.Rows == Rows &&
+        ( Raster.PixelStride == 0 || Raster.PixelStride == Bytes ) &&
+        ( Raster.LineStride  == 0 || Raster.LineStride  == Bytes*N_COLS ) &&
+        Raster.BandStride%Bytes == 0;
+    };
+    PansharpenRaster const& Pan = MemoryImagery.at( "pan" );
+    if( Packed( Pan,GDALTypeOf<P>(),Pan.Rows ) ) Plan.DirectPan = Pan.Data;
+    for( int band=0; band<N_bands; band++ ) {
+      PansharpenRaster const& MS = MemoryImagery.at( MS_KEYS[band] );
+      bool SameGrid = !MS.HasGeoTransform || std::equal( MS.GeoTransform,MS.GeoTransform+6,panGT );
+      if( Packed( MS,GDALTypeOf<T>(),Pan.Rows ) && SameGrid ) Plan.Direct[band] = MS.Data;
+    }
+    for( int Method : Methods ) {
+      PansharpenRaster const& Output = MemoryOutputs[Method];
+      if( !Packed( Output,outType,N_ROWS ) ) continue;
+      DirectOut[Method]     = Output.Data;
+      OutBandStride[Method] = Output.BandStride ? Output.BandStride/outBytes : (size_t)N_COLS*N_ROWS;
+    }
+  }
+
+  // the windows flow through a pipeline of stages connected by bounded
+  // queues, so that reading (decoding, resampling), computing, and
+  // writing (encoding) of different windows overlap in time:
+  //
+  //   readers (nThreads) -> compute (nThreads) -> writer (method 1)
+  //                                           \-> writer (method 2)
+  //                                           \-> ...
+  //
+  // Each reader owns its own input datasets; each writer is the only
+  // thread that touches its output dataset. Window buffers come from
+  // two pools (queues pre-filled with buffers) and are recycled, so at
+  // most nBuffers input and output windows are held in memory.
+  // ******************************************************************
+  int nThreads  = ThreadCount( Budget.Threads,Windows.size() );
+  int nBuffers  = Budget.Buffers<2*nThreads ? Budget.Buffers : 2*nThreads;
+  if( Options.MaxMemory>0 ) {
+    printf("  memory: %d thread(s), %d window buffers of %d x %d pixels, about %zu MB of %zu MB \n",
+      nThreads,nBuffers,winCols,winRows,Budget.Bytes>>20,Options.MaxMemory>>20);
+    if( !Budget.Fits ) {
+      printf("  WARNING: --max-memory is too small for this scene; using the smallest windows.\n");
+    }
+  }
+  std::vector< SharpenWorker<T> > Workers( nThreads );
+  for( int worker=0; worker<nThreads; worker++ ) {
+    Workers[worker].Timing = ThreadTimingOf( Options,"reader",worker );
+  }
+  if( Options.Timing ) Options.Timing->PipelineThreads = nThreads;
+
+  std::vector< InputWindow<P,T> > InputBuffers( nBuffers );
+  std::vector< OutputWindow >   OutputBuffers( nBuffers );
+  BoundedQueue< InputWindow<P,T>* > FreeInputs( nBuffers );
+  BoundedQueue< OutputWindow* >   FreeOutputs( nBuffers );
+  for( int buffer=0; buffer<nBuffers; buffer++ ) {
+    InputWindow<P,T>& In = InputBuffers[buffer];
+    if( Plan.DirectPan == nullptr ) In.PanStorage = (P*) CPLMalloc( sizeof(P)*winPixels );
+    if( Plan.MultiBand ) {
+      // one block for the bands of a multi-band image, read together
+      In.Storage[0]   = (T*) CPLMalloc( sizeof(T)*N_bands*winPixels );
+      In.MSBandStride = winPixels;
+      for( int band=1; band<N_bands; band++ ) In.Storage[band] = In.Storage[0]+band*winPixels;
+    }
+    for( int band=0; band<N_bands && !Plan.MultiBand; band++ ) {
+      if( Plan.Direct[band] != nullptr ) continue;
+      In.Storage[band] = (T*) CPLMalloc( sizeof(T)*winPixels );
+    }
+    FreeInputs.Push( &In );
+
+    // output window buffers hold one window for every output band 
+    // of every method (N_bands*winPixels pixels each), so that each
+    // input window is read only once and all output bands are
+    // computed from that read.
+    // *************************************************************
+    OutputWindow& Out = OutputBuffers[buffer];
+    for( int Method : Methods ) {
+      if( DirectOut[Method] != nullptr ) continue;
+      Out.out[Method] = CPLMalloc( (size_t)outBytes*N_bands*winPixels );
+    }
+    FreeOutputs.Push( &Out );
+  }
+  BoundedQueue< InputWindow<P,T>* > ComputeQueue( nBuffers );
+
+  // first error of any pass or stage: once it is set, no more windows
+  // are read, and the windows in flight are recycled without being 
+  // computed or written, so that every thread finishes
+  // *****************************************************************
+  FirstError Error;
+
+  // first pass, only for methods that need global band statistics (e.g.
+  // Gram-Schmidt and PCA): read every window (borrowing buffers from the
+  // pool) and accumulate the statistics of each window in parallel. The
+  // windows are then merged in window order, so the statistics (and the
+  // output) do not depend on the number of threads. Like the second pass,
+  // it holds at most nBuffers windows in memory.
+  // *********************************************************************
+  SharpenParams Params[ N_METHODS ];
+  bool NeedsStatistics = false;
+  for( int Method : Methods ) {
+    NeedsStatistics = NeedsStatistics || SHARPEN_METHODS[Method].NeedsStatistics;
+  }
+  if( NeedsStatistics ) {
+    std::vector<BandStatistics> WindowStatistics( Windows.size() );
+    ParallelFor( nThreads,Windows.size(),Error,[&]( int worker,size_t task ) {
+      SharpenWorker<T>& Worker = Workers[worker];
+      if( Worker.panDataset == nullptr ) {
+        OpenSharpenWorker( Worker,*this,Plan,N_bands );
+      }
+      InputWindow<P,T>* In;
+      TimedPop( FreeInputs,In,Worker.Timing );
+      In->win = Windows[task];
+      try {
+        ReadWindow( Worker,*In,Plan,N_bands );
+      } catch( ... ) {
+        FreeInputs.Push( In );
+        throw;
+      }
+      size_t nPixels = (size_t)In->win.xsize*(size_t)In->win.ysize;
+      StageTimer Timer( Worker.Timing,STAGE_STATISTICS );
+      AccumulateStatistics( WindowStatistics[task],In->pan,In->ms,nPixels,N_bands,NoDataValue );
+      Timer.Count( nPixels,nPixels*( sizeof(P)+sizeof(T)*N_bands ),0 );
+      FreeInputs.Push( In );
+    });
+    BandStatistics Statistics;
+    for( BandStatistics const& WindowStats : WindowStatistics ) {
+      MergeStatistics( Statistics,WindowStats );
+    }
+    for( int Method : Methods ) {
+      if( IsComponentSubstitution( Method ) ) {
+        Params[Method] = ComponentSubstitutionParams( Method,Statistics,N_bands );
+      }
+    }
+  }
+
+  // FIHS with intensity weights (--fihs-weights) or with the pan band
+  // matched to the intensity (--pan-match) runs the component 
+  // substitution kernel with gains of 1. The pan matching comes from a
+  // cheap pre-pass over a sparse grid of small sample tiles (about 1/16
+  // of the image, read through the same readers): mean and standard
+  // deviation, or a histogram matching table built from at most
+  // MAX_SAMPLES pixels. Tiles are merged in order, as in the first pass.
+  // ********************************************************************
+  int KernelTypes[ N_METHODS ];
+  for( int method=0; method<N_METHODS; method++ ) {
+    KernelTypes[method] = SHARPEN_METHODS[method].Kernel;
+  }
+  PanMatchTable PanMatch;
+  bool UsePanMatch = false;
+  bool CustomFIHS  = !Error.Occurred() && ( Options.Methods & ( 1u<<METHOD_FIHS ) ) &&
+    ( !Options.IntensityWeights.empty() || Options.PanMatch != PAN_MATCH_NONE );
+  if( CustomFIHS ) {
+    double Weights[4];
+    for( int band=0; band<N_bands; band++ ) {
+      Weights[band] = Options.IntensityWeights.empty() ? 1.0/N_bands : Options.IntensityWeights[band];
+    }
+    BandStatistics SampleStatistics;
+    std::vector<float> PanSamples,IntensitySamples;
+    if( Options.PanMatch != PAN_MATCH_NONE ) {
+      const size_t MAX_SAMPLES = 1<<20;
+      std::vector<Window> Tiles = SampleWindows( N_COLS,N_ROWS,
+        winCols<256 ? winCols : 256,winRows<256 ? winRows : 256,4 );
+      size_t TilePixels = 0;
+      for( Window const& Tile : Tiles ) TilePixels += (size_t)Tile.xsize*(size_t)Tile.ysize;
+      size_t Step = ( TilePixels+MAX_SAMPLES-1 )/MAX_SAMPLES;
+      if( Step>1 ) Step |= 1; // odd, so that samples do not line up in columns
+
+      bool Histogram = ( Options.PanMatch == PAN_MATCH_HISTOGRAM );
+      std::vector<BandStatistics> TileStatistics( Tiles.size() );
+      std::vector< std::vector<float> > TilePan( Tiles.size() ),TileIntensity( Tiles.size() );
+      ParallelFor( nThreads,Tiles.size(),Error,[&]( int worker,size_t task ) {
+        SharpenWorker<T>& Worker = Workers[worker];
+        if( Worker.panDataset == nullptr ) {
+          OpenSharpenWorker( Worker,*this,Plan,N_bands );
+        }
+        InputWindow<P,T>* In;
+        TimedPop( FreeInputs,In,Worker.Timing );
+        In->win = Tiles[task];
+        try {
+          ReadWindow( Worker,*In,Plan,N_bands );
+        } catch( ... ) {
+          FreeInputs.Push( In );
+          throw;
+        }
+        size_t nPixels = (size_t)In->win.xsize*(size_t)In->win.ysize;
+        StageTimer Timer( Worker.Timing,STAGE_PAN_MATCH );
+        AccumulateStatistics( TileStatistics[task],In->pan,In->ms,nPixels,N_bands,NoDataValue );
+        if( Histogram ) {
+          CollectSamples( TilePan[task],TileIntensity[task],In->pan,In->ms,nPixels,
+            N_bands,NoDataValue,Weights,Step );
+        }
+        Timer.Count( nPixels,nPixels*( sizeof(P)+sizeof(T)*N_bands ),0 );
+        FreeInputs.Push( In );
+      });
+      for( size_t tile=0; tile<Tiles.size(); tile++ ) {
+        MergeStatistics( SampleStatistics,TileStatistics[tile] );
+        PanSamples.insert( PanSamples.end(),TilePan[tile].begin(),TilePan[tile].end() );
+        IntensitySamples.insert( IntensitySamples.end(),
+          TileIntensity[tile].begin(),TileIntensity[tile].end() );
+      }
+      if( Histogram ) {
+        UsePanMatch = HistogramMatchTable( PanSamples,IntensitySamples,&PanMatch );
+      }
+    }
+    bool MatchMeanStd = ( Options.PanMatch == PAN_MATCH_MEANSTD ) ||
+      ( Options.PanMatch == PAN_MATCH_HISTOGRAM && !UsePanMatch );
+    Params[METHOD_FIHS]      = IntensityParams( SampleStatistics,N_bands,Weights,MatchMeanStd );
+    KernelTypes[METHOD_FIHS] = UsePanMatch ? KERNEL_CS_PANF : KERNEL_CS;
+  }
+
+  // pick the fastest kernel (SIMD instruction set) of each selected 
+  // method that this processor supports, for this pixel type and
+  // number of bands
+  // ***************************************************************
+  SharpenKernel<P,T> Kernels[ N_METHODS ] = { nullptr };
+  for( int Method : Methods ) {
+    Kernels[Method] = SelectSharpenKernel<P,T>( N_bands,KernelTypes[Method] );
+  }
+
+  // FIHS and Brovey of Byte or UInt16 imagery written as that same data
+  // type (e.g. --ot native), with no scale or offset, are computed in 
+  // fixed point instead (see SharpenFixedScalar()): exactly rounded, and 
+  // stored straight into the output window
+  // *********************************************************************
+  FixedSharpenKernel<T> FixedKernels[ N_METHODS ] = { nullptr };
+  if constexpr ( std::is_same<P,T>::value && HasFixedKernels<T>() ) {
+    for( int Method : Methods ) {
+      if( outType != GDALTypeOf<T>() || ScaleOffset ) break;
+      FixedKernels[Method] = SelectFixedSharpenKernel<T>( N_bands,KernelTypes[Method] );
+    }
+  }
+
+  std::vector< std::unique_ptr< BoundedQueue<OutputWindow*> > > WriteQueues( N_METHODS );
+  for( int Method : Methods ) {
+    WriteQueues[Method].reset( new BoundedQueue<OutputWindow*>( nBuffers ) );
+  }
+
+  // writer stage: one thread per output dataset. All the bands of a
+  // window are written with one dataset-level RasterIO() call, so that
+  // with pixel-interleaved (the GTiff default) or compressed outputs,
+  // each block is complete when it is written and is encoded only once.
+  // Each output window is recycled once all the writers have written it.
+  // *********************************************************************
+  const double Checkpoint = CheckpointSeconds();
+  auto Writer = [&]( int Method ) {
+    GDALDataset *outDataset = outDatasets[Method];
+    ThreadTiming *Timing = ThreadTimingOf( Options,"writer",Method );
+    int BandMap[4] = { 1,2,3,4 };
+    std::vector<size_t> Unflushed; // windows written since the last checkpoint
+    auto LastCheckpoint = std::chrono::steady_clock::now();
+    OutputWindow* Out;
+    while( TimedPop( *WriteQueues[Method],Out,Timing ) ) {
+      Window const& win = Out->win;
+      if( !Error.Occurred() && DirectOut[Method] == nullptr ) {
+        size_t nPixels = (size_t)win.xsize*(size_t)win.ysize;
+        StageTimer Timer( Timing,STAGE_WRITE );
+        Timer.Count( nPixels,0,nPixels*outBytes*N_bands );
+        CPLErr e_Out = outDataset->RasterIO( GF_Write,win.xoff,win.yoff,win.xsize,win.ysize,
+          Out->out[Method],win.xsize,win.ysize,outType,N_bands,BandMap,outBytes,
+          (GSpacing)outBytes*win.xsize,(GSpacing)outBytes*winPixels );
+        if( !(e_Out == 0) ) {
+          Error.Capture( std::make_exception_ptr( PansharpenError( String( "Unable to write " )+
+            SHARPEN_METHODS[Method].Label+" output Geotiff: "+CPLGetLastErrorMsg() ) ) );
+        } else if( Journaled ) {
+          Unflushed.push_back( Out->Task );
+        }
+
+        // checkpoint: flush the output, then commit what was written
+        // **********************************************************
+        auto Now = std::chrono::steady_clock::now();
+        if( !Unflushed.empty() && std::chrono::duration<double>( Now-LastCheckpoint ).count()>=Checkpoint ) {
+          outDataset->FlushCache();
+          RunJournal.Flushed( Unflushed );
+          Unflushed.clear();
+          LastCheckpoint = Now;
+        }
+      }
+      if( Out->Pending.fetch_sub( 1 ) == 1 ) FreeOutputs.Push( Out );
+    }
+  };
+  std::vector<std::thread> WriterThreads;
+  for( int Method : Methods ) {
+    WriterThreads.emplace_back( Writer,Method );
+  }
+
+  // compute stage: compute all the pan-sharpened bands of each window.
+  // Windows are processed in chunks of CHUNK pixels, running the kernel
+  // of every selected method on a chunk while its input pixels are still
+  // in cache. For Float32 outputs the kernels write straight into the
+  // output window, and so do the fixed-point kernels. For other output
+  // types (or scale/offset) they write into a small scratch buffer, 
+  // which is then rounded and saturated into the output window.
+  // ********************************************************************
+  const size_t CHUNK = 4096;
+  std::vector<std::thread> ComputeThreads;
+  for( int thread=0; thread<nThreads; thread++ ) {
+    ComputeThreads.emplace_back( [&,thread]() {
+      ThreadTiming *Timing = ThreadTimingOf( Options,"compute",thread );
+      std::vector<float> Scratch( DirectFloat ? 0 : 4*CHUNK );
+      std::vector<float> PanScratch( UsePanMatch ? CHUNK : 0 );
+      InputWindow<P,T>* In;
+      while( TimedPop( ComputeQueue,In,Timing ) ) {
+        if( Error.Occurred() ) {
+          FreeInputs.Push( In );
+          continue;
+        }
+        OutputWindow* Out;
+        TimedPop( FreeOutputs,Out,Timing );
+        Out->win  = In->win;
+        Out->Task = In->Task;
+        size_t nPixels = (size_t)In->win.xsize*(size_t)In->win.ysize;
+        StageTimer Timer( Timing,STAGE_COMPUTE );
+        Timer.Count( nPixels,nPixels*( sizeof(P)+sizeof(T)*N_bands ),nPixels*outBytes*N_bands*N_outputs );
+
+        // output bands of each method: in the output window (bands 
+        // winPixels apart), or in place in the caller's output raster
+        // ************************************************************
+        char *Dest[ N_METHODS ];
+        size_t DestStride[ N_METHODS ];
+        for( int Method : Methods ) {
+          Dest[Method]       = (char*)Out->out[Method];
+          DestStride[Method] = winPixels;
+          if( DirectOut[Method] != nullptr ) {
+            Dest[Method]       = (char*)DirectOut[Method]+(size_t)In->win.yoff*N_COLS*outBytes;
+            DestStride[Method] = OutBandStride[Method];
+          }
+        }
+
+        SharpenArgs<P,T> Args;
+        Args.NoDataValue   = NoDataValue;
+        Args.panSubstitute = nullptr;
+        for( size_t first=0; first<nPixels; first+=CHUNK ) {
+          size_t n = nPixels-first<CHUNK ? nPixels-first : CHUNK;
+          Args.pan         = In->pan+first;
+          for( int band=0; band<4; band++ ) {
+            Args.ms[band]  = In->ms[band] ? In->ms[band]+first : nullptr;
+          }
+          Args.nPixels     = n;
+          if( UsePanMatch ) {
+            ApplyPanMatch( PanMatch,Args.pan,n,PanScratch.data() );
+            Args.panSubstitute = PanScratch.data();
+          }
+          for( int Method : Methods ) {
+            Args.Params = &Params[Method];
+            if constexpr ( std::is_same<P,T>::value && HasFixedKernels<T>() ) {
+              if( FixedKernels[Method] != nullptr ) {
+                FixedSharpenArgs<T> Fixed = { Args.pan,{ Args.ms[0],Args.ms[1],Args.ms[2],Args.ms[3] },
+                  n,(T*)Dest[Method]+first,DestStride[Method] };
+                FixedKernels[Method]( Fixed );
+                continue;
+              }
+            }
+            if( DirectFloat ) {
+              Args.out        = (float*)Dest[Method]+first;
+              Args.bandStride = DestStride[Method];
+              Kernels[Method]( Args );
+              continue;
+            }
+            Args.out        = Scratch.data();
+            Args.bandStride = CHUNK;
+            Kernels[Method]( Args );
+            for( int band=0; band<N_bands; band++ ) {
+              size_t outOff = ( band*DestStride[Method]+first )*outBytes;
+              StoreOutputPixels( Args.out+band*CHUNK,n,Dest[Method]+outOff,
+                outType,Options.OutputScale,Options.OutputOffset );
+            }
+          }
+        }
+        FreeInputs.Push( In );
+        Timer.Stop();
+
+        Out->Pending = N_outputs;
+        for( int Method : Methods ) {
+          TimedPush( *WriteQueues[Method],Out,Timing );
+        }
+      }
+    });
+  }
+
+  // reader stage: iterate through the block-aligned windows (of the 
+  // shard, if any). Each window of the input imagery is read exactly 
+  // once. Each reader opens its datasets the first time it picks up a
+  // window. No windows are read if a pass above has failed.
+  // ********************************************************************
+  ParallelFor( nThreads,SharpenWindows.size()-FirstWindow,Error,[&]( int worker,size_t task ) {
+    SharpenWorker<T>& Worker = Workers[worker];
+    if( Worker.panDataset == nullptr ) {
+      OpenSharpenWorker( Worker,*this,Plan,N_bands );
+    }
+    InputWindow<P,T>* In;
+    TimedPop( FreeInputs,In,Worker.Timing );
+    In->Task = FirstWindow+task;
+    In->win  = SharpenWindows[In->Task];
+    try {
+      ReadWindow( Worker,*In,Plan,N_bands );
+    } catch( ... ) {
+      FreeInputs.Push( In );
+      throw;
+    }
+    TimedPush( ComputeQueue,In,Worker.Timing );
+  });
+
+  // drain the pipeline: once all windows are read, the compute stage
+  // finishes, and then the writers finish
+  // ****************************************************************
+  ComputeQueue.Close();
+  for( std::thread& Thread : ComputeThreads ) Thread.join();
+  for( int Method : Methods ) {
+    WriteQueues[Method]->Close();
+  }
+  for( std::thread& Thread : WriterThreads ) Thread.join();
+
+  // close the datasets of each reader as well as the output datasets
+  // (which flushes them), and release the window buffers
+  // *****************************************************************
+  StageTimer CloseTimer( MainTiming,STAGE_CLOSE );
+  for( SharpenWorker<T>& Worker : Workers ) {
+    CloseSharpenWorker( Worker );
+  }
+  for( int buffer=0; buffer<nBuffers; buffer++ ) {
+    int nStorage = Plan.MultiBand ? 1 : 4; // the others point into Storage[0]
+    CPLFree( InputBuffers[buffer].PanStorage );
+    for( int band=0; band<nStorage; band++ ) CPLFree( InputBuffers[buffer].Storage[band] );
+    for( int Method : Methods ) CPLFree( OutputBuffers[buffer].out[Method] );
+  }
+  for( int Method : Methods ) {
+    GDALClose( outDatasets[Method] );
+  }
+  if( MainTiming && !InMemory ) {
+    uint64_t Bytes = 0;
+    for( int Method : Methods ) {
+      std::error_code ec;
+      uintmax_t Size = std::filesystem::file_size( Dir / PartialFiles[Method],ec );
+      if( !ec ) Bytes += Size;
+    }
+    CloseTimer.Count( 0,0,Bytes );
+  }
+  CloseTimer.Stop();
+
+  // the outputs of a failed run are incomplete: delete them (and the
+  // journal), and report the first error. Those of a run that succeeded
+  // get their own names. (A run that is killed leaves its partial 
+  // outputs and journal for --resume.)
+  // *******************************************************************
+  if( Error.Occurred() ) {
+    for( int Method : Methods ) {
+      if( InMemory ) break;
+      std::remove( ( Dir / PartialFiles[Method] ).c_str() );
+    }
+    RunJournal.Remove();
+    Error.Rethrow();
+  }
+  for( int Method : Methods ) {
+    if( InMemory ) break;
+    std::error_code ec;
+    std::filesystem::rename( Dir / PartialFiles[Method],Dir / OutputFiles[Method],ec );
+    if( ec ) {
+      RunJournal.Remove();
+      throw PansharpenError( "Unable to rename "+( Dir / PartialFiles[Method] ).string()+
+        " to "+OutputFiles[Method]+": "+ec.message() );
+    }
+  }
+  RunJournal.Remove();
 }
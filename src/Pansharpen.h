@@ -10,14 +10,155 @@
 #include "gdalwarper.h"
 #include <filesystem>
 #include "ogr_spatialref.h"
+#include "cpl_string.h"
+#include <stdexcept>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Window.h"
+#include "Scene.h"
+#include "Methods.h"
+#include "Timing.h"
+
+// define C++ class for the errors (e.g. an image file that cannot be
+// opened or read) that end the pan-sharpening of one set of imagery.
+// They are thrown rather than exiting, so that a batch of scenes (see
+// the --batch flag) goes on with the next scene. The message has no
+// "ERROR (fatal)" prefix; the caller reports it.
+// *******************************************************************
+class PansharpenError : public std::runtime_error {
+  public:
+    PansharpenError( std::string const& Message ) : std::runtime_error( Message ) {}
+};
+
+// define C++ structure to hold options for the pan-sharpening
+// (e.g. size of windows that imagery is processed in). A window
+// size of zero means that a size is chosen automatically.
+// *************************************************************
+struct PansharpenOptions {
+  int WindowRows = 0; // window height in rows (-w flag)
+  int WindowCols = 0; // window width in columns (-t flag)
+  int Threads    = 1; // number of worker threads (-j flag, 0 for all cores)
+  bool ResampleToDisk = false; // write *_resampled.tif files (--resample-to-disk)
+  bool FusedUpsample  = true;  // fused bicubic upsampler for integer ratios
+  unsigned Methods    = DEFAULT_METHODS; // bit mask of methods to run (--method)
+
+  // intensity weights of FIHS, one per output band (--fihs-weights flag,
+  // empty for equal weights), and how the pan band is matched to the
+  // intensity (--pan-match flag, see PanMatchMode)
+  std::vector<double> IntensityWeights;
+  int PanMatch = PAN_MATCH_NONE;
+
+  // data type of the outputs (--ot flag, GDT_Unknown for the data type
+  // of the input imagery), and the scale and offset of the stored values
+  // (value = stored*scale+offset, --scale and --offset flags)
+  GDALDataType OutputType = GDT_Float32;
+  double OutputScale  = 1.0;
+  double OutputOffset = 0.0;
+
+  // region of interest: a window of the panchromatic grid (--window
+  // flag), or a bounding box minx,miny,maxx,maxy (--bbox flag) in the
+  // coordinates of RegionSRS (any SRS GDAL understands, e.g. EPSG:4326;
+  // empty for the SRS of the pan image). Only the region is resampled
+  // and pan-sharpened, and the outputs cover just the region (see 
+  // Pansharpen::RegionOfInterest()).
+  bool HasRegionWindow = false;
+  Window RegionWindow  = { 0,0,0,0 };
+  bool HasRegionBBox   = false;
+  double RegionBBox[4] = { 0.0,0.0,0.0,0.0 };
+  std::string RegionSRS;
+
+  // memory budget in bytes for the window buffers and threads of the
+  // run (--max-memory flag, less the GDAL block cache; 0 for no budget).
+  // The thread count, pipeline depth, and window size are reduced to
+  // fit it (see FitMemoryBudget()).
+  size_t MaxMemory = 0;
+
+  // shard of a run split over several processes or nodes (--shard flag):
+  // shard ShardIndex (1 to ShardCount) sharpens its range of rows of 
+  // windows into partial outputs (see ShardFileName() and MergeShards()).
+  // A ShardCount of 0 means no sharding.
+  int ShardIndex = 0;
+  int ShardCount = 0;
+
+  // bands (1-based) of a multi-band multispectral image (--ms flag, 
+  // imagery key "ms") that are the red,green,blue, and NIR bands 
+  // (--ms-bands flag). The bands are read together, band-interleaved,
+  // instead of from one file per band.
+  int MSBands[4] = { 1,2,3,4 };
+
+  // quick-look at reduced resolution (--preview flag, see Preview.h):
+  // the largest dimension of the panchromatic preview in pixels, or an
+  // overview level of the pan image (1 for its first overview). The
+  // imagery is read from its overviews (or decimated), and the outputs
+  // are named <name>.preview.tif. Zero for both means no preview.
+  int PreviewSize  = 0;
+  int PreviewLevel = 0;
+
+  // go on from the partial outputs and journal of an interrupted run 
+  // (--resume flag, see Journal), instead of starting over
+  bool Resume = false;
+
+  // per-stage and per-thread timing of the run (--stats-json flag), or
+  // nullptr for none (the default, at the cost of one branch per stage)
+  SceneTiming *Timing = nullptr;
+
+  // GTiff creation options of the outputs, as NAME=VALUE strings (e.g.
+  // TILED=YES, COMPRESS=ZSTD, PREDICTOR=3, BIGTIFF=IF_SAFER, NUM_THREADS=4)
+  std::vector<std::string> CreationOptions;
+};
+
+// define C++ structure describing a raster held in memory by the 
+// caller (see LibPansharpen.h): Bands bands of Cols by Rows pixels of
+// data type Type, with pixel (col,row) of band b at byte offset
+// b*BandStride+row*LineStride+col*PixelStride from Data. Zero strides
+// mean packed pixels, rows, and bands. Input rasters may carry a 
+// geotransform, projection, and NoData value; without a geotransform
+// a multispectral raster is taken to cover the same extent as the
+// panchromatic raster.
+// *******************************************************************
+struct PansharpenRaster {
+  void *Data         = nullptr;
+  GDALDataType Type  = GDT_Unknown;
+  int Cols           = 0;
+  int Rows           = 0;
+  int Bands          = 1;
+  GSpacing PixelStride = 0;
+  GSpacing LineStride  = 0;
+  GSpacing BandStride  = 0;
+  bool HasGeoTransform = false;
+  double GeoTransform[6] = { 0.0,1.0,0.0,0.0,0.0,-1.0 };
+  std::string Projection;
+  bool HasNoData     = false;
+  double NoDataValue = 0.0;
+};
 
 class Pansharpen {
   private:
     std::map<std::string,std::string> ImageryFileNames;
+    PansharpenOptions Options;
+
+    // imagery and outputs held in memory by the caller (same keys as
+    // ImageryFileNames, and one output per method), instead of files
+    // **************************************************************
+    std::map<std::string,PansharpenRaster> MemoryImagery;
+    PansharpenRaster MemoryOutputs[ N_METHODS ];
+    bool InMemory = false;
+
+    // the opened imagery (see Scene): shared by the caller, or opened
+    // by OpenScene() on first use
+    // ***************************************************************
+    Scene *SharedScene = nullptr;
+    std::unique_ptr<Scene> OwnScene;
+    Scene& OpenScene();
   public:
     // overloaded constructor functions
     Pansharpen();
     Pansharpen( std::map<std::string,std::string> );
+    Pansharpen( std::map<std::string,std::string>,PansharpenOptions );
+    Pansharpen( std::map<std::string,PansharpenRaster>,const PansharpenRaster*,PansharpenOptions );
+    Pansharpen( std::map<std::string,PansharpenRaster>,PansharpenOptions );
+    Pansharpen( Scene&,PansharpenOptions );
     
     // number of images
     // ****************
@@ -25,12 +166,20 @@ class Pansharpen {
 
     // define any static method(s)
     // ***************************
-    static bool ImageryHasOneDataType( std::map<std::string,std::string>& ); 
+    static bool ImageryHasSupportedDataTypes( Scene const& ); 
+    static Window RegionOfInterest( GDALDataset*,PansharpenOptions const& );
+
+    // open one of the images (e.g. "pan", "red", or "red_resampled") as
+    // a new GDAL dataset (e.g. for a reader thread), from its file or 
+    // from the caller's memory
+    // *****************************************************************
+    bool HasImage( std::string const& ) const;
+    GDALDataset* OpenImage( std::string const& ) const;
 
     // define template class function
     // ******************************
     void PansharpenImagery( int,const char* );
-    template<typename T>
+    template<typename P,typename T>
     void WritePansharpenedImagery( int,const char* );
 };
 #endif
@@ -0,0 +1,105 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "Parallel.h"
+
+int ThreadCount( int requested,size_t nTasks ) {
+  /* *************************************************************************
+   * int ThreadCount( int,size_t ):
+   *
+   * This function returns the number of worker threads to use for nTasks
+   * independent tasks. A requested count of zero or less means one thread
+   * per CPU core. There are never more threads than tasks, and always at
+   * least one thread.
+   *
+   * Args:
+   *   int : requested number of threads (e.g. from the -j flag).
+   *   size_t : number of tasks.
+   * Returns:
+   *   int : number of threads to use.
+   */
+  int nThreads = requested;
+  if( nThreads<1 ) {
+    nThreads = (int)std::thread::hardware_concurrency();
+  }
+  if( (size_t)nThreads>nTasks ) nThreads = (int)nTasks;
+  if( nThreads<1 ) nThreads = 1;
+  return nThreads;
+}
+
+void ParallelFor( int nThreads,size_t nTasks,FirstError& Error,
+  const std::function<void(int,size_t)>& Task ) {
+  /* *************************************************************************
+   * void ParallelFor( int,size_t,FirstError&,
+   *   const std::function<void(int,size_t)>& ):
+   *
+   * This function runs Task(worker,task) for every task in [0,nTasks) on
+   * nThreads worker threads. Workers pull the next task index from a 
+   * shared atomic counter, so that a worker that finishes early picks up
+   * more tasks (dynamic load balancing). The worker index (0 to nThreads-1)
+   * lets the caller keep per-thread state, e.g. GDAL dataset handles. With
+   * one thread, all tasks run in order on the calling thread.
+   *
+   * If a task throws, the exception is kept in Error and no more tasks are
+   * started (tasks already running finish). Tasks are not started either
+   * if Error already holds an error, e.g. from another stage.
+   *
+   * Args:
+   *   int : number of worker threads.
+   *   size_t : number of tasks.
+   *   FirstError& : first error of any task.
+   *   const std::function<void(int,size_t)>& : task to run.
+   * Returns:
+   *   None. Void. Returns once all started tasks have finished.
+   */
+  auto RunTask = [&]( int worker,size_t task ) {
+    try {
+      Task( worker,task );
+    } catch( ... ) {
+      Error.Capture( std::current_exception() );
+    }
+  };
+  if( nThreads<=1 ) {
+    for( size_t task=0; task<nTasks && !Error.Occurred(); task++ ) {
+      RunTask( 0,task );
+    }
+    return;
+  }
+
+  // each thread claims task indices until none are left
+  // ***************************************************
+  std::atomic<size_t> NextTask( 0 );
+  std::vector<std::thread> Threads;
+  for( int worker=0; worker<nThreads; worker++ ) {
+    Threads.emplace_back( [&,worker]() {
+      size_t task;
+      while( !Error.Occurred() && (task = NextTask.fetch_add(1))<nTasks ) {
+        RunTask( worker,task );
+      }
+    });
+  }
+  for( std::thread& Thread : Threads ) {
+    Thread.join();
+  }
+}
+
+void ParallelFor( int nThreads,size_t nTasks,const std::function<void(int,size_t)>& Task ) {
+  /* *************************************************************************
+   * void ParallelFor( int,size_t,const std::function<void(int,size_t)>& ):
+   *
+   * This function runs Task(worker,task) for every task in [0,nTasks) on
+   * nThreads worker threads (see above). If a task throws, no more tasks
+   * are started, and the first exception is thrown again on the calling
+   * thread once all the workers have finished.
+   *
+   * Args:
+   *   int : number of worker threads.
+   *   size_t : number of tasks.
+   *   const std::function<void(int,size_t)>& : task to run.
+   * Returns:
+   *   None. Void. Returns once all tasks have finished.
+   */
+  FirstError Error;
+  ParallelFor( nThreads,nTasks,Error,Task );
+  Error.Rethrow();
+}
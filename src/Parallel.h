@@ -0,0 +1,47 @@
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+// define C++ class that keeps the first error (exception) raised by any
+// of a set of threads, so that the other threads can stop early and the
+// error can be raised again on the calling thread once they have all
+// finished. Later errors are dropped.
+// *********************************************************************
+class FirstError {
+  private:
+    std::mutex Mutex;
+    std::exception_ptr Error;
+    std::atomic<bool> Failed;
+  public:
+    FirstError() : Failed( false ) {}
+
+    // keep the error if it is the first one
+    // *************************************
+    void Capture( std::exception_ptr E ) {
+      std::lock_guard<std::mutex> Lock( Mutex );
+      if( !Error ) Error = E;
+      Failed = true;
+    }
+
+    // has any thread failed?
+    // **********************
+    bool Occurred() const { return Failed; }
+
+    // raise the first error again (if there was one)
+    // **********************************************
+    void Rethrow() {
+      std::lock_guard<std::mutex> Lock( Mutex );
+      if( Error ) std::rethrow_exception( Error );
+    }
+};
+
+// define function prototypes
+// **************************
+int ThreadCount( int,size_t );
+void ParallelFor( int,size_t,FirstError&,const std::function<void(int,size_t)>& );
+void ParallelFor( int,size_t,const std::function<void(int,size_t)>& );
+#endif
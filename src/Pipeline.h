@@ -0,0 +1,64 @@
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+// define template class for a bounded, blocking, multi-producer and
+// multi-consumer queue that connects the stages of the pan-sharpening
+// pipeline (reader -> compute -> writers). Push() blocks while the queue
+// is full, so a fast stage cannot run ahead of a slow one by more than
+// the queue capacity. Pop() blocks while the queue is empty, and returns
+// false once the queue has been closed and drained. A queue pre-filled
+// with buffers also serves as a pool of buffers that are recycled
+// between the stages.
+// **********************************************************************
+template<typename T>
+class BoundedQueue {
+  private:
+    std::deque<T> Items;
+    size_t Capacity;
+    bool Closed;
+    std::mutex Mutex;
+    std::condition_variable NotEmpty;
+    std::condition_variable NotFull;
+  public:
+    // constructor that takes in the capacity of the queue
+    // ***************************************************
+    BoundedQueue( size_t capacity ) {
+      Capacity = capacity>0 ? capacity : 1;
+      Closed   = false;
+    }
+
+    // add an item at the back of the queue (blocks while full)
+    // ********************************************************
+    void Push( T Item ) {
+      std::unique_lock<std::mutex> Lock( Mutex );
+      NotFull.wait( Lock,[this]() { return Items.size()<Capacity; } );
+      Items.push_back( Item );
+      NotEmpty.notify_one();
+    }
+
+    // take the item at the front of the queue (blocks while empty).
+    // Returns false if the queue is closed and has no more items.
+    // *************************************************************
+    bool Pop( T& Item ) {
+      std::unique_lock<std::mutex> Lock( Mutex );
+      NotEmpty.wait( Lock,[this]() { return !Items.empty() || Closed; } );
+      if( Items.empty() ) return false;
+      Item = Items.front();
+      Items.pop_front();
+      NotFull.notify_one();
+      return true;
+    }
+
+    // no more items will be pushed: wake up all waiting consumers
+    // ***********************************************************
+    void Close() {
+      std::lock_guard<std::mutex> Lock( Mutex );
+      Closed = true;
+      NotEmpty.notify_all();
+    }
+};
+#endif
@@ -0,0 +1,193 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include "Pansharpen.h"
+#include "Preview.h"
+typedef std::string String;
+
+// keys and names of the multispectral images, in the order of the output
+// bands (red,green,blue, and NIR)
+// **********************************************************************
+static const char* PREVIEW_MS_KEYS[4] = { "red","green","blue","nir" };
+
+bool ParsePreview( const char* Text,int* Size,int* Level ) {
+  /* *************************************************************************
+   * bool ParsePreview( const char*,int*,int* ):
+   *
+   * This function parses the size of a preview (--preview flag): the
+   * largest dimension of the panchromatic preview in pixels (e.g. 2048),
+   * or an overview level of the panchromatic image as ovK (e.g. ov3, 1
+   * for its first overview).
+   *
+   * Args:
+   *   const char* : text to parse.
+   *   int* : largest dimension, set (or 0 for an overview level).
+   *   int* : overview level, set (or 0 for a largest dimension).
+   * Returns:
+   *   bool : true if the text is a valid preview size, false otherwise.
+   */
+  char End;
+  *Size  = 0;
+  *Level = 0;
+  if( sscanf( Text,"ov%d%c",Level,&End ) == 1 ) return *Level>0;
+  if( sscanf( Text,"%d%c",Size,&End ) == 1 ) return *Size>0;
+  return false;
+}
+
+std::string PreviewFileName( const char* OutputFile ) {
+  /* *************************************************************************
+   * std::string PreviewFileName( const char* ):
+   *
+   * This function returns the file name of a preview output, from the
+   * file name of the whole output: sharpened_fihs.tif becomes
+   * sharpened_fihs.preview.tif, so a preview never replaces an output.
+   *
+   * Args:
+   *   const char* : file name of the output (see SHARPEN_METHODS).
+   * Returns:
+   *   std::string : file name of the preview output.
+   */
+  String Name( OutputFile );
+  size_t dot = Name.rfind( '.' );
+  String Stem = Name.substr( 0,dot );
+  String Extension = dot == String::npos ? "" : Name.substr( dot );
+  return Stem+".preview"+Extension;
+}
+
+double PreviewScale( GDALDataset* panDataset,PansharpenOptions const& Options ) {
+  /* *************************************************************************
+   * double PreviewScale( GDALDataset*,PansharpenOptions const& ):
+   *
+   * This function returns the scale of a preview: the size of the preview
+   * of each image over its full size. For a largest dimension, the pan
+   * preview fits in it (the scale is at most 1). For an overview level K,
+   * the pan preview has the size of the K-th overview of the pan image,
+   * or, if it has fewer overviews, 1/2^K of its size.
+   *
+   * Args:
+   *   GDALDataset* : panchromatic image.
+   *   PansharpenOptions const& : options of the run (PreviewSize or
+   *                              PreviewLevel).
+   * Returns:
+   *   double : scale of the preview (0 to 1).
+   */
+  int Cols = panDataset->GetRasterXSize();
+  int Rows = panDataset->GetRasterYSize();
+  if( Options.PreviewLevel>0 ) {
+    GDALRasterBand *panBand = panDataset->GetRasterBand(1);
+    if( Options.PreviewLevel<=panBand->GetOverviewCount() ) {
+      GDALRasterBand *Overview = panBand->GetOverview( Options.PreviewLevel-1 );
+      if( Overview != nullptr ) return (double)Overview->GetXSize()/Cols;
+    }
+    return std::ldexp( 1.0,-Options.PreviewLevel );
+  }
+  int Largest = Cols>Rows ? Cols : Rows;
+  return Largest>Options.PreviewSize ? (double)Options.PreviewSize/Largest : 1.0;
+}
+
+static void ReadPreviewBand( SceneImage const& Image,int Band,double Scale,String const& Key,
+  PreviewImagery* Preview ) {
+  /* *************************************************************************
+   * void ReadPreviewBand( SceneImage const&,int,double,String const&,
+   *   PreviewImagery* ):
+   *
+   * This function reads one band of an image at the scale of the preview
+   * into a raster in memory. The read is one RasterIO() call with a
+   * buffer smaller than the image, so GDAL reads it from the closest
+   * internal or external (.ovr) overview of the band, or else decimates
+   * it (nearest neighbour): only about as many pixels as the preview has
+   * are decoded. The geotransform is scaled to the preview's grid.
+   *
+   * Args:
+   *   SceneImage const& : image of the scene.
+   *   int : band to read (1-based).
+   *   double : scale of the preview (see PreviewScale()).
+   *   String const& : key of the raster (e.g. "pan" or "red").
+   *   PreviewImagery* : preview, that the raster is added to.
+   * Returns:
+   *   None. Void. Throws PansharpenError if the band cannot be read.
+   */
+  GDALRasterBand *poBand = Image.Dataset->GetRasterBand( Band );
+  int Cols = (int)std::lround( Image.Cols*Scale );
+  int Rows = (int)std::lround( Image.Rows*Scale );
+  if( Cols<1 ) Cols = 1;
+  if( Rows<1 ) Rows = 1;
+
+  PansharpenRaster Raster;
+  Raster.Type = poBand->GetRasterDataType();
+  Raster.Cols = Cols;
+  Raster.Rows = Rows;
+  Preview->Pixels.emplace_back( (size_t)Cols*Rows*GDALGetDataTypeSizeBytes( Raster.Type ) );
+  Raster.Data = Preview->Pixels.back().data();
+  CPLErr e_Read = poBand->RasterIO( GF_Read,0,0,Image.Cols,Image.Rows,Raster.Data,
+    Cols,Rows,Raster.Type,0,0 );
+  if( !(e_Read == 0) ) {
+    throw PansharpenError( "Unable to read preview of "+( Image.File.empty() ? Key : Image.File )+
+      ": "+CPLGetLastErrorMsg() );
+  }
+
+  // the geotransform of the preview's grid: coarser pixels over the
+  // same extent
+  // ***************************************************************
+  double xRatio = (double)Image.Cols/Cols;
+  double yRatio = (double)Image.Rows/Rows;
+  Raster.HasGeoTransform = Image.HasGeoTransform;
+  for( int i=0; i<6; i++ ) Raster.GeoTransform[i] = Image.GeoTransform[i];
+  Raster.GeoTransform[1] *= xRatio;
+  Raster.GeoTransform[2] *= yRatio;
+  Raster.GeoTransform[4] *= xRatio;
+  Raster.GeoTransform[5] *= yRatio;
+  Raster.Projection = Image.Projection;
+  int bGotNoData = FALSE;
+  Raster.NoDataValue = poBand->GetNoDataValue( &bGotNoData );
+  Raster.HasNoData   = bGotNoData;
+  Preview->Rasters[Key] = Raster;
+}
+
+void ReadPreviewImagery( Scene const& Inputs,int N_bands,PansharpenOptions const& Options,
+  PreviewImagery* Preview ) {
+  /* *************************************************************************
+   * void ReadPreviewImagery( Scene const&,int,PansharpenOptions const&,
+   *   PreviewImagery* ):
+   *
+   * This function reads the imagery of a scene at reduced resolution for
+   * a quick-look (--preview flag): the panchromatic image and the first
+   * N_bands multispectral images (or bands of a multi-band multispectral
+   * image, see --ms-bands), all at the same scale (see PreviewScale()),
+   * so that the pan to multispectral ratio is kept. The time it takes is
+   * about proportional to the size of the preview rather than that of
+   * the scene. The rasters are then resampled and pan-sharpened as
+   * imagery in memory (see Pansharpen).
+   *
+   * Args:
+   *   Scene const& : the scene (opened imagery).
+   *   int : number of output bands (3 or 4).
+   *   PansharpenOptions const& : options of the run.
+   *   PreviewImagery* : preview, filled in.
+   * Returns:
+   *   None. Void. Throws PansharpenError if an image cannot be read.
+   */
+  SceneImage const& Pan = Inputs.Image( "pan" );
+  double Scale = PreviewScale( Pan.Dataset,Options );
+
+  // every raster of the preview, with its pixels allocated before any
+  // raster points at them (so that none moves)
+  // *****************************************************************
+  Preview->Pixels.reserve( 1+N_bands );
+  ReadPreviewBand( Pan,1,Scale,"pan",Preview );
+  Preview->Cols = Preview->Rasters["pan"].Cols;
+  Preview->Rows = Preview->Rasters["pan"].Rows;
+  for( int band=0; band<N_bands; band++ ) {
+    if( Inputs.Has( "ms" ) ) {
+      SceneImage const& MS = Inputs.Image( "ms" );
+      int Band = Options.MSBands[band];
+      if( Band<1 || Band>MS.Bands ) {
+        throw PansharpenError( "--ms-bands: band "+std::to_string( Band )+" is not a band of "+
+          MS.File+"." );
+      }
+      ReadPreviewBand( MS,Band,Scale,PREVIEW_MS_KEYS[band],Preview );
+    } else {
+      ReadPreviewBand( Inputs.Image( PREVIEW_MS_KEYS[band] ),1,Scale,PREVIEW_MS_KEYS[band],Preview );
+    }
+  }
+}
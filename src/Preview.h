@@ -0,0 +1,33 @@
+#ifndef PREVIEW_H_
+#define PREVIEW_H_
+#include <map>
+#include <string>
+#include <vector>
+#include "Pansharpen.h"
+
+// define C++ structure holding the imagery of a scene read at reduced
+// resolution for a quick-look (--preview flag): one raster in memory
+// per image (same keys as the image filenames, with a multi-band
+// multispectral image split into red,green,blue, and NIR rasters), the
+// pixels they point at, and the size of the panchromatic preview.
+// *********************************************************************
+struct PreviewImagery {
+  std::map<std::string,PansharpenRaster> Rasters;
+  std::vector< std::vector<unsigned char> > Pixels;
+  int Cols = 0;
+  int Rows = 0;
+};
+
+// is this a preview run (--preview flag)?
+// ***************************************
+inline bool HasPreview( PansharpenOptions const& Options ) {
+  return Options.PreviewSize>0 || Options.PreviewLevel>0;
+}
+
+// define function prototypes
+// **************************
+bool ParsePreview( const char*,int*,int* );
+std::string PreviewFileName( const char* );
+double PreviewScale( GDALDataset*,PansharpenOptions const& );
+void ReadPreviewImagery( Scene const&,int,PansharpenOptions const&,PreviewImagery* );
+#endif
@@ -8,82 +8,95 @@
 #include "cpl_conv.h"
 #include "gdalwarper.h"
 #include "ogr_spatialref.h"
+#include "cpl_string.h"
 #include "Resample.h"
 typedef std::string String;
 
-std::map<String,String> ResampleImageGeotiffs( std::map<String,String>& image_filenames ) { // reference parameter
+std::map<String,String> ResampleImageGeotiffs( Scene& Inputs, // reference parameter
+  const Window* Region, bool Reuse ) {
 
   /* ************************************************************************************
-   * std::map<std::string,std::string> ResampleImageGeotiffs( std::map<String,String>& ):
+   * std::map<std::string,std::string> ResampleImageGeotiffs( Scene&,const Window*,
+   *   bool ):
    * 
-   * This function takes in a reference parameter to a std::map object, which uses
-   * the std::string class for both keys and values. These keys and values refer
-   * to the imagery passsed in from command-line (see src/Main.cpp) for the panchromatic,
-   * blue,green,red, and NIR image files. For each of the NIR, RGB image files, this
-   * function calls the ResampleImageFile() function below to resample that Geotiff
-   * image file to the same dimensions as the panchromatic image file. A map is
-   * returned containing the new image filenames for the resampled imagery.
+   * This function takes in a reference parameter to the Scene holding the imagery
+   * passsed in from command-line (see src/Main.cpp) for the panchromatic, blue,
+   * green,red, and NIR image files (already opened, see Scene). For each of the NIR,
+   * RGB images, this function calls the ResampleImageFile() function below to 
+   * resample that Geotiff image file to the same dimensions as the panchromatic 
+   * image file (or as a region of interest of it). In the scene, each image is then
+   * replaced by its resampled Geotiff (key "<image>_resampled"), and a map is
+   * returned containing the image filenames of the scene.
    *
    * Args:
-   *   std::map<std::string,std::string>& : reference to map for filenames.
+   *   Scene& : reference to the scene (opened imagery).
+   *   const Window* : region of interest of the panchromatic grid (--window or
+   *                   --bbox flags), or nullptr for the whole image.
+   *   bool : reuse resampled files that are already there (--resume flag).
    * Returns:
    *   std::map<std:string,strd::string>  : map holding resampled imagery.
    *
    */
 
-  // create map to hold output resampled imagery
-  std::map<String,String> ResampledImagery;
+  // the multispectral (RGB,NIR) images: there is no need to resample the
+  // panchromatic image, and images already resampled are kept
+  // *********************************************************************
+  std::vector<String> filekeys;
+  for( auto const& [filekey,filename] : Inputs.FileNames() ) {
+    if( filekey == "pan" || filekey.find( "_resampled" ) != String::npos ) continue;
+    filekeys.push_back( filekey );
+  }
   
-  for( auto const& [filekey,filename] : image_filenames ) {
-
-    // there is no need to resample the panchromatic image, so we
-    // continue, so we only resample the multispectral (RGB,NIR) images
-    // ****************************************************************
-    if( filekey == "pan" ) continue;
+  for( String const& filekey : filekeys ) {
 
     // resample the Geotiff so that it maches the same dimensions as
     // the panchroamtic Geotiff. we write to file, not in memory here.
     // ***************************************************************
-    String OutNameResampled = ResampleImageFile( 
-      filename.c_str(), image_filenames["pan"].c_str() ); 
+    SceneImage const& Image = Inputs.Image( filekey );
+    String OutNameResampled = ResampleImageFile( Image.Dataset, Image.File.c_str(),
+      Inputs.Image( "pan" ).Dataset, Region, Reuse ); 
   
-    // append the map<String,String> add key/filename for the
-    // resampled image Geotiff file.
-    // ******************************************************
-    ResampledImagery[ filekey+"_resampled" ] = OutNameResampled;   
+    // replace the image with the resampled image Geotiff file
+    // *******************************************************
+    Inputs.Add( filekey+"_resampled", OutNameResampled );
+    Inputs.Remove( filekey );
   }
-
-  // make sure panchromatic image is inside the new
-  // data structure
-  // **********************************************
-  ResampledImagery[ "pan" ] = image_filenames[ "pan" ];
-  return ResampledImagery;
+  return Inputs.FileNames();
 }
 
-String ResampleImageFile( const char* srcfname, const char* dstfname ){
+String ResampleImageFile( GDALDatasetH srcDataset, const char* srcfname, GDALDatasetH dstDataset,
+  const Window* Region, bool Reuse ){
 
  /* *******************************************************************
-  * String resample(char*,char*):
+  * String ResampleImageFile(GDALDatasetH,const char*,GDALDatasetH,
+  *   const Window*,bool):
   * 
-  * This function resamples an input low-resolution 1-band
-  * Geotiff file to new dimensions as specified by an input
+  * This function resamples an input low-resolution Geotiff
+  * file (all of its bands, e.g. of a multi-band multispectral
+  * file) to new dimensions as specified by an input
   * higher-resolution (panchromatic) Geotiff file. Bicubic
-  * resampling is used here.
+  * resampling is used here. With a region of interest, only
+  * that window of the higher-resolution grid is written (and
+  * only the low-resolution pixels it needs are read). The file
+  * is written as <name>.partial and renamed once complete, so
+  * a resampled file under its own name is always complete;
+  * with Reuse, one that is already on the right grid is kept.
+  *
+  * The low- and higher-resolution datasets are opened (and closed)
+  * by the caller, see Scene.
   *
   * Args:
-  *  char* : low-resolution 1-band Geotiff filename string.
-  *  char* : higher-resolution 1-band Geotiff filename string.
+  *  GDALDatasetH : opened low-resolution Geotiff dataset.
+  *  char* : low-resolution Geotiff filename string.
+  *  GDALDatasetH : opened higher-resolution 1-band Geotiff dataset.
+  *  Window* : region of the higher-resolution grid, or nullptr.
+  *  bool : reuse an existing resampled file (--resume flag).
   * Returns:
   *  String (std::string): Out filename for resampled Geotiff file.
   *
   */
 
-  GDALAllRegister();
-  GDALDatasetH srcDataset;
   const char* srcProjection;
-
-  /* open up low-resolution Geotiff file dataset */
-  srcDataset = GDALOpen( srcfname , GA_ReadOnly );
   CPLAssert( srcDataset != NULL );
 
   /* read projection from low-res. Geotiff. Also read its
@@ -104,13 +117,9 @@ String ResampleImageFile( const char* srcfname, const char* dstfname ){
   String extension("_resampled.tif");
   outfname = ((String)srcfname).substr(0,len-4)+extension;
 
-  /* remove output resampled Geotiff file if it already exists */
-  int deleted;
-  if( access( outfname.c_str() , F_OK ) != -1) {
-    deleted = remove(outfname.c_str());
-  }
+  String partialfname = outfname+".partial";
 
-  /* open the destination (high-res) file (i.e. panchromatic image file) ,
+  /* from the destination (high-res) file (i.e. panchromatic image file) ,
    * read following parameters:
    *  (1) ncols : output resampled number of columns (samples)
    *  (2) nrows : output resampled number of rows (lines)
@@ -118,17 +127,47 @@ String ResampleImageFile( const char* srcfname, const char* dstfname ){
    *  (4) output projection string
    */
 
-  GDALDatasetH dstDataset;
   int dstnrows, dstncols;
   double dstGeotransform[6];
   const char* dstProjection;
 
-  dstDataset = GDALOpen( dstfname , GA_ReadOnly);
   dstncols = GDALGetRasterXSize( dstDataset );
   dstnrows = GDALGetRasterYSize( dstDataset );
   GDALGetGeoTransform(dstDataset, dstGeotransform);
   dstProjection = GDALGetProjectionRef( dstDataset );
 
+  /* restrict the output to the region of interest, if any: its
+   * dimensions, and the geotransform moved to its upper-left corner
+   */
+
+  if( Region != nullptr ) {
+    dstGeotransform[0] += Region->xoff*dstGeotransform[1]+Region->yoff*dstGeotransform[2];
+    dstGeotransform[3] += Region->xoff*dstGeotransform[4]+Region->yoff*dstGeotransform[5];
+    dstncols = Region->xsize;
+    dstnrows = Region->ysize;
+  }
+
+  /* keep an existing resampled Geotiff file on the same grid if asked
+   * to (it is complete, see above), otherwise remove it
+   */
+
+  if( Reuse && access( outfname.c_str() , F_OK ) != -1 ) {
+    GDALDatasetH oldDataset = GDALOpen( outfname.c_str() , GA_ReadOnly );
+    double oldGeotransform[6];
+    bool sameGrid = oldDataset != NULL &&
+      GDALGetRasterXSize( oldDataset ) == dstncols &&
+      GDALGetRasterYSize( oldDataset ) == dstnrows &&
+      GDALGetRasterCount( oldDataset ) == GDALGetRasterCount( srcDataset ) &&
+      GDALGetGeoTransform( oldDataset, oldGeotransform ) == CE_None &&
+      memcmp( oldGeotransform, dstGeotransform, sizeof(oldGeotransform) ) == 0;
+    if( oldDataset != NULL ) GDALClose( oldDataset );
+    if( sameGrid ) return outfname;
+  }
+  int deleted;
+  if( access( outfname.c_str() , F_OK ) != -1) {
+    deleted = remove(outfname.c_str());
+  }
+
   /* create geotransform object ... pass in following parameters:
    * (1) srcDataset : open GDAL dataset from low-res file
    * (2) srcProjection : projection from low-res file
@@ -172,14 +211,16 @@ String ResampleImageFile( const char* srcfname, const char* dstfname ){
 
   /* create output dataset. This will have the same dimensions
    * as the input high-resolution Geotiff datasat (i.e. a 1-band Geotiff file
-   * holding a panchromatic band). This output dataset will also inherit
-   * its geotransform and projection string from this input high-res. dataset.
+   * holding a panchromatic band), and the bands of the low-res. Geotiff 
+   * (all of them, for a multi-band multispectral file). This output dataset
+   * will also inherit its geotransform and projection string from this input
+   * high-res. dataset.
    */
 
   outHandleDriver = GDALGetDriverByName("GTiff");
   outDataset = GDALCreate( outHandleDriver ,
-    outfname.c_str() ,
-    dstncols, dstnrows , 1 ,
+    partialfname.c_str() ,
+    dstncols, dstnrows , GDALGetRasterCount( srcDataset ) ,
     sourceDatatype, NULL);
   GDALSetProjection( outDataset , dstProjection) ;
   GDALSetGeoTransform( outDataset, dstGeotransform) ;
@@ -204,5 +245,113 @@ String ResampleImageFile( const char* srcfname, const char* dstfname ){
     // alternatively: GRA_Cubic, 0.0, 0.0, GDALTermProgress, NULL, NULL);
   CPLAssert( eErr == CE_None) ;
   GDALClose(outDataset); /* this line is important. Close output dataset! */
+
+  /* give the complete file its own name, or remove an incomplete one */
+  if( eErr == CE_None ) {
+    rename( partialfname.c_str(), outfname.c_str() );
+  } else {
+    remove( partialfname.c_str() );
+  }
   return outfname;
 }
+
+GDALDatasetH CreateResampledVRT( GDALDatasetH srcDataset,GDALDatasetH dstDataset,
+  int nBands,const int* srcBands ) {
+
+ /* *******************************************************************
+  * GDALDatasetH CreateResampledVRT(GDALDatasetH,GDALDatasetH,int,
+  *   const int*):
+  *
+  * This function creates an in-memory warped VRT dataset that resamples
+  * bands of an opened low-resolution Geotiff onto the grid (dimensions,
+  * geotransform, and projection) of an opened higher-resolution 
+  * (panchromatic) Geotiff. Bicubic resampling is used here, with the
+  * same source NoData handling as GDALReprojectImage() in
+  * ResampleImageFile() above, so no resampled file is written to disk.
+  * Pixels are warped on demand, only for the windows that are read
+  * from the returned dataset.
+  *
+  * The returned dataset must be closed (GDALClose()) before the source
+  * dataset is closed. A warped VRT is not thread-safe, so each thread
+  * should create its own from its own source dataset.
+  *
+  * Band i of the warped VRT is band srcBands[i-1] of the source, so a
+  * band-interleaved read of the VRT warps all of the bands at once.
+  *
+  * Args:
+  *  GDALDatasetH : opened low-resolution Geotiff dataset.
+  *  GDALDatasetH : opened higher-resolution 1-band Geotiff dataset.
+  *  int : number of bands to resample (default 1).
+  *  const int* : bands (1-based) of the source to resample, or NULL for
+  *               bands 1 to N (default).
+  * Returns:
+  *  GDALDatasetH : warped VRT dataset, or NULL on failure.
+  *
+  */
+
+  const char* srcProjection = GDALGetProjectionRef( srcDataset );
+  const char* dstProjection = GDALGetProjectionRef( dstDataset );
+  int dstncols = GDALGetRasterXSize( dstDataset );
+  int dstnrows = GDALGetRasterYSize( dstDataset );
+  double dstGeotransform[6];
+  GDALGetGeoTransform( dstDataset, dstGeotransform );
+
+  /* set up the warp options: bicubic resampling of the bands of the 
+   * source into bands 1 to N of the warped VRT, using a transformer from
+   * the source (low-res.) grid to the destination (high-res.) grid.
+   */
+
+  GDALWarpOptions *psWarpOptions = GDALCreateWarpOptions();
+  psWarpOptions->hSrcDS          = srcDataset;
+  psWarpOptions->eResampleAlg    = GRA_Cubic;
+  psWarpOptions->nBandCount      = nBands;
+  psWarpOptions->panSrcBands     = (int*) CPLMalloc( sizeof(int)*nBands );
+  psWarpOptions->panDstBands     = (int*) CPLMalloc( sizeof(int)*nBands );
+  for( int band=0; band<nBands; band++ ) {
+    psWarpOptions->panSrcBands[band] = srcBands ? srcBands[band] : band+1;
+    psWarpOptions->panDstBands[band] = band+1;
+  }
+  psWarpOptions->pfnTransformer  = GDALGenImgProjTransform;
+  psWarpOptions->pTransformerArg = GDALCreateGenImgProjTransformer( srcDataset,
+    srcProjection, dstDataset, dstProjection, FALSE, 0, 1 );
+  if( psWarpOptions->pTransformerArg == NULL ) {
+    GDALDestroyWarpOptions( psWarpOptions );
+    return NULL;
+  }
+
+  /* like GDALReprojectImage(), skip source NoData pixels if the source
+   * has a NoData value (each band its own; a band without one gets a 
+   * value that no pixel holds, as in gdalwarp), and initialize destination
+   * pixels to zero.
+   */
+
+  for( int band=0; band<nBands; band++ ) {
+    int bGotNoData = FALSE;
+    double srcNoData = GDALGetRasterNoDataValue( GDALGetRasterBand(srcDataset,
+      psWarpOptions->panSrcBands[band]), &bGotNoData );
+    if( !bGotNoData ) continue;
+    if( psWarpOptions->padfSrcNoDataReal == NULL ) {
+      psWarpOptions->padfSrcNoDataReal = (double*) CPLMalloc( sizeof(double)*nBands );
+      for( int other=0; other<nBands; other++ ) {
+        psWarpOptions->padfSrcNoDataReal[other] = -1.1e20;
+      }
+    }
+    psWarpOptions->padfSrcNoDataReal[band] = srcNoData;
+  }
+  psWarpOptions->papszWarpOptions = CSLSetNameValue(
+    psWarpOptions->papszWarpOptions, "INIT_DEST", "0" );
+
+  /* create the warped VRT. It takes ownership of the transformer, and 
+   * copies the warp options, so they can be destroyed here.
+   */
+
+  GDALDatasetH vrtDataset = GDALCreateWarpedVRT( srcDataset,
+    dstncols, dstnrows, dstGeotransform, psWarpOptions );
+  if( vrtDataset == NULL ) {
+    GDALDestroyGenImgProjTransformer( psWarpOptions->pTransformerArg );
+  } else {
+    GDALSetProjection( vrtDataset, dstProjection );
+  }
+  GDALDestroyWarpOptions( psWarpOptions );
+  return vrtDataset;
+}
@@ -1,6 +1,9 @@
 #ifndef RESAMPLE_H_
 #define RESAMPLE_H_
+#include "Window.h"
+#include "Scene.h"
 typedef std::string String;
-std::map<String,String> ResampleImageGeotiffs( std::map<String,String>& );
-String ResampleImageFile(const char*,const char*);
+std::map<String,String> ResampleImageGeotiffs( Scene&,const Window* = nullptr,bool = false );
+String ResampleImageFile(GDALDatasetH,const char*,GDALDatasetH,const Window* = nullptr,bool = false);
+GDALDatasetH CreateResampledVRT(GDALDatasetH,GDALDatasetH,int = 1,const int* = nullptr);
 #endif
@@ -0,0 +1,24 @@
+#ifndef SATURATE_H_
+#define SATURATE_H_
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// define template function to convert a double-precision value to pixel
+// type T. For integer types, the value is rounded to the nearest integer
+// (halves away from zero, like GDAL) and clamped to the range of T; NaN
+// becomes zero. Floating-point values are simply cast.
+// **********************************************************************
+template<typename T>
+inline T SaturateCast( double value ) {
+  if constexpr ( std::is_integral<T>::value ) {
+    if( std::isnan( value ) ) return (T)0;
+    value = std::round( value );
+    if( value<(double)std::numeric_limits<T>::lowest() ) return std::numeric_limits<T>::lowest();
+    if( value>(double)std::numeric_limits<T>::max()    ) return std::numeric_limits<T>::max();
+    return (T)value;
+  } else {
+    return (T)value;
+  }
+}
+#endif
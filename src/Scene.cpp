@@ -0,0 +1,136 @@
+#include "Pansharpen.h"
+#include "Scene.h"
+typedef std::string String;
+
+Scene::Scene( std::map<String,String> const& FileNames ) {
+  /* *************************************************************************
+   * Scene::Scene( std::map<std::string,std::string> const& ):
+   *
+   * This constructor opens every image of a scene (see Add()).
+   *
+   * Args:
+   *   std::map<std::string,std::string> const& : image filenames, keyed
+   *     "pan", "red", ... (see src/Main.cpp).
+   * Returns:
+   *   None. Throws PansharpenError if an image file cannot be opened (the
+   *   images opened so far are closed).
+   */
+  try {
+    for( auto const& [Key,File] : FileNames ) Add( Key,File );
+  } catch( ... ) {
+    for( auto& [Key,Image] : Images ) GDALClose( Image.Dataset );
+    throw;
+  }
+}
+
+Scene::~Scene() {
+  /* *************************************************************************
+   * Scene::~Scene():
+   *
+   * This destructor closes the datasets of the scene.
+   */
+  for( auto& [Key,Image] : Images ) GDALClose( Image.Dataset );
+}
+
+void Scene::Add( String const& Key,String const& File ) {
+  /* *************************************************************************
+   * void Scene::Add( std::string const&,std::string const& ):
+   *
+   * This function opens an image file of the scene (read-only) and reads
+   * its metadata.
+   *
+   * Args:
+   *   std::string const& : key of the image (e.g. "pan" or "red_resampled").
+   *   std::string const& : name of the image file.
+   * Returns:
+   *   None. Void. Throws PansharpenError if the file cannot be opened.
+   */
+  GDALDataset *Dataset = (GDALDataset*) GDALOpen( File.c_str(),GA_ReadOnly );
+  if( Dataset == nullptr ) {
+    throw PansharpenError( "Unable to open image file "+File+"." );
+  }
+  Add( Key,Dataset,File );
+}
+
+void Scene::Add( String const& Key,GDALDataset* Dataset,String const& File ) {
+  /* *************************************************************************
+   * void Scene::Add( std::string const&,GDALDataset*,std::string const& ):
+   *
+   * This function adds an opened image to the scene, which owns it from
+   * then on, and reads its metadata. An image already under the key is
+   * closed.
+   *
+   * Args:
+   *   std::string const& : key of the image.
+   *   GDALDataset* : opened dataset (e.g. a MEM dataset wrapping a raster
+   *                  held in memory).
+   *   std::string const& : name of its file, or "" for none.
+   * Returns:
+   *   None. Void. Throws PansharpenError if the image has no bands (the
+   *   dataset is closed).
+   */
+  if( Dataset->GetRasterCount()<1 ) {
+    GDALClose( Dataset );
+    throw PansharpenError( "image "+( File.empty() ? Key : File )+" has no bands." );
+  }
+  Remove( Key );
+  SceneImage& Image = Images[Key];
+  Image.File    = File;
+  Image.Dataset = Dataset;
+  Image.Cols    = Dataset->GetRasterXSize();
+  Image.Rows    = Dataset->GetRasterYSize();
+  Image.Bands   = Dataset->GetRasterCount();
+  for( int band=1; band<=Image.Bands; band++ ) {
+    Image.BandTypes.push_back( Dataset->GetRasterBand(band)->GetRasterDataType() );
+  }
+  Image.Type    = Image.BandTypes[0];
+  Image.HasGeoTransform = Dataset->GetGeoTransform( Image.GeoTransform ) == CE_None;
+  const char* Projection = Dataset->GetProjectionRef();
+  Image.Projection = Projection ? Projection : "";
+  int bGotNoData = FALSE;
+  Image.NoDataValue = Dataset->GetRasterBand(1)->GetNoDataValue( &bGotNoData );
+  Image.HasNoData   = bGotNoData;
+  Dataset->GetRasterBand(1)->GetBlockSize( &Image.BlockX,&Image.BlockY );
+}
+
+void Scene::Remove( String const& Key ) {
+  // close an image of the scene, if there is one under this key
+  auto Image = Images.find( Key );
+  if( Image == Images.end() ) return;
+  GDALClose( Image->second.Dataset );
+  Images.erase( Image );
+}
+
+bool Scene::Has( String const& Key ) const {
+  // is there an image under this key?
+  return Images.count( Key )>0;
+}
+
+SceneImage const& Scene::Image( String const& Key ) const {
+  /* *************************************************************************
+   * SceneImage const& Scene::Image( std::string const& ) const:
+   *
+   * This function returns an image of the scene: its metadata, and the
+   * dataset handle of the thread that runs the scene.
+   *
+   * Args:
+   *   std::string const& : key of the image.
+   * Returns:
+   *   SceneImage const& : the image. Throws PansharpenError if there is
+   *   no image under the key.
+   */
+  auto Image = Images.find( Key );
+  if( Image == Images.end() ) {
+    throw PansharpenError( "no "+Key+" image in the scene." );
+  }
+  return Image->second;
+}
+
+std::map<String,String> Scene::FileNames() const {
+  // image filenames of the scene, keyed as the images (files only)
+  std::map<String,String> Files;
+  for( auto const& [Key,Image] : Images ) {
+    if( !Image.File.empty() ) Files[Key] = Image.File;
+  }
+  return Files;
+}
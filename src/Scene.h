@@ -0,0 +1,55 @@
+#ifndef SCENE_H_
+#define SCENE_H_
+#include <map>
+#include <string>
+#include <vector>
+#include "gdal_priv.h"
+
+// define C++ structure holding what is known about one image of a scene:
+// its file (empty for a raster in memory), the dataset handle of the 
+// main thread, and the metadata read once when it was opened (dimensions,
+// geotransform, projection, data type of each band, NoData value and
+// block size of band 1)
+// ***********************************************************************
+struct SceneImage {
+  std::string File;
+  GDALDataset *Dataset = nullptr;
+  int Cols  = 0;
+  int Rows  = 0;
+  int Bands = 0;
+  GDALDataType Type = GDT_Unknown; // of band 1
+  std::vector<GDALDataType> BandTypes;
+  bool HasGeoTransform   = false;
+  double GeoTransform[6] = { 0.0,1.0,0.0,0.0,0.0,1.0 };
+  std::string Projection;
+  bool HasNoData     = false;
+  double NoDataValue = 0.0;
+  int BlockX = 0;
+  int BlockY = 0;
+};
+
+// define C++ class holding the images of one scene (pan, red, ..., and
+// their *_resampled files), keyed as the map of image filenames. Each 
+// image is opened once, and the stages of a run (data type check, region
+// of interest, resampling to disk, planning, and creating the outputs)
+// share its handle and metadata instead of opening it again. A handle is
+// not thread-safe: it is only used by the thread that runs the scene, and
+// reader threads still open their own (see OpenSharpenWorker()).
+// ***********************************************************************
+class Scene {
+  private:
+    std::map<std::string,SceneImage> Images;
+  public:
+    Scene() {}
+    Scene( std::map<std::string,std::string> const& );
+    Scene( Scene const& ) = delete;
+    Scene& operator=( Scene const& ) = delete;
+    ~Scene();
+    void Add( std::string const&,std::string const& );
+    void Add( std::string const&,GDALDataset*,std::string const& );
+    void Remove( std::string const& );
+    bool Has( std::string const& ) const;
+    SceneImage const& Image( std::string const& ) const;
+    std::map<std::string,std::string> FileNames() const;
+};
+#endif
@@ -0,0 +1,165 @@
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "Pansharpen.h"
+#include "gdal_vrt.h"
+#include "Shard.h"
+typedef std::string String;
+
+std::string ShardFileName( const char* OutputFile,int Shard,int N_shards ) {
+  /* *************************************************************************
+   * std::string ShardFileName( const char*,int,int ):
+   *
+   * This function returns the file name of a shard's partial output, from
+   * the file name of the whole output: sharpened_fihs.tif becomes
+   * sharpened_fihs.shard-2-of-8.tif for shard 2 of 8.
+   *
+   * Args:
+   *   const char* : file name of the output (see SHARPEN_METHODS).
+   *   int : shard number, from 1 to N_shards.
+   *   int : number of shards.
+   * Returns:
+   *   std::string : file name of the partial output.
+   */
+  String Name( OutputFile );
+  size_t dot = Name.rfind( '.' );
+  String Stem = Name.substr( 0,dot );
+  String Extension = dot == String::npos ? "" : Name.substr( dot );
+  return Stem+".shard-"+std::to_string( Shard )+"-of-"+std::to_string( N_shards )+Extension;
+}
+
+bool ParseShard( const char* Text,int* Shard,int* N_shards ) {
+  /* *************************************************************************
+   * bool ParseShard( const char*,int*,int* ):
+   *
+   * This function parses a shard given as i/N (--shard flag), e.g. 2/8.
+   *
+   * Args:
+   *   const char* : text of the shard.
+   *   int* : shard number, from 1 to N (output).
+   *   int* : number of shards (output).
+   * Returns:
+   *   bool : true if the text is a valid shard, false otherwise.
+   */
+  char End;
+  if( sscanf( Text,"%d/%d%c",Shard,N_shards,&End ) != 2 ) return false;
+  return *N_shards>=1 && *Shard>=1 && *Shard<=*N_shards;
+}
+
+void MergeShards( const char* OutDir,unsigned Methods,int N_shards ) {
+  /* *************************************************************************
+   * void MergeShards( const char*,unsigned,int ):
+   *
+   * This function stitches the N_shards partial outputs of each selected
+   * method (written by runs with --shard i/N into OutDir) into one output:
+   * a VRT (e.g. sharpened_fihs.vrt) next to the partial outputs, that 
+   * takes each row of the image from the shard holding it. Nothing is
+   * decoded or recompressed, and since every shard computed its rows 
+   * exactly as a single run would have, the VRT reads back identical to
+   * the output of a single run. It can be converted into one Geotiff 
+   * with gdal_translate if needed.
+   *
+   * Args:
+   *   const char* : output directory holding the partial outputs.
+   *   unsigned : bit mask of the methods to merge (see SharpenMethod).
+   *   int : number of shards.
+   * Returns:
+   *   None. Void. Throws PansharpenError if a partial output is missing,
+   *   or the partial outputs do not fit together.
+   */
+  std::filesystem::path Dir( OutDir );
+  GDALDriver *driverVRT = GetGDALDriverManager()->GetDriverByName( "VRT" );
+  if( driverVRT == nullptr ) {
+    throw PansharpenError( "the GDAL VRT driver is not available." );
+  }
+
+  for( int Method=0; Method<N_METHODS; Method++ ) {
+    if( !( Methods & ( 1u<<Method ) ) ) continue;
+
+    // open every partial output of the method, and make sure they have
+    // one size, band count, and data type, and that their rows tile 
+    // the image from top to bottom
+    // ****************************************************************
+    std::vector<GDALDataset*> Shards;
+    std::vector<int> RowOffsets,RowCounts;
+    auto CloseShards = [&]() {
+      for( GDALDataset *Shard : Shards ) GDALClose( Shard );
+    };
+    int NextRow = 0;
+    for( int shard=1; shard<=N_shards; shard++ ) {
+      String Name = ( Dir / ShardFileName( SHARPEN_METHODS[Method].OutputFile,shard,N_shards ) ).string();
+      GDALDataset *Shard = (GDALDataset*) GDALOpen( Name.c_str(),GA_ReadOnly );
+      const char *Rows = Shard ? Shard->GetMetadataItem( SHARD_METADATA_ROWS ) : nullptr;
+      int yoff = 0,ysize = 0;
+      if( Shard == nullptr || Rows == nullptr || sscanf( Rows,"%d,%d",&yoff,&ysize ) != 2 ) {
+        if( Shard != nullptr ) GDALClose( Shard );
+        CloseShards();
+        throw PansharpenError( "Unable to open partial output "+Name+" (shard "+
+          std::to_string( shard )+" of "+std::to_string( N_shards )+")." );
+      }
+      Shards.push_back( Shard );
+      GDALDataset *First = Shards[0];
+      bool Fits = yoff == NextRow && yoff+ysize<=Shard->GetRasterYSize() &&
+        Shard->GetRasterXSize() == First->GetRasterXSize() &&
+        Shard->GetRasterYSize() == First->GetRasterYSize() &&
+        Shard->GetRasterCount() == First->GetRasterCount() &&
+        Shard->GetRasterBand(1)->GetRasterDataType() == First->GetRasterBand(1)->GetRasterDataType();
+      if( !Fits ) {
+        CloseShards();
+        throw PansharpenError( "partial output "+Name+" does not fit with the other shards "
+          "(were all shards run with the same options?)." );
+      }
+      RowOffsets.push_back( yoff );
+      RowCounts.push_back( ysize );
+      NextRow = yoff+ysize;
+    }
+    GDALDataset *First = Shards[0];
+    int N_COLS  = First->GetRasterXSize();
+    int N_ROWS  = First->GetRasterYSize();
+    int N_bands = First->GetRasterCount();
+    GDALDataType Type = First->GetRasterBand(1)->GetRasterDataType();
+    if( NextRow != N_ROWS ) {
+      CloseShards();
+      throw PansharpenError( String( "the partial outputs of " )+SHARPEN_METHODS[Method].Label+
+        " do not cover the whole image." );
+    }
+
+    // the VRT: the grid of the partial outputs, and for each band one
+    // simple source (a range of rows) per non-empty shard
+    // ***************************************************************
+    String VRTFile = ( Dir / SHARPEN_METHODS[Method].OutputFile ).replace_extension( ".vrt" ).string();
+    GDALDataset *Merged = driverVRT->Create( VRTFile.c_str(),N_COLS,N_ROWS,0,Type,nullptr );
+    if( Merged == nullptr ) {
+      CloseShards();
+      throw PansharpenError( "Unable to create "+VRTFile+": "+CPLGetLastErrorMsg() );
+    }
+    double gt[6];
+    if( First->GetGeoTransform( gt ) == CE_None ) Merged->SetGeoTransform( gt );
+    Merged->SetProjection( First->GetProjectionRef() );
+    CPLErr e_VRT = CE_None;
+    for( int band=1; band<=N_bands && e_VRT == CE_None; band++ ) {
+      Merged->AddBand( Type,nullptr );
+      GDALRasterBand *MergedBand = Merged->GetRasterBand( band );
+      GDALRasterBand *FirstBand  = First->GetRasterBand( band );
+      int HasScale = FALSE,HasOffset = FALSE;
+      double Scale  = FirstBand->GetScale( &HasScale );
+      double Offset = FirstBand->GetOffset( &HasOffset );
+      if( HasScale )  MergedBand->SetScale( Scale );
+      if( HasOffset ) MergedBand->SetOffset( Offset );
+      for( int shard=0; shard<N_shards && e_VRT == CE_None; shard++ ) {
+        if( RowCounts[shard] == 0 ) continue;
+        e_VRT = VRTAddSimpleSource( (VRTSourcedRasterBandH) MergedBand,
+          Shards[shard]->GetRasterBand( band ),0,RowOffsets[shard],N_COLS,RowCounts[shard],
+          0,RowOffsets[shard],N_COLS,RowCounts[shard],nullptr,VRT_NODATA_UNSET );
+      }
+    }
+    GDALClose( Merged ); // writes the VRT file
+    CloseShards();
+    if( e_VRT != CE_None ) {
+      std::remove( VRTFile.c_str() );
+      throw PansharpenError( "Unable to add shards to "+VRTFile+": "+CPLGetLastErrorMsg() );
+    }
+    printf("  merged %d shard(s) into %s \n",N_shards,VRTFile.c_str());
+  }
+}
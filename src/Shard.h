@@ -0,0 +1,16 @@
+#ifndef SHARD_H_
+#define SHARD_H_
+#include <string>
+
+// metadata items of a shard's partial output (--shard flag): the shard
+// as i/N, and the rows of the output it holds as yoff,ysize
+// ********************************************************************
+#define SHARD_METADATA_SHARD "PANSHARPEN_SHARD"
+#define SHARD_METADATA_ROWS  "PANSHARPEN_SHARD_ROWS"
+
+// define function prototypes
+// **************************
+std::string ShardFileName( const char*,int,int );
+bool ParseShard( const char*,int*,int* );
+void MergeShards( const char*,unsigned,int );
+#endif
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cmath>
+#include "Statistics.h"
+
+void MergeStatistics( BandStatistics& A,BandStatistics const& B ) {
+  /* *************************************************************************
+   * void MergeStatistics( BandStatistics&,BandStatistics const& ):
+   *
+   * This function merges a second set of statistics into the first, with
+   * the pairwise update of Chan, Golub and LeVeque:
+   *   mean = meanA + delta*nB/n
+   *   M2   = M2A + M2B + delta*delta'*nA*nB/n,  delta = meanB - meanA
+   *
+   * Args:
+   *   BandStatistics& : statistics to merge into.
+   *   BandStatistics const& : statistics to merge.
+   * Returns:
+   *   None. Void.
+   */
+  if( B.Count == 0.0 ) return;
+  if( A.Count == 0.0 ) {
+    A = B;
+    return;
+  }
+  double n = A.Count+B.Count;
+  double delta[ MAX_STAT_VARS ];
+  for( int v=0; v<A.NV; v++ ) {
+    delta[v] = B.Mean[v]-A.Mean[v];
+  }
+  for( int v=0; v<A.NV; v++ ) {
+    for( int w=0; w<A.NV; w++ ) {
+      A.M2[v][w] += B.M2[v][w]+delta[v]*delta[w]*A.Count*B.Count/n;
+    }
+    A.Mean[v] += delta[v]*B.Count/n;
+  }
+  A.Count = n;
+}
+
+static void LargestEigenvector( double C[4][4],int N,double* Vector ) {
+  /* *************************************************************************
+   * void LargestEigenvector( double[4][4],int,double* ):
+   *
+   * This function finds the eigenvector of the largest eigenvalue of a
+   * symmetric N-by-N matrix (N<=4) with cyclic Jacobi rotations. The sign
+   * is chosen so that the elements sum to a positive value.
+   *
+   * Args:
+   *   double[4][4] : symmetric matrix (overwritten).
+   *   int : size of the matrix.
+   *   double* : the eigenvector (unit length, N elements).
+   * Returns:
+   *   None. Void.
+   */
+  double V[4][4] = { { 0.0 } };
+  for( int i=0; i<N; i++ ) V[i][i] = 1.0;
+
+  for( int sweep=0; sweep<50; sweep++ ) {
+    double offDiagonal = 0.0;
+    for( int p=0; p<N; p++ ) {
+      for( int q=p+1; q<N; q++ ) offDiagonal += C[p][q]*C[p][q];
+    }
+    if( offDiagonal == 0.0 ) break;
+
+    for( int p=0; p<N; p++ ) {
+      for( int q=p+1; q<N; q++ ) {
+        if( C[p][q] == 0.0 ) continue;
+        double theta = ( C[q][q]-C[p][p] )/( 2.0*C[p][q] );
+        double t = ( theta>=0.0 ? 1.0 : -1.0 )/( std::fabs(theta)+std::sqrt( theta*theta+1.0 ) );
+        double c = 1.0/std::sqrt( t*t+1.0 );
+        double s = t*c;
+        for( int k=0; k<N; k++ ) {
+          double Ckp = C[k][p],Ckq = C[k][q];
+          C[k][p] = c*Ckp-s*Ckq;
+          C[k][q] = s*Ckp+c*Ckq;
+        }
+        for( int k=0; k<N; k++ ) {
+          double Cpk = C[p][k],Cqk = C[q][k];
+          C[p][k] = c*Cpk-s*Cqk;
+          C[q][k] = s*Cpk+c*Cqk;
+        }
+        for( int k=0; k<N; k++ ) {
+          double Vkp = V[k][p],Vkq = V[k][q];
+          V[k][p] = c*Vkp-s*Vkq;
+          V[k][q] = s*Vkp+c*Vkq;
+        }
+      }
+    }
+  }
+
+  int largest = 0;
+  for( int i=1; i<N; i++ ) {
+    if( C[i][i]>C[largest][largest] ) largest = i;
+  }
+  double sum = 0.0;
+  for( int i=0; i<N; i++ ) sum += V[i][largest];
+  for( int i=0; i<N; i++ ) Vector[i] = sum<0.0 ? -V[i][largest] : V[i][largest];
+}
+
+static void IntensityMoments( BandStatistics const& Stats,int N_bands,const double* Weights,
+  double* meanI,double* M2_II,double* M2_kI ) {
+  /* *************************************************************************
+   * void IntensityMoments( BandStatistics const&,int,const double*,double*,
+   *   double*,double* ):
+   *
+   * This function computes the mean of the intensity component 
+   * I = sum_j Weights[j]*band_j, its co-moment with itself, and its
+   * co-moment with each band, from the band statistics.
+   *
+   * Args:
+   *   BandStatistics const& : statistics of the bands.
+   *   int : number of multispectral bands (3 or 4).
+   *   const double* : intensity weights.
+   *   double* : mean of I.
+   *   double* : co-moment of I with itself.
+   *   double* : co-moment of I with each band (N_bands values).
+   * Returns:
+   *   None. Void.
+   */
+  *meanI = 0.0;
+  *M2_II = 0.0;
+  for( int v=0; v<N_bands; v++ ) {
+    *meanI  += Weights[v]*Stats.Mean[v];
+    M2_kI[v] = 0.0;
+    for( int w=0; w<N_bands; w++ ) {
+      M2_kI[v] += Stats.M2[v][w]*Weights[w];
+      *M2_II   += Weights[v]*Stats.M2[v][w]*Weights[w];
+    }
+  }
+}
+
+static bool MatchPanMeanStd( BandStatistics const& Stats,int N_bands,double meanI,double M2_II,
+  double* PanGain,double* PanBias ) {
+  /* *************************************************************************
+   * bool MatchPanMeanStd( BandStatistics const&,int,double,double,double*,
+   *   double* ):
+   *
+   * This function computes the gain and bias that match the pan band to
+   * the mean and standard deviation of the intensity component. If the
+   * statistics are degenerate (e.g. constant imagery), the pan band is not
+   * matched (gain 1, bias 0).
+   *
+   * Returns:
+   *   bool : false if the statistics are degenerate.
+   */
+  double M2_PP = Stats.M2[N_bands][N_bands];
+  bool degenerate = !( Stats.Count>1.0 && M2_II>0.0 && M2_PP>0.0 );
+  *PanGain = degenerate ? 1.0 : std::sqrt( M2_II/M2_PP );
+  *PanBias = degenerate ? 0.0 : meanI-*PanGain*Stats.Mean[N_bands];
+  return !degenerate;
+}
+
+SharpenParams ComponentSubstitutionParams( int Method,BandStatistics const& Stats,int N_bands ) {
+  /* *************************************************************************
+   * SharpenParams ComponentSubstitutionParams( int,BandStatistics const&,
+   *   int ):
+   *
+   * This function derives the parameters of a component substitution
+   * method (see SharpenParams) from the statistics of the multispectral
+   * bands and the pan band:
+   *   Gram-Schmidt: the intensity component is the mean of the bands
+   *     (the simulated low-resolution pan), and the gain of band k is
+   *     cov(band_k,I)/var(I), the first Gram-Schmidt coefficient.
+   *   PCA: the intensity component is the first principal component
+   *     (largest eigenvector v of the band covariance matrix), and the
+   *     gain of band k is v_k, the inverse transform of the component.
+   * In both cases the pan band is matched to the mean and standard
+   * deviation of the intensity component before it is substituted.
+   * If the statistics are degenerate (e.g. constant imagery), the pan
+   * band is not matched and the Gram-Schmidt gains are 1 (FIHS-like).
+   *
+   * Args:
+   *   int : method (METHOD_GS or METHOD_PCA).
+   *   BandStatistics const& : statistics of the bands (N_bands+1 variables).
+   *   int : number of multispectral bands (3 or 4).
+   * Returns:
+   *   SharpenParams : weights, gains, and pan matching of the method.
+   */
+  double Weights[4] = { 0.0 },Gains[4] = { 0.0 };
+  if( Method == METHOD_PCA ) {
+    double C[4][4];
+    for( int v=0; v<N_bands; v++ ) {
+      for( int w=0; w<N_bands; w++ ) C[v][w] = Stats.M2[v][w];
+    }
+    LargestEigenvector( C,N_bands,Weights );
+    for( int band=0; band<N_bands; band++ ) Gains[band] = Weights[band];
+  } else {
+    for( int band=0; band<N_bands; band++ ) Weights[band] = 1.0/N_bands;
+  }
+
+  double meanI,M2_II,M2_kI[4],PanGain,PanBias;
+  IntensityMoments( Stats,N_bands,Weights,&meanI,&M2_II,M2_kI );
+  bool matched = MatchPanMeanStd( Stats,N_bands,meanI,M2_II,&PanGain,&PanBias );
+
+  SharpenParams Params;
+  for( int band=0; band<4; band++ ) {
+    if( Method == METHOD_GS ) {
+      Gains[band] = matched ? M2_kI[band]/M2_II : 1.0;
+    }
+    Params.Weights[band] = band<N_bands ? (float)Weights[band] : 0.0f;
+    Params.Gains[band]   = band<N_bands ? (float)Gains[band] : 0.0f;
+  }
+  Params.PanGain = (float)PanGain;
+  Params.PanBias = (float)PanBias;
+  return Params;
+}
+
+SharpenParams IntensityParams( BandStatistics const& Stats,int N_bands,const double* Weights,
+  bool MatchMeanStd ) {
+  /* *************************************************************************
+   * SharpenParams IntensityParams( BandStatistics const&,int,const double*,
+   *   bool ):
+   *
+   * This function gives the parameters of FIHS as a component substitution
+   * kernel: intensity weights as given, gains of 1, and the pan band either
+   * left as it is or matched to the mean and standard deviation of the 
+   * intensity component.
+   *
+   * Args:
+   *   BandStatistics const& : statistics of the bands (N_bands+1 variables).
+   *   int : number of multispectral bands (3 or 4).
+   *   const double* : intensity weights (N_bands weights).
+   *   bool : true to match the pan band to the mean and standard deviation.
+   * Returns:
+   *   SharpenParams : weights, gains, and pan matching of FIHS.
+   */
+  double PanGain = 1.0,PanBias = 0.0;
+  if( MatchMeanStd ) {
+    double meanI,M2_II,M2_kI[4];
+    IntensityMoments( Stats,N_bands,Weights,&meanI,&M2_II,M2_kI );
+    MatchPanMeanStd( Stats,N_bands,meanI,M2_II,&PanGain,&PanBias );
+  }
+  SharpenParams Params;
+  for( int band=0; band<4; band++ ) {
+    Params.Weights[band] = band<N_bands ? (float)Weights[band] : 0.0f;
+    Params.Gains[band]   = band<N_bands ? 1.0f : 0.0f;
+  }
+  Params.PanGain = (float)PanGain;
+  Params.PanBias = (float)PanBias;
+  return Params;
+}
+
+bool HistogramMatchTable( std::vector<float>& PanSamples,std::vector<float>& IntensitySamples,
+  PanMatchTable* Table ) {
+  /* *************************************************************************
+   * bool HistogramMatchTable( std::vector<float>&,std::vector<float>&,
+   *   PanMatchTable* ):
+   *
+   * This function builds the histogram matching table that maps the
+   * distribution of the pan samples onto the distribution of the 
+   * intensity samples: the q-th quantile of the pan samples maps onto
+   * the q-th quantile of the intensity samples (N_QUANTILES quantiles,
+   * linear in between), tabulated on TABLE_SIZE uniform steps from the
+   * smallest to the largest pan sample. Runs of equal pan quantiles 
+   * (e.g. integer imagery) map onto the mean of their intensity 
+   * quantiles. The samples are sorted in place.
+   *
+   * Args:
+   *   std::vector<float>& : pan samples.
+   *   std::vector<float>& : intensity samples (the same number).
+   *   PanMatchTable* : histogram matching table.
+   * Returns:
+   *   bool : false if there are too few samples, or the pan samples are
+   *          all equal (no table).
+   */
+  const int N_QUANTILES = 1024;
+  const int TABLE_SIZE  = 4096;
+  size_t n = PanSamples.size();
+  if( n<2 || IntensitySamples.size() != n ) return false;
+  std::sort( PanSamples.begin(),PanSamples.end() );
+  std::sort( IntensitySamples.begin(),IntensitySamples.end() );
+  double Min = PanSamples.front(),Max = PanSamples.back();
+  if( !( Max>Min ) ) return false;
+
+  // knots of the mapping: one per distinct pan quantile
+  // ***************************************************
+  std::vector<double> PanKnots,IntensityKnots;
+  int q = 0;
+  while( q<=N_QUANTILES ) {
+    double pan = PanSamples[ (size_t)( (double)q*(double)( n-1 )/N_QUANTILES ) ];
+    double sum = 0.0;
+    int count  = 0;
+    while( q<=N_QUANTILES ) {
+      size_t index = (size_t)( (double)q*(double)( n-1 )/N_QUANTILES );
+      if( PanSamples[index] != pan ) break;
+      sum += IntensitySamples[index];
+      count++;
+      q++;
+    }
+    PanKnots.push_back( pan );
+    IntensityKnots.push_back( sum/count );
+  }
+
+  // walk up the knots along the uniform grid of pan values
+  // ******************************************************
+  Table->Min     = (float)Min;
+  Table->InvStep = (float)( TABLE_SIZE/( Max-Min ) );
+  Table->Values.resize( TABLE_SIZE+1 );
+  size_t k = 0;
+  for( int i=0; i<=TABLE_SIZE; i++ ) {
+    double x = Min+( Max-Min )*i/TABLE_SIZE;
+    while( k+2<PanKnots.size() && PanKnots[k+1]<=x ) k++;
+    double f = ( x-PanKnots[k] )/( PanKnots[k+1]-PanKnots[k] );
+    f = f<0.0 ? 0.0 : ( f>1.0 ? 1.0 : f );
+    Table->Values[i] = (float)( IntensityKnots[k]+f*( IntensityKnots[k+1]-IntensityKnots[k] ) );
+  }
+  return true;
+}
@@ -0,0 +1,195 @@
+#ifndef STATISTICS_H_
+#define STATISTICS_H_
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "Kernels.h"
+
+// define C++ structure holding streaming statistics (number of pixels,
+// means, and co-moments, i.e. sums of products of deviations from the
+// means) of the multispectral bands and the panchromatic band. Variable
+// v<N_bands is multispectral band v, and variable N_bands is the pan
+// band. Two sets of statistics are combined with MergeStatistics().
+// *********************************************************************
+const int MAX_STAT_VARS = 5;
+struct BandStatistics {
+  int NV       = 0;   // number of variables (N_bands+1)
+  double Count = 0.0; // number of pixels
+  double Mean[ MAX_STAT_VARS ] = { 0.0 };
+  double M2[ MAX_STAT_VARS ][ MAX_STAT_VARS ] = { { 0.0 } };
+};
+
+// define C++ structure holding a monotone, piecewise-linear mapping of
+// pan values onto intensity values (histogram matching), tabulated on
+// a uniform grid of pan values: Values[i] is the matched value of pan
+// value Min+i/InvStep. Pan values outside of the grid are clamped.
+// *********************************************************************
+struct PanMatchTable {
+  float Min     = 0.0f;
+  float InvStep = 0.0f;
+  std::vector<float> Values;
+};
+
+// define function prototypes
+// **************************
+void MergeStatistics( BandStatistics&,BandStatistics const& );
+SharpenParams ComponentSubstitutionParams( int,BandStatistics const&,int );
+SharpenParams IntensityParams( BandStatistics const&,int,const double*,bool );
+bool HistogramMatchTable( std::vector<float>&,std::vector<float>&,PanMatchTable* );
+
+template<typename P,typename T>
+inline bool ValidStatisticsPixel( const P* pan,const T* const* ms,size_t px,int N_bands,
+  double NoDataValue,double* x ) {
+  /* *************************************************************************
+   * bool ValidStatisticsPixel<P,T>( const P*,const T* const*,size_t,int,
+   *   double,double* ):
+   *
+   * This function gets the multispectral values (x[0..N_bands-1]) and the
+   * panchromatic value (x[N_bands]) of a pixel, and tells whether the pixel
+   * counts towards band statistics: the panchromatic value must not be 
+   * less than zero or equal to the NoData value, and all values must be 
+   * finite.
+   *
+   * Returns:
+   *   bool : true if the pixel counts towards the statistics.
+   */
+  x[N_bands] = (double)pan[px];
+  if( !(x[N_bands]>=0.0) || x[N_bands] == NoDataValue ) return false;
+  bool finite = std::isfinite( x[N_bands] );
+  for( int band=0; band<N_bands; band++ ) {
+    x[band] = (double)ms[band][px];
+    finite  = finite && std::isfinite( x[band] );
+  }
+  return finite;
+}
+
+template<typename P,typename T>
+inline void AccumulateStatistics( BandStatistics& Stats,const P* pan,const T* const* ms,
+  size_t nPixels,int N_bands,double NoDataValue ) {
+  /* *************************************************************************
+   * void AccumulateStatistics<P,T>( BandStatistics&,const P*,const T* const*,
+   *   size_t,int,double ):
+   *
+   * This function adds nPixels pixels of the panchromatic band and the
+   * (resampled) multispectral bands to a set of statistics. Pixels where
+   * the panchromatic value is less than zero or equal to the NoData value,
+   * or where any value is not finite, are skipped. Pixels are taken in
+   * runs of STAT_RUN: each run is summed in double precision relative to
+   * its first pixel (shifted data, which avoids cancellation), and the
+   * runs are merged one after the other (Chan et al.). The result only
+   * depends on the pixels and their order.
+   *
+   * Args:
+   *   BandStatistics& : statistics to add the pixels to.
+   *   const P* : panchromatic pixels.
+   *   const T* const* : multispectral pixels (N_bands bands).
+   *   size_t : number of pixels.
+   *   int : number of multispectral bands (3 or 4).
+   *   double : NoData value of the panchromatic band.
+   * Returns:
+   *   None. Void.
+   */
+  const size_t STAT_RUN = 4096;
+  int NV = N_bands+1;
+  Stats.NV = NV;
+  for( size_t first=0; first<nPixels; first+=STAT_RUN ) {
+    size_t last = first+STAT_RUN<nPixels ? first+STAT_RUN : nPixels;
+    double Shift[ MAX_STAT_VARS ],Sum[ MAX_STAT_VARS ] = { 0.0 };
+    double Prod[ MAX_STAT_VARS ][ MAX_STAT_VARS ] = { { 0.0 } };
+    double n = 0.0;
+    for( size_t px=first; px<last; px++ ) {
+      double x[ MAX_STAT_VARS ];
+      if( !ValidStatisticsPixel( pan,ms,px,N_bands,NoDataValue,x ) ) continue;
+
+      if( n == 0.0 ) {
+        for( int v=0; v<NV; v++ ) Shift[v] = x[v];
+      }
+      double d[ MAX_STAT_VARS ];
+      for( int v=0; v<NV; v++ ) {
+        d[v]    = x[v]-Shift[v];
+        Sum[v] += d[v];
+        for( int w=0; w<=v; w++ ) Prod[v][w] += d[v]*d[w];
+      }
+      n += 1.0;
+    }
+    if( n == 0.0 ) continue;
+
+    // means and co-moments of this run
+    // ********************************
+    BandStatistics Run;
+    Run.NV    = NV;
+    Run.Count = n;
+    for( int v=0; v<NV; v++ ) {
+      Run.Mean[v] = Shift[v]+Sum[v]/n;
+      for( int w=0; w<=v; w++ ) {
+        Run.M2[v][w] = Prod[v][w]-Sum[v]*Sum[w]/n;
+        Run.M2[w][v] = Run.M2[v][w];
+      }
+    }
+    MergeStatistics( Stats,Run );
+  }
+}
+
+template<typename P,typename T>
+inline void CollectSamples( std::vector<float>& PanSamples,std::vector<float>& IntensitySamples,
+  const P* pan,const T* const* ms,size_t nPixels,int N_bands,double NoDataValue,
+  const double* Weights,size_t Step ) {
+  /* *************************************************************************
+   * void CollectSamples<P,T>( std::vector<float>&,std::vector<float>&,
+   *   const P*,const T* const*,size_t,int,double,const double*,size_t ):
+   *
+   * This function appends the panchromatic value and the intensity value
+   * ( sum_j Weights[j]*band_j ) of every Step-th pixel that counts towards
+   * band statistics to two lists of samples (for histogram matching).
+   *
+   * Args:
+   *   std::vector<float>& : panchromatic samples.
+   *   std::vector<float>& : intensity samples.
+   *   const P* : panchromatic pixels.
+   *   const T* const* : multispectral pixels (N_bands bands).
+   *   size_t : number of pixels.
+   *   int : number of multispectral bands (3 or 4).
+   *   double : NoData value of the panchromatic band.
+   *   const double* : intensity weights (N_bands weights).
+   *   size_t : distance between sampled pixels.
+   * Returns:
+   *   None. Void.
+   */
+  for( size_t px=0; px<nPixels; px+=Step ) {
+    double x[ MAX_STAT_VARS ];
+    if( !ValidStatisticsPixel( pan,ms,px,N_bands,NoDataValue,x ) ) continue;
+    double I = 0.0;
+    for( int band=0; band<N_bands; band++ ) I += Weights[band]*x[band];
+    PanSamples.push_back( (float)x[N_bands] );
+    IntensitySamples.push_back( (float)I );
+  }
+}
+
+template<typename T>
+inline void ApplyPanMatch( PanMatchTable const& Table,const T* pan,size_t nPixels,float* out ) {
+  /* *************************************************************************
+   * void ApplyPanMatch<T>( PanMatchTable const&,const T*,size_t,float* ):
+   *
+   * This function maps panchromatic pixels onto intensity values through
+   * a histogram matching table (linear interpolation between entries).
+   *
+   * Args:
+   *   PanMatchTable const& : histogram matching table.
+   *   const T* : panchromatic pixels.
+   *   size_t : number of pixels.
+   *   float* : matched pixels.
+   * Returns:
+   *   None. Void.
+   */
+  const float last = (float)( Table.Values.size()-1 );
+  const float *V   = Table.Values.data();
+  for( size_t px=0; px<nPixels; px++ ) {
+    float t = ( (float)pan[px]-Table.Min )*Table.InvStep;
+    t = t>0.0f ? ( t<last ? t : last ) : 0.0f; // clamp (and NaN -> 0)
+    int i = (int)t;
+    if( i>(int)last-1 ) i = (int)last-1;
+    float f = t-(float)i;
+    out[px] = V[i]+f*( V[i+1]-V[i] );
+  }
+}
+#endif
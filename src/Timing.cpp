@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <cstring>
+#include "Memory.h"
+#include "Timing.h"
+
+// names of the stages in the report, in the order of TimingStage
+// **************************************************************
+const char* TIMING_STAGE_NAMES[ N_STAGES ] = {
+  "open","check_types","resample","preview","create","statistics","pan_match",
+  "read","compute","write","close","wait" };
+
+static std::string JsonString( std::string const& Text ) {
+  /* *************************************************************************
+   * std::string JsonString( std::string const& ):
+   *
+   * This function quotes and escapes a string for a JSON document.
+   *
+   * Args:
+   *   std::string const& : text (e.g. a file name or an error message).
+   * Returns:
+   *   std::string : JSON string, with quotes.
+   */
+  std::string Quoted = "\"";
+  for( unsigned char c : Text ) {
+    if( c == '"' || c == '\\' ) {
+      Quoted += '\\';
+      Quoted += (char)c;
+    } else if( c<0x20 ) {
+      char Escape[8];
+      snprintf( Escape,sizeof(Escape),"\\u%04x",c );
+      Quoted += Escape;
+    } else {
+      Quoted += (char)c;
+    }
+  }
+  return Quoted+"\"";
+}
+
+static std::string JsonStages( StageCounters const* Stages,std::string const& Indent ) {
+  /* *************************************************************************
+   * std::string JsonStages( StageCounters const*,std::string const& ):
+   *
+   * This function formats the counters of the stages that ran as a JSON
+   * object keyed by stage name, with the throughput of each stage per
+   * second of its wall time (summed over threads, i.e. per busy thread).
+   *
+   * Args:
+   *   StageCounters const* : counters of the N_STAGES stages.
+   *   std::string const& : indentation of the object's members.
+   * Returns:
+   *   std::string : JSON object.
+   */
+  std::string Json = "{";
+  const char* Separator = "\n";
+  for( int stage=0; stage<N_STAGES; stage++ ) {
+    StageCounters const& S = Stages[stage];
+    if( S.Calls == 0 ) continue;
+    double Wall = S.WallTime>0.0 ? S.WallTime : 1e-9;
+    char Line[512];
+    snprintf( Line,sizeof(Line),"%s%s\"%s\": { \"calls\": %llu, \"wall_seconds\": %.6f, "
+      "\"cpu_seconds\": %.6f, \"bytes_read\": %llu, \"bytes_written\": %llu, \"pixels\": %llu, "
+      "\"mpix_per_s\": %.3f, \"read_mb_per_s\": %.3f, \"write_mb_per_s\": %.3f }",
+      Separator,Indent.c_str(),TIMING_STAGE_NAMES[stage],(unsigned long long)S.Calls,
+      S.WallTime,S.CpuTime,(unsigned long long)S.BytesRead,(unsigned long long)S.BytesWritten,
+      (unsigned long long)S.Pixels,S.Pixels/Wall/1e6,S.BytesRead/Wall/1048576.0,
+      S.BytesWritten/Wall/1048576.0 );
+    Json += Line;
+    Separator = ",\n";
+  }
+  return Json+"\n"+Indent.substr( 0,Indent.size()>=2 ? Indent.size()-2 : 0 )+"}";
+}
+
+SceneTiming::SceneTiming() {
+  /* *************************************************************************
+   * SceneTiming::SceneTiming():
+   *
+   * This constructor starts the wall clock of the scene.
+   */
+  Start = std::chrono::steady_clock::now();
+}
+
+ThreadTiming* SceneTiming::Thread( const char* Role,int Index ) {
+  /* *************************************************************************
+   * ThreadTiming* SceneTiming::Thread( const char*,int ):
+   *
+   * This function returns the counters of a thread of the scene (e.g.
+   * "reader",2), creating them the first time. A thread should get its
+   * counters once, before its hot loop.
+   *
+   * Args:
+   *   const char* : role of the thread (main, reader, compute, writer).
+   *   int : index of the thread within its role (e.g. the method of a
+   *         writer).
+   * Returns:
+   *   ThreadTiming* : counters of the thread.
+   */
+  std::lock_guard<std::mutex> Guard( Lock );
+  for( ThreadTiming& Thread : Threads ) {
+    if( Thread.Role == Role && Thread.Index == Index ) return &Thread;
+  }
+  Threads.emplace_back();
+  Threads.back().Role  = Role;
+  Threads.back().Index = Index;
+  return &Threads.back();
+}
+
+void SceneTiming::Finish( std::string const& Message ) {
+  /* *************************************************************************
+   * void SceneTiming::Finish( std::string const& ):
+   *
+   * This function stops the wall clock of the scene and records its
+   * outcome.
+   *
+   * Args:
+   *   std::string const& : error message, or "" if the scene succeeded.
+   * Returns:
+   *   None. Void.
+   */
+  WallTime = std::chrono::duration<double>( std::chrono::steady_clock::now()-Start ).count();
+  Error    = Message;
+}
+
+std::string SceneTiming::Json( const char* Indent ) const {
+  /* *************************************************************************
+   * std::string SceneTiming::Json( const char* ) const:
+   *
+   * This function formats the timing of the scene as a JSON object: its
+   * outcome and wall time, the counters of each stage summed over the
+   * threads ("stages"), and the counters of each thread ("threads").
+   *
+   * Args:
+   *   const char* : indentation of the object.
+   * Returns:
+   *   std::string : JSON object.
+   */
+  std::lock_guard<std::mutex> Guard( Lock );
+  std::string In  = Indent;
+  std::string In2 = In+"  ";
+  StageCounters Totals[ N_STAGES ];
+  for( ThreadTiming const& Thread : Threads ) {
+    for( int stage=0; stage<N_STAGES; stage++ ) {
+      StageCounters const& S = Thread.Stages[stage];
+      Totals[stage].Calls        += S.Calls;
+      Totals[stage].WallTime     += S.WallTime;
+      Totals[stage].CpuTime      += S.CpuTime;
+      Totals[stage].BytesRead    += S.BytesRead;
+      Totals[stage].BytesWritten += S.BytesWritten;
+      Totals[stage].Pixels       += S.Pixels;
+    }
+  }
+
+  char Numbers[256];
+  snprintf( Numbers,sizeof(Numbers),"%s\"wall_seconds\": %.6f,\n%s\"pixels\": %llu,\n"
+    "%s\"mpix_per_s\": %.3f,\n%s\"pipeline_threads\": %d,\n",In2.c_str(),WallTime,In2.c_str(),
+    (unsigned long long)Pixels,In2.c_str(),WallTime>0.0 ? Pixels/WallTime/1e6 : 0.0,
+    In2.c_str(),PipelineThreads );
+  std::string Json = In+"{\n";
+  Json += In2+"\"pan\": "+JsonString( Pan )+",\n";
+  Json += In2+"\"output\": "+JsonString( Output )+",\n";
+  Json += In2+"\"status\": "+( Error.empty() ? "\"ok\"" : "\"failed\"" )+",\n";
+  if( !Error.empty() ) Json += In2+"\"error\": "+JsonString( Error )+",\n";
+  Json += Numbers;
+  Json += In2+"\"stages\": "+JsonStages( Totals,In2+"  " )+",\n";
+  Json += In2+"\"threads\": [";
+  const char* Separator = "\n";
+  for( ThreadTiming const& Thread : Threads ) {
+    Json += Separator+In2+"  { \"role\": "+JsonString( Thread.Role )+", \"index\": "+
+      std::to_string( Thread.Index )+", \"stages\": "+JsonStages( Thread.Stages,In2+"      " )+" }";
+    Separator = ",\n";
+  }
+  return Json+"\n"+In2+"]\n"+In+"}";
+}
+
+bool WriteTimingReport( const char* Filename,std::vector<SceneTiming*> const& Scenes,
+  int Threads,double WallTime ) {
+  /* *************************************************************************
+   * bool WriteTimingReport( const char*,std::vector<SceneTiming*> const&,
+   *   int,double ):
+   *
+   * This function writes the timing report of a run (--stats-json flag):
+   * a JSON document with the threads and wall time of the run, its peak
+   * resident memory, and the timing of each scene (see SceneTiming::Json()).
+   *
+   * Args:
+   *   const char* : name of the report file.
+   *   std::vector<SceneTiming*> const& : timing of each scene.
+   *   int : number of threads of the run (-j flag).
+   *   double : wall time of the run, in seconds.
+   * Returns:
+   *   bool : true if the report was written, false otherwise.
+   */
+  FILE* File = fopen( Filename,"w" );
+  if( File == nullptr ) return false;
+  fprintf( File,"{\n  \"threads\": %d,\n  \"wall_seconds\": %.6f,\n  \"peak_rss_bytes\": %zu,\n"
+    "  \"scenes\": [",Threads,WallTime,PeakResidentMemory() );
+  const char* Separator = "\n";
+  for( SceneTiming const* Scene : Scenes ) {
+    fprintf( File,"%s%s",Separator,Scene->Json( "    " ).c_str() );
+    Separator = ",\n";
+  }
+  fprintf( File,"\n  ]\n}\n" );
+  return fclose( File ) == 0;
+}
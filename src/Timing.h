@@ -0,0 +1,141 @@
+#ifndef TIMING_H_
+#define TIMING_H_
+#include <time.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// define the stages of a run that are timed (--stats-json flag):
+//   open          opening the input imagery (each reader its own datasets)
+//   check_types   checking the data types of the imagery (see PIXEL_TYPE_PAIRS)
+//   resample      resampling to *_resampled.tif files (--resample-to-disk)
+//   preview       reading the imagery at reduced resolution (--preview)
+//   create        creating the outputs
+//   statistics    accumulating band statistics (Gram-Schmidt, PCA)
+//   pan_match     sampling the pan-matching pre-pass (--pan-match)
+//   read          reading (decoding, resampling) windows of the imagery
+//   compute       running the kernels on windows
+//   write         writing (encoding) windows of the outputs
+//   close         closing (flushing) the outputs
+//   wait          blocked on a queue of the pipeline (empty or full)
+// **************************************************************************
+enum TimingStage {
+  STAGE_OPEN = 0,
+  STAGE_CHECK_TYPES,
+  STAGE_RESAMPLE,
+  STAGE_PREVIEW,
+  STAGE_CREATE,
+  STAGE_STATISTICS,
+  STAGE_PAN_MATCH,
+  STAGE_READ,
+  STAGE_COMPUTE,
+  STAGE_WRITE,
+  STAGE_CLOSE,
+  STAGE_WAIT,
+  N_STAGES
+};
+extern const char* TIMING_STAGE_NAMES[ N_STAGES ];
+
+// define C++ structure holding what one thread spent in one stage: wall
+// and CPU time, bytes read and written, and pixels processed (of the
+// panchromatic grid)
+// **********************************************************************
+struct StageCounters {
+  uint64_t Calls   = 0;
+  double WallTime  = 0.0; // seconds
+  double CpuTime   = 0.0; // seconds
+  uint64_t BytesRead    = 0;
+  uint64_t BytesWritten = 0;
+  uint64_t Pixels       = 0;
+};
+
+// define C++ structure holding the counters of one thread of a run (e.g.
+// reader 2, or the writer of the FIHS output). Only that thread updates
+// them, so no locking is needed on the hot path.
+// **********************************************************************
+struct ThreadTiming {
+  std::string Role;
+  int Index;
+  StageCounters Stages[ N_STAGES ];
+};
+
+// define C++ class holding the timing of one scene: the counters of each
+// thread that worked on it, and the outcome of the scene. Threads get
+// their counters once (Thread()), then update them without locking.
+// ***********************************************************************
+class SceneTiming {
+  private:
+    mutable std::mutex Lock;
+    std::deque<ThreadTiming> Threads; // addresses stay valid as it grows
+    std::chrono::steady_clock::time_point Start;
+  public:
+    std::string Pan;      // panchromatic image of the scene
+    std::string Output;   // output directory
+    std::string Error;    // error message, if the scene failed
+    double WallTime = 0.0;
+    uint64_t Pixels = 0;  // pixels of the panchromatic grid
+    int PipelineThreads = 0; // reader (and compute) threads of the pipeline
+    SceneTiming();
+    ThreadTiming* Thread( const char*,int );
+    void Finish( std::string const& );
+    std::string Json( const char* ) const;
+};
+
+static inline double ThreadCpuTime() {
+  /* *************************************************************************
+   * double ThreadCpuTime():
+   *
+   * This function returns the CPU time consumed by the calling thread.
+   *
+   * Args:
+   *   None.
+   * Returns:
+   *   double : CPU time in seconds.
+   */
+  struct timespec Now;
+  clock_gettime( CLOCK_THREAD_CPUTIME_ID,&Now );
+  return (double)Now.tv_sec+1e-9*(double)Now.tv_nsec;
+}
+
+// define C++ class timing one stage of one thread from its construction
+// to its destruction (scope) or to Stop(), and counting what was 
+// processed. With no thread counters (timing off) it does nothing, 
+// without reading clocks.
+// *********************************************************************
+class StageTimer {
+  private:
+    StageCounters *Counters;
+    std::chrono::steady_clock::time_point WallStart;
+    double CpuStart = 0.0;
+  public:
+    StageTimer( ThreadTiming* Thread,int Stage ) :
+      Counters( Thread ? &Thread->Stages[Stage] : nullptr ) {
+      if( Counters == nullptr ) return;
+      WallStart = std::chrono::steady_clock::now();
+      CpuStart  = ThreadCpuTime();
+    }
+    ~StageTimer() {
+      Stop();
+    }
+    void Stop() {
+      if( Counters == nullptr ) return;
+      Counters->Calls++;
+      Counters->WallTime += std::chrono::duration<double>( std::chrono::steady_clock::now()-WallStart ).count();
+      Counters->CpuTime  += ThreadCpuTime()-CpuStart;
+      Counters = nullptr;
+    }
+    void Count( uint64_t Pixels,uint64_t BytesRead,uint64_t BytesWritten ) {
+      if( Counters == nullptr ) return;
+      Counters->Pixels       += Pixels;
+      Counters->BytesRead    += BytesRead;
+      Counters->BytesWritten += BytesWritten;
+    }
+};
+
+// define function prototypes
+// **************************
+bool WriteTimingReport( const char*,std::vector<SceneTiming*> const&,int,double );
+#endif
@@ -0,0 +1,369 @@
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include "gdal_priv.h"
+#include "ogr_spatialref.h"
+#include "Saturate.h"
+#include "Upsampler.h"
+
+// largest ratio of low-res to high-res pixel size for the fused upsampler
+// ***********************************************************************
+static const int MAX_RATIO = 16;
+
+// floor of integer division (rounds towards negative infinity)
+// ************************************************************
+static inline int FloorDiv( int a,int b ) {
+  int q = a/b;
+  if( (a%b != 0) && ((a<0) != (b<0)) ) q--;
+  return q;
+}
+
+// bicubic convolution kernel of Keys (a = -0.5), as used by GDAL's GRA_Cubic
+// **************************************************************************
+static double CubicKernel( double x ) {
+  const double a = -0.5;
+  x = std::fabs( x );
+  if( x<=1.0 ) {
+    return ( (a+2.0)*x - (a+3.0) )*x*x + 1.0;
+  } else if( x<2.0 ) {
+    return ( ( a*x - 5.0*a )*x + 8.0*a )*x - 4.0*a;
+  }
+  return 0.0;
+}
+
+bool IntegerRatioAlignment( GDALDatasetH msDataset,GDALDatasetH panDataset,GridAlignment* Grid ) {
+  /* *************************************************************************
+   * bool IntegerRatioAlignment( GDALDatasetH,GDALDatasetH,GridAlignment* ):
+   *
+   * This function checks whether a low-resolution (multispectral) Geotiff can be upsampled to the grid of a high-resolution (panchromatic)
+   * Geotiff with the fused bicubic upsampler (BicubicUpsampler) instead of
+   * the generic GDAL warper. This is the case when:
+   *   (1) both have the same projection and no rotation terms,
+   *   (2) the low-res pixel size is an exact integer multiple of the pan
+   *       pixel size, with the same ratio along both axes,
+   *   (3) the pan grid origin falls on a pan-pixel boundary of the low-res
+   *       grid (i.e. the grids are aligned), and the pan extent lies 
+   *       inside of the low-res extent, and
+   *   (4) the low-res bands have no NoData value (NoData pixels are skipped
+   *       by the generic warper, which the fused upsampler does not do).
+   *
+   * Args:
+   *   GDALDatasetH : opened low-resolution Geotiff dataset.
+   *   GDALDatasetH : opened high-resolution 1-band Geotiff dataset.
+   *   GridAlignment* : output, alignment of the two grids (if aligned).
+   * Returns:
+   *   bool : true if the fused upsampler can be used, false otherwise.
+   */
+  double msGT[6],panGT[6];
+  if( GDALGetGeoTransform( msDataset,msGT ) != CE_None ||
+      GDALGetGeoTransform( panDataset,panGT ) != CE_None ) {
+    return false;
+  }
+
+  // (1) same projection, no rotation
+  // ********************************
+  if( msGT[2] != 0.0 || msGT[4] != 0.0 || panGT[2] != 0.0 || panGT[4] != 0.0 ) {
+    return false;
+  }
+  const char* msWKT  = GDALGetProjectionRef( msDataset  );
+  const char* panWKT = GDALGetProjectionRef( panDataset );
+  if( strcmp( msWKT,panWKT ) != 0 ) {
+    if( strlen( msWKT ) == 0 || strlen( panWKT ) == 0 ) return false;
+    OGRSpatialReference msSRS( msWKT );
+    OGRSpatialReference panSRS( panWKT );
+    if( !msSRS.IsSame( &panSRS ) ) return false;
+  }
+
+  // (2) integer ratio of pixel sizes, the same along both axes
+  // **********************************************************
+  if( panGT[1] == 0.0 || panGT[5] == 0.0 ) return false;
+  double ratioX = msGT[1]/panGT[1];
+  double ratioY = msGT[5]/panGT[5];
+  int ratio = (int)std::lround( ratioX );
+  if( ratio<1 || ratio>MAX_RATIO ) return false;
+  if( std::fabs( ratioX-ratio )>1e-6*ratio || std::fabs( ratioY-ratio )>1e-6*ratio ) {
+    return false;
+  }
+
+  // (3) aligned origins, pan extent inside of the low-res extent
+  // ************************************************************
+  double offX = ( panGT[0]-msGT[0] )/panGT[1];
+  double offY = ( panGT[3]-msGT[3] )/panGT[5];
+  int iOffX = (int)std::lround( offX );
+  int iOffY = (int)std::lround( offY );
+  if( std::fabs( offX-iOffX )>1e-3 || std::fabs( offY-iOffY )>1e-3 ) return false;
+  if( iOffX<0 || iOffY<0 ) return false;
+  if( (long)iOffX+GDALGetRasterXSize( panDataset )>(long)ratio*GDALGetRasterXSize( msDataset ) ||
+      (long)iOffY+GDALGetRasterYSize( panDataset )>(long)ratio*GDALGetRasterYSize( msDataset ) ) {
+    return false;
+  }
+
+  // (4) no NoData value on the low-res bands
+  // ****************************************
+  for( int band=1; band<=GDALGetRasterCount( msDataset ); band++ ) {
+    int bGotNoData = FALSE;
+    GDALGetRasterNoDataValue( GDALGetRasterBand( msDataset,band ),&bGotNoData );
+    if( bGotNoData ) return false;
+  }
+
+  Grid->Ratio = ratio;
+  Grid->OffX  = iOffX;
+  Grid->OffY  = iOffY;
+  return true;
+}
+
+// constructor that takes in the low-resolution band and grid alignment
+// ********************************************************************
+template<typename T>
+BicubicUpsampler<T>::BicubicUpsampler( GDALRasterBand* LowBand,GridAlignment Alignment ) :
+  BicubicUpsampler( LowBand->GetDataset(),1,nullptr,Alignment ) {
+  Bands[0] = LowBand->GetBand();
+}
+
+// constructor that takes in the low-resolution image, the number of
+// its bands that are upsampled and their numbers (1-based; nullptr for
+// bands 1 to N), and the grid alignment
+// ********************************************************************
+template<typename T>
+BicubicUpsampler<T>::BicubicUpsampler( GDALDataset* LowDataset,int N,const int* BandMap,
+  GridAlignment Alignment ) {
+  Dataset = LowDataset;
+  NBands  = N;
+  for( int band=0; band<N; band++ ) Bands.push_back( BandMap ? BandMap[band] : band+1 );
+  Grid    = Alignment;
+  LowCols = Dataset->GetRasterXSize();
+  LowRows = Dataset->GetRasterYSize();
+
+  // the center of pan pixel p (absolute, p = Off+column) lies at low-res
+  // coordinate u = (p+0.5)/Ratio-0.5. Its integer part and its fraction
+  // (and thus the 4 bicubic weights) only depend on p mod Ratio.
+  // ********************************************************************
+  int k = Grid.Ratio;
+  Weights.resize( 4*k );
+  Fraction.resize( k );
+  for( int phase=0; phase<k; phase++ ) {
+    int num     = 2*phase+1-k;
+    int base    = FloorDiv( num,2*k );
+    double frac = (double)( num-base*2*k )/(double)( 2*k );
+    Fraction[phase] = frac;
+    Weights[4*phase+0] = CubicKernel( 1.0+frac );
+    Weights[4*phase+1] = CubicKernel( frac     );
+    Weights[4*phase+2] = CubicKernel( 1.0-frac );
+    Weights[4*phase+3] = CubicKernel( 2.0-frac );
+  }
+
+  RingXOff  = -1;
+  RingXSize = 0;
+  RingCol0  = 0;
+  RingNCols = 0;
+  for( int slot=0; slot<4; slot++ ) RingRow[slot] = INT_MIN;
+}
+
+// first of the 4 low-res taps (row or column) for absolute pan index p
+// ********************************************************************
+static inline int FirstTap( int p,int k ) {
+  int m     = FloorDiv( p,k );
+  int phase = p-m*k;
+  return FloorDiv( 2*phase+1-k,2*k )+m-1;
+}
+
+template<typename T>
+CPLErr BicubicUpsampler<T>::LoadRow( int lowRow,int slot ) {
+  /* *************************************************************************
+   * CPLErr BicubicUpsampler<T>::LoadRow( int,int ):
+   *
+   * This function reads one low-resolution row of every band (clamped to
+   * the image) and upsamples it horizontally to the columns of the current
+   * window, into the given slot of the ring. (Taps outside of the image 
+   * replicate its edge; they only make up values of border pixels, which
+   * are computed by Bilinear() instead.)
+   *
+   * Args:
+   *   int : low-resolution row (may lie outside of the band by 1 or 2).
+   *   int : ring slot (0 to 3).
+   * Returns:
+   *   CPLErr : CE_None on success, error of RasterIO() otherwise.
+   */
+  int row = lowRow<0 ? 0 : ( lowRow>=LowRows ? LowRows-1 : lowRow );
+  double *LowRow = LowRing.data()+(size_t)slot*NBands*RingNCols;
+  CPLErr eErr = Dataset->RasterIO( GF_Read,RingCol0,row,RingNCols,1,
+    LowRow,RingNCols,1,GDT_Float64,NBands,Bands.data(),0,0,
+    (GSpacing)sizeof(double)*RingNCols );
+  if( eErr != CE_None ) return eErr;
+
+  for( int band=0; band<NBands; band++ ) {
+    const double *in = LowRow+(size_t)band*RingNCols;
+    double *out = Ring.data()+( (size_t)slot*NBands+band )*RingXSize;
+    for( int col=0; col<RingXSize; col++ ) {
+      const double *w = &Weights[4*Phase[col]];
+      double value = 0.0;
+      for( int tap=0; tap<4; tap++ ) {
+        int lowCol = TapCol[col]+tap;
+        lowCol = lowCol<0 ? 0 : ( lowCol>=LowCols ? LowCols-1 : lowCol );
+        value += w[tap]*in[lowCol-RingCol0];
+      }
+      out[col] = value;
+    }
+  }
+  RingRow[slot] = lowRow;
+  return CE_None;
+}
+
+template<typename T>
+double BicubicUpsampler<T>::Bilinear( int band,int col,int tap0,int phase,int slot1,int slot2 ) const {
+  /* *************************************************************************
+   * double BicubicUpsampler<T>::Bilinear( int,int,int,int,int,int ):
+   *
+   * This function computes one border pixel (whose 4x4 bicubic taps leave
+   * the low-resolution image) the way GDAL's cubic warp kernel does: 
+   * bilinear over the 2x2 taps around it, leaving out those outside of the
+   * image and renormalizing the weights of the others.
+   *
+   * Args:
+   *   int : band (index into the bands of the upsampler).
+   *   int : column of the current window.
+   *   int : first of the 4 bicubic taps (low-res row) of the pan row.
+   *   int : phase of the pan row.
+   *   int : ring slot of low-res row tap0+1 (upper bilinear row).
+   *   int : ring slot of low-res row tap0+2 (lower bilinear row).
+   * Returns:
+   *   double : upsampled value (0 if no tap lies inside of the image).
+   */
+  int x0 = TapCol[col]+1;
+  int y0 = tap0+1;
+  double RatioX = 1.0-Fraction[Phase[col]];
+  double RatioY = 1.0-Fraction[phase];
+  bool InX0 = x0>=0 && x0<LowCols;
+  bool InX1 = x0+1>=0 && x0+1<LowCols;
+  bool InY0 = y0>=0 && y0<LowRows;
+  bool InY1 = y0+1>=0 && y0+1<LowRows;
+  const double *Upper = LowRing.data()+( (size_t)slot1*NBands+band )*RingNCols;
+  const double *Lower = LowRing.data()+( (size_t)slot2*NBands+band )*RingNCols;
+  int c0 = x0-RingCol0; // column x0 in the ring rows
+
+  // upper left, upper right, lower right, and lower left taps, in the
+  // order of GDAL's GWKBilinearResample4Sample()
+  // *****************************************************************
+  double Accumulator = 0.0,Divisor = 0.0;
+  if( InX0 && InY0 ) {
+    double Mult  = RatioX*RatioY;
+    Divisor     += Mult;
+    Accumulator += Upper[c0]*Mult;
+  }
+  if( InX1 && InY0 ) {
+    double Mult  = ( 1.0-RatioX )*RatioY;
+    Divisor     += Mult;
+    Accumulator += Upper[c0+1]*Mult;
+  }
+  if( InX1 && InY1 ) {
+    double Mult  = ( 1.0-RatioX )*( 1.0-RatioY );
+    Divisor     += Mult;
+    Accumulator += Lower[c0+1]*Mult;
+  }
+  if( InX0 && InY1 ) {
+    double Mult  = RatioX*( 1.0-RatioY );
+    Divisor     += Mult;
+    Accumulator += Lower[c0]*Mult;
+  }
+  if( Divisor == 1.0 ) return Accumulator;
+  if( Divisor<0.00001 ) return 0.0;
+  return Accumulator/Divisor;
+}
+
+template<typename T>
+CPLErr BicubicUpsampler<T>::ReadWindow( Window const& win,T* out ) {
+  // one window of a single-band upsampler (see below)
+  return ReadWindow( win,&out );
+}
+
+template<typename T>
+CPLErr BicubicUpsampler<T>::ReadWindow( Window const& win,T* const* out ) {
+  /* *************************************************************************
+   * CPLErr BicubicUpsampler<T>::ReadWindow( Window const&,T* const* ):
+   *
+   * This function produces one window of the low-resolution bands upsampled
+   * (bicubic) to the pan grid, the same window that would be read from a
+   * resampled Geotiff with RasterIO(). Integer pixel types are rounded and
+   * clamped. Low-res rows are kept in the ring between calls, so that
+   * consecutive windows (in rows) only read the rows they do not share.
+   *
+   * Args:
+   *   Window const& : window of the pan grid.
+   *   T* const* : output buffer of win.xsize*win.ysize pixels for each band.
+   * Returns:
+   *   CPLErr : CE_None on success, error of RasterIO() otherwise.
+   */
+  int k = Grid.Ratio;
+
+  // (re)build the horizontal layout if the columns of the window changed;
+  // this invalidates the rows of the ring
+  // *********************************************************************
+  if( win.xoff != RingXOff || win.xsize != RingXSize ) {
+    RingXOff  = win.xoff;
+    RingXSize = win.xsize;
+    TapCol.resize( win.xsize );
+    Phase.resize( win.xsize );
+    BorderCol.resize( win.xsize );
+    for( int col=0; col<win.xsize; col++ ) {
+      int p          = Grid.OffX+win.xoff+col;
+      TapCol[col]    = FirstTap( p,k );
+      Phase[col]     = p-FloorDiv( p,k )*k;
+      BorderCol[col] = TapCol[col]<0 || TapCol[col]+3>=LowCols;
+    }
+    int first = TapCol[0]<0 ? 0 : TapCol[0];
+    int last  = TapCol[win.xsize-1]+3;
+    if( last>=LowCols ) last = LowCols-1;
+    RingCol0  = first;
+    RingNCols = last-first+1;
+    LowRing.resize( 4*(size_t)NBands*RingNCols );
+    Ring.resize( 4*(size_t)NBands*RingXSize );
+    for( int slot=0; slot<4; slot++ ) RingRow[slot] = INT_MIN;
+  }
+
+  // produce each pan row from the 4 ring rows around it (or, for 
+  // pixels whose taps leave the image, from the 2 rows around it)
+  // *************************************************************
+  for( int row=0; row<win.ysize; row++ ) {
+    int q     = Grid.OffY+win.yoff+row;
+    int tap0  = FirstTap( q,k );
+    int phase = q-FloorDiv( q,k )*k;
+    const double *w = &Weights[4*phase];
+    bool BorderRow  = tap0<0 || tap0+3>=LowRows;
+
+    int slots[4];
+    for( int tap=0; tap<4; tap++ ) {
+      int lowRow = tap0+tap;
+      int slot   = ( (lowRow%4)+4 )%4;
+      if( RingRow[slot] != lowRow ) {
+        CPLErr eErr = LoadRow( lowRow,slot );
+        if( eErr != CE_None ) return eErr;
+      }
+      slots[tap] = slot;
+    }
+
+    for( int band=0; band<NBands; band++ ) {
+      const double *taps[4];
+      for( int tap=0; tap<4; tap++ ) {
+        taps[tap] = Ring.data()+( (size_t)slots[tap]*NBands+band )*RingXSize;
+      }
+      T *outRow = out[band]+(size_t)row*win.xsize;
+      for( int col=0; col<win.xsize; col++ ) {
+        double value = w[0]*taps[0][col]+w[1]*taps[1][col]+
+                       w[2]*taps[2][col]+w[3]*taps[3][col];
+        if( BorderRow || BorderCol[col] ) value = Bilinear( band,col,tap0,phase,slots[1],slots[2] );
+        outRow[col] = SaturateCast<T>( value );
+      }
+    }
+  }
+  return CE_None;
+}
+
+// explicit instantiations for each pixel type of the pan-sharpening
+// *****************************************************************
+template class BicubicUpsampler<unsigned char>;
+template class BicubicUpsampler<unsigned short>;
+template class BicubicUpsampler<short>;
+template class BicubicUpsampler<unsigned int>;
+template class BicubicUpsampler<int>;
+template class BicubicUpsampler<float>;
+template class BicubicUpsampler<double>;
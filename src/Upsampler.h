@@ -0,0 +1,74 @@
+#ifndef UPSAMPLER_H_
+#define UPSAMPLER_H_
+#include <vector>
+#include "gdal_priv.h"
+#include "Window.h"
+
+// define C++ structure holding how a low-resolution (multispectral) grid
+// lines up with the high-resolution (panchromatic) grid when the pixel
+// size ratio is an exact integer and the grids are aligned: pan column
+// c (row r) starts exactly at low-res column (OffX+c)/Ratio (row
+// (OffY+r)/Ratio).
+// **********************************************************************
+typedef struct {
+  int Ratio; // ratio of low-res to high-res pixel size (e.g. 2 or 4)
+  int OffX;  // column offset of the pan grid, in pan pixels
+  int OffY;  // row offset of the pan grid, in pan pixels
+} GridAlignment;
+
+// define function prototypes
+// **************************
+bool IntegerRatioAlignment( GDALDatasetH,GDALDatasetH,GridAlignment* );
+
+// define template class for the fused, separable bicubic upsampler. It
+// reads low-resolution rows of one or more bands, upsamples them 
+// horizontally into a small ring of rows, and then produces 
+// high-resolution rows from the four ring rows around each one (vertical
+// pass), as the windows of the pan grid stream by. Rows already in the
+// ring are not read again. Near the border, where the 4x4 taps of a pixel
+// leave the image, it falls back to bilinear over the taps inside of it,
+// as GDAL's cubic warp kernel does. The bands of a multi-band image are read 
+// together, with one dataset-level RasterIO() per row, so that each 
+// block of a pixel-interleaved file is decoded once for all of them.
+// ***********************************************************************
+template<typename T>
+class BicubicUpsampler {
+  private:
+    GDALDataset *Dataset;   // low-resolution image
+    std::vector<int> Bands; // bands of Dataset that are upsampled
+    int NBands;
+    GridAlignment Grid;     // alignment of low-res and pan grids
+    int LowCols,LowRows;    // dimensions of the low-resolution bands
+
+    // bicubic weights for each of the Ratio sub-pixel phases (4 taps),
+    // and the fraction of each phase (for the bilinear border)
+    // ***************************************************************
+    std::vector<double> Weights;
+    std::vector<double> Fraction;
+
+    // horizontal layout of the current window: first low-res column
+    // read, and for each window column its first tap, its phase, and
+    // whether its taps leave the image (border column)
+    // **************************************************************
+    int RingXOff,RingXSize,RingCol0,RingNCols;
+    std::vector<int> TapCol;
+    std::vector<int> Phase;
+    std::vector<char> BorderCol;
+
+    // ring of 4 horizontally upsampled low-res rows (of every band), 
+    // indexed by (low-res row mod 4), the low-res rows as read (for the
+    // bilinear border), and the low-res row held by each slot
+    // *****************************************************************
+    std::vector<double> Ring;
+    std::vector<double> LowRing;
+    int RingRow[4];
+
+    CPLErr LoadRow( int,int );
+    double Bilinear( int,int,int,int,int,int ) const;
+  public:
+    BicubicUpsampler( GDALRasterBand*,GridAlignment );
+    BicubicUpsampler( GDALDataset*,int,const int*,GridAlignment );
+    CPLErr ReadWindow( Window const&,T* );
+    CPLErr ReadWindow( Window const&,T* const* );
+};
+#endif
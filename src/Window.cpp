@@ -0,0 +1,180 @@
+#include <numeric>
+#include <vector>
+#include "Window.h"
+
+// default number of pixels in a window when no window size is given
+// *****************************************************************
+static const long DEFAULT_WINDOW_PIXELS = 1L<<20;
+
+int AlignmentUnit( int inBlockSize,int outBlockSize,int imageSize ) {
+  /* *************************************************************************
+   * int AlignmentUnit( int,int,int ):
+   *
+   * This function returns the number of pixels (along one image axis) that
+   * a window should be a multiple of, so that its edges fall on block
+   * boundaries of both the input (panchromatic) and output Geotiffs. This
+   * is the least common multiple of the two block sizes. If that multiple
+   * is larger than the image itself, then the output block size is used,
+   * because partial output blocks are the more expensive case (they force
+   * a read-modify-write of the block).
+   *
+   * Args:
+   *   int : block size of the input (panchromatic) band along this axis.
+   *   int : block size of the output bands along this axis.
+   *   int : image size along this axis.
+   * Returns:
+   *   int : alignment unit in pixels (always at least 1).
+   */
+  if( inBlockSize<1  ) inBlockSize  = 1;
+  if( outBlockSize<1 ) outBlockSize = 1;
+
+  long unit = std::lcm( (long)inBlockSize,(long)outBlockSize );
+  if( unit>imageSize ) {
+    unit = outBlockSize;
+  }
+  return (int)unit;
+}
+
+int AlignedWindowSize( int requested,int unit,int imageSize,int otherSize ) {
+  /* *************************************************************************
+   * int AlignedWindowSize( int,int,int,int ):
+   *
+   * This function rounds a requested window size (along one image axis) up
+   * to a multiple of the alignment unit returned by AlignmentUnit(). If no
+   * window size was requested (zero or less), then a size is chosen so that
+   * a window holds about one million pixels given the size of the window
+   * along the other axis.
+   *
+   * Args:
+   *   int : requested window size in pixels (0 for default).
+   *   int : alignment unit in pixels (see AlignmentUnit()).
+   *   int : image size along this axis.
+   *   int : window size along the other axis.
+   * Returns:
+   *   int : window size in pixels, clipped to the image size.
+   */
+  if( requested<1 ) {
+    requested = (int)( DEFAULT_WINDOW_PIXELS / (otherSize>0 ? otherSize : 1) );
+  }
+  if( requested<unit ) requested = unit;
+
+  int size = ( (requested+unit-1)/unit )*unit;
+  if( size>imageSize ) size = imageSize;
+  return size;
+}
+
+std::vector<Window> BlockAlignedWindows( int N_COLS,int N_ROWS,int winCols,int winRows ) {
+  /* *************************************************************************
+   * std::vector<Window> BlockAlignedWindows( int,int,int,int ):
+   *
+   * This function splits an image with N_COLS columns and N_ROWS rows into
+   * windows of winCols columns by winRows rows, ordered row-major (left to
+   * right, then top to bottom). Windows along the right and bottom edges
+   * of the image are clipped to the image. If the window sizes come from
+   * AlignedWindowSize(), then every window starts on a block boundary.
+   *
+   * Args:
+   *   int : number of columns in the image.
+   *   int : number of rows in the image.
+   *   int : number of columns in a window.
+   *   int : number of rows in a window.
+   * Returns:
+   *   std::vector<Window> : windows covering the entire image.
+   */
+  std::vector<Window> Windows;
+  if( winCols<1 ) winCols = N_COLS;
+  if( winRows<1 ) winRows = 1;
+
+  for( int yoff=0; yoff<N_ROWS; yoff+=winRows ) {
+    for( int xoff=0; xoff<N_COLS; xoff+=winCols ) {
+      Window win;
+      win.xoff  = xoff;
+      win.yoff  = yoff;
+      win.xsize = ( xoff+winCols>N_COLS ) ? N_COLS-xoff : winCols;
+      win.ysize = ( yoff+winRows>N_ROWS ) ? N_ROWS-yoff : winRows;
+      Windows.push_back( win );
+    }
+  }
+  return Windows;
+}
+
+std::vector<Window> SampleWindows( int N_COLS,int N_ROWS,int tileCols,int tileRows,int spacing ) {
+  /* *************************************************************************
+   * std::vector<Window> SampleWindows( int,int,int,int,int ):
+   *
+   * This function lays out a sparse grid of small sample tiles over an 
+   * image: one tile of tileCols columns by tileRows rows in the center of
+   * every cell of spacing*tileCols columns by spacing*tileRows rows, so
+   * that about 1/(spacing*spacing) of the image is sampled, spread evenly
+   * over the image. Images smaller than a cell get one (clipped) tile in
+   * their center. Tiles are ordered row-major.
+   *
+   * Args:
+   *   int : number of columns in the image.
+   *   int : number of rows in the image.
+   *   int : number of columns in a tile.
+   *   int : number of rows in a tile.
+   *   int : tile spacing, in tiles.
+   * Returns:
+   *   std::vector<Window> : the sample tiles.
+   */
+  std::vector<Window> Tiles;
+  if( tileCols<1 ) tileCols = 1;
+  if( tileRows<1 ) tileRows = 1;
+  if( spacing<1 )  spacing  = 1;
+  int cellCols = spacing*tileCols;
+  int cellRows = spacing*tileRows;
+  int nx = N_COLS/cellCols>0 ? N_COLS/cellCols : 1;
+  int ny = N_ROWS/cellRows>0 ? N_ROWS/cellRows : 1;
+
+  for( int j=0; j<ny; j++ ) {
+    for( int i=0; i<nx; i++ ) {
+      Window win;
+      win.xoff  = N_COLS<cellCols ? ( N_COLS-tileCols )/2 : i*cellCols+( cellCols-tileCols )/2;
+      win.yoff  = N_ROWS<cellRows ? ( N_ROWS-tileRows )/2 : j*cellRows+( cellRows-tileRows )/2;
+      if( win.xoff<0 ) win.xoff = 0;
+      if( win.yoff<0 ) win.yoff = 0;
+      win.xsize = ( win.xoff+tileCols>N_COLS ) ? N_COLS-win.xoff : tileCols;
+      win.ysize = ( win.yoff+tileRows>N_ROWS ) ? N_ROWS-win.yoff : tileRows;
+      Tiles.push_back( win );
+    }
+  }
+  return Tiles;
+}
+
+Window ShardRows( std::vector<Window> const& Windows,int Shard,int N_shards ) {
+  /* *************************************************************************
+   * Window ShardRows( std::vector<Window> const&,int,int ):
+   *
+   * This function splits the rows of windows laid out by 
+   * BlockAlignedWindows() into N_shards contiguous, nearly equal ranges,
+   * and returns range Shard (1 to N_shards) as a full-width part of the
+   * image. Its edges are window (and so block) boundaries, and every 
+   * window lies in exactly one shard. With more shards than rows of 
+   * windows, some shards are empty (no rows).
+   *
+   * Args:
+   *   std::vector<Window> const& : windows covering the image (row-major).
+   *   int : shard number, from 1 to N_shards.
+   *   int : number of shards.
+   * Returns:
+   *   Window : part of the image (all columns, a range of rows) of the shard.
+   */
+  std::vector<int> RowStarts; // first row of each row of windows
+  int N_COLS = 0,N_ROWS = 0;
+  for( Window const& win : Windows ) {
+    if( RowStarts.empty() || win.yoff != RowStarts.back() ) RowStarts.push_back( win.yoff );
+    if( win.xoff+win.xsize>N_COLS ) N_COLS = win.xoff+win.xsize;
+    if( win.yoff+win.ysize>N_ROWS ) N_ROWS = win.yoff+win.ysize;
+  }
+  long nRows = (long)RowStarts.size();
+  long first = ( Shard-1 )*nRows/N_shards;
+  long last  = Shard*nRows/N_shards;
+
+  Window Part;
+  Part.xoff  = 0;
+  Part.xsize = N_COLS;
+  Part.yoff  = first<nRows ? RowStarts[first] : N_ROWS;
+  Part.ysize = ( last<nRows ? RowStarts[last] : N_ROWS )-Part.yoff;
+  return Part;
+}
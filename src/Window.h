@@ -0,0 +1,22 @@
+#ifndef WINDOW_H_
+#define WINDOW_H_
+#include <vector>
+
+// define C++ structure to hold a rectangular window (or tile) of pixels
+// inside of the panchromatic (and therefore output) image grid
+// *********************************************************************
+typedef struct {
+  int xoff;  // column offset of the window
+  int yoff;  // row offset of the window
+  int xsize; // number of columns in the window
+  int ysize; // number of rows in the window
+} Window;
+
+// define function prototypes
+// **************************
+int AlignmentUnit( int,int,int );
+int AlignedWindowSize( int,int,int,int );
+std::vector<Window> BlockAlignedWindows( int,int,int,int );
+std::vector<Window> SampleWindows( int,int,int,int,int );
+Window ShardRows( std::vector<Window> const&,int,int );
+#endif
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <getopt.h>
+#include "gdal.h"
+
+// options of the comparison: pixels within Border pixels of an edge of
+// the raster may differ by up to Tolerance (e.g. the fused upsampler
+// against the GDAL warper); every other pixel must be identical. With
+// a window (e.g. of a --window output), the actual raster is compared
+// with that window of the expected raster.
+// ********************************************************************
+struct CompareOptions {
+  int Border       = 0;
+  double Tolerance = 0.0;
+  bool HasWindow   = false;
+  int Window[4]    = { 0,0,0,0 }; // xoff,yoff,xsize,ysize
+};
+
+void Usage() {
+  printf("                                                                         \n "
+   " ***************************************************************************** \n "
+   " NAME:                                                                         \n "
+   "  compareimagery                                                               \n "
+   " DESCRIPTION:                                                                  \n "
+   "  Compares the pixels of two rasters (any GDAL format, e.g. a Geotiff and     \n "
+   "  the VRT of merged shards) byte for byte: same dimensions, band count, and   \n "
+   "  data types, and identical stored values in every band. Exits with status   \n "
+   "  0 if they are identical, 1 otherwise (see test/check.sh).                   \n "
+   " USAGE:                                                                        \n "
+   "  $ bin/compareimagery [--border N --tolerance T]                             \n "
+   "      [--window XOFF,YOFF,XSIZE,YSIZE] EXPECTED ACTUAL                        \n "
+   "                                                                               \n "
+   "  --border      width in pixels of the border along every edge (default 0)    \n "
+   "  --tolerance   largest difference allowed in the border (default 0)          \n "
+   "  --window      compare ACTUAL (of XSIZE x YSIZE pixels) with this window of  \n "
+   "                EXPECTED, e.g. a --window output with a whole-scene output    \n "
+   " ***************************************************************************** \n\n");
+  exit(1);
+}
+
+static bool CompareBand( GDALRasterBandH Expected,GDALRasterBandH Actual,int Band,
+  int Cols,int Rows,const char* ActualName,CompareOptions const& Options ) {
+  /* *************************************************************************
+   * bool CompareBand( GDALRasterBandH,GDALRasterBandH,int,int,int,
+   *   const char*,CompareOptions const& ):
+   *
+   * This function compares one band of two rasters of the same size (or
+   * the actual raster with a window of the expected one), row by row, in
+   * their stored data type, and reports the first pixel that differs and
+   * how many do. Pixels of the border (see CompareOptions) that differ by
+   * no more than the tolerance are only counted.
+   *
+   * Args:
+   *   GDALRasterBandH : band of the expected raster.
+   *   GDALRasterBandH : band of the actual raster.
+   *   int : band number (1-based, for the report).
+   *   int : number of columns (of the actual raster).
+   *   int : number of rows (of the actual raster).
+   *   const char* : file name of the actual raster (for the report).
+   *   CompareOptions const& : border and tolerance.
+   * Returns:
+   *   bool : true if every pixel of the bands is identical (or within
+   *   the tolerance, in the border).
+   */
+  GDALDataType Type = GDALGetRasterDataType( Expected );
+  if( GDALGetRasterDataType( Actual ) != Type ) {
+    printf("  %s: band %d is %s, expected %s \n",ActualName,Band,
+      GDALGetDataTypeName( GDALGetRasterDataType( Actual ) ),GDALGetDataTypeName( Type ));
+    return false;
+  }
+  int Bytes = GDALGetDataTypeSizeBytes( Type );
+  int xoff  = Options.Window[0],yoff = Options.Window[1];
+  std::vector<unsigned char> ExpectedRow( (size_t)Cols*Bytes ),ActualRow( (size_t)Cols*Bytes );
+  uint64_t Differ = 0,Tolerated = 0;
+  for( int row=0; row<Rows; row++ ) {
+    bool BorderRow = row<Options.Border || row>=Rows-Options.Border;
+    if( GDALRasterIO( Expected,GF_Read,xoff,yoff+row,Cols,1,ExpectedRow.data(),Cols,1,Type,0,0 ) != CE_None ||
+        GDALRasterIO( Actual,GF_Read,0,row,Cols,1,ActualRow.data(),Cols,1,Type,0,0 ) != CE_None ) {
+      printf("  %s: unable to read row %d of band %d \n",ActualName,row,Band);
+      return false;
+    }
+    if( memcmp( ExpectedRow.data(),ActualRow.data(),ExpectedRow.size() ) == 0 ) continue;
+    for( int col=0; col<Cols; col++ ) {
+      if( memcmp( &ExpectedRow[(size_t)col*Bytes],&ActualRow[(size_t)col*Bytes],Bytes ) == 0 ) continue;
+      if( BorderRow || col<Options.Border || col>=Cols-Options.Border ) {
+        double ExpectedValue,ActualValue;
+        GDALCopyWords( &ExpectedRow[(size_t)col*Bytes],Type,0,&ExpectedValue,GDT_Float64,0,1 );
+        GDALCopyWords( &ActualRow[(size_t)col*Bytes],Type,0,&ActualValue,GDT_Float64,0,1 );
+        if( fabs( ExpectedValue-ActualValue )<=Options.Tolerance ) {
+          Tolerated++;
+          continue;
+        }
+      }
+      if( Differ == 0 ) printf("  %s: band %d differs first at pixel (%d,%d) \n",ActualName,Band,col,row);
+      Differ++;
+    }
+  }
+  if( Tolerated>0 ) {
+    printf("  %s: band %d has %llu border pixel(s) within %g \n",ActualName,Band,
+      (unsigned long long)Tolerated,Options.Tolerance);
+  }
+  if( Differ>0 ) {
+    printf("  %s: band %d has %llu differing pixel(s) \n",ActualName,Band,(unsigned long long)Differ);
+  }
+  return Differ == 0;
+}
+
+int main( int argc, char* argv[] )
+{
+  /* **************************************************************
+   *
+   * This is the main method of the raster comparison. It compares
+   * the two rasters given (see Usage()) pixel for pixel.
+   *
+   * ************************************************************ */
+  CompareOptions Options;
+  enum { OPT_BORDER=256,OPT_TOLERANCE,OPT_WINDOW };
+  static struct option LongOptions[] = {
+    { "border",required_argument,nullptr,OPT_BORDER },
+    { "tolerance",required_argument,nullptr,OPT_TOLERANCE },
+    { "window",required_argument,nullptr,OPT_WINDOW },
+    { nullptr,0,nullptr,0 }
+  };
+
+  // get option arguments
+  // ********************
+  int opt = 0;
+  while((opt=getopt_long(argc,argv,":h",LongOptions,nullptr))!=-1) {
+    switch(opt) {
+      case OPT_BORDER:
+	Options.Border = atoi(optarg);
+	break;
+      case OPT_TOLERANCE:
+	Options.Tolerance = atof(optarg);
+	break;
+      case OPT_WINDOW:
+	if( sscanf( optarg,"%d,%d,%d,%d",&Options.Window[0],&Options.Window[1],
+	      &Options.Window[2],&Options.Window[3] ) != 4 || Options.Window[0]<0 || Options.Window[1]<0 ||
+	    Options.Window[2]<1 || Options.Window[3]<1 ) {
+	  printf("  \n ERROR (fatal): --window %s should be xoff,yoff,xsize,ysize (pixels). Exiting ... \n",optarg);
+	  exit(1);
+	}
+	Options.HasWindow = true;
+	break;
+      default:
+	Usage();
+    }
+  }
+  if( argc-optind != 2 ) Usage();
+  const char* ExpectedName = argv[optind];
+  const char* ActualName   = argv[optind+1];
+  GDALAllRegister();
+  GDALDatasetH Expected = GDALOpen( ExpectedName,GA_ReadOnly );
+  GDALDatasetH Actual   = GDALOpen( ActualName,GA_ReadOnly );
+  if( Expected == nullptr || Actual == nullptr ) {
+    printf("  \n ERROR (fatal): unable to open %s. Exiting ... \n",Expected == nullptr ? ExpectedName : ActualName);
+    exit(1);
+  }
+
+  // same dimensions (those of the window, inside of the expected
+  // raster) and bands, then the same pixels in every band
+  // *************************************************************
+  int Cols  = GDALGetRasterXSize( Expected );
+  int Rows  = GDALGetRasterYSize( Expected );
+  int Bands = GDALGetRasterCount( Expected );
+  bool Identical = true;
+  if( Options.HasWindow ) {
+    if( Options.Window[0]+Options.Window[2]>Cols || Options.Window[1]+Options.Window[3]>Rows ) {
+      printf("  %s: --window is not inside of its %d x %d pixels \n",ExpectedName,Cols,Rows);
+      Identical = false;
+    }
+    Cols = Options.Window[2];
+    Rows = Options.Window[3];
+  }
+  if( GDALGetRasterXSize( Actual ) != Cols || GDALGetRasterYSize( Actual ) != Rows ||
+      GDALGetRasterCount( Actual ) != Bands ) {
+    printf("  %s: %d x %d x %d, expected %d x %d x %d \n",ActualName,GDALGetRasterXSize( Actual ),
+      GDALGetRasterYSize( Actual ),GDALGetRasterCount( Actual ),Cols,Rows,Bands);
+    Identical = false;
+  }
+  for( int band=1; band<=Bands && Identical; band++ ) {
+    if( !CompareBand( GDALGetRasterBand( Expected,band ),GDALGetRasterBand( Actual,band ),
+          band,Cols,Rows,ActualName,Options ) ) Identical = false;
+  }
+  GDALClose( Expected );
+  GDALClose( Actual );
+  GDALDestroyDriverManager();
+  return Identical ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "LibPansharpen.h"
+
+// names of the Geotiffs of a scene written by bin/makescene, and the
+// options of the reference run of test/check.sh that the outputs are
+// compared with (-z 4 -w 64 --method all)
+// *****************************************************************
+static const char* SCENE_FILES[5] = { "PAN.TIF","RED.TIF","GREEN.TIF","BLUE.TIF","NIR.TIF" };
+static const int N_BANDS     = 4;
+static const int WINDOW_ROWS = 64;
+
+void Usage() {
+  printf("                                                                         \n "
+   " ***************************************************************************** \n "
+   " NAME:                                                                         \n "
+   "  sharpenbuffers                                                               \n "
+   " DESCRIPTION:                                                                  \n "
+   "  Reads a scene of bin/makescene into memory, pan-sharpens it with every      \n "
+   "  method through PansharpenBuffers() (src/LibPansharpen.h), once with packed  \n "
+   "  rasters (the zero-copy path) and once with strided ones (padded pan rows,   \n "
+   "  pixel-interleaved multispectral bands without a geotransform, and pixel-    \n "
+   "  interleaved outputs), and compares the outputs byte for byte with those of  \n "
+   "  bin/pansharpen -z 4 -w 64 --method all. Exits with status 0 if they are     \n "
+   "  identical, 1 otherwise (see test/check.sh).                                 \n "
+   " USAGE:                                                                        \n "
+   "  $ bin/sharpenbuffers SCENE_DIRECTORY REFERENCE_DIRECTORY                     \n "
+   " ***************************************************************************** \n\n");
+  exit(1);
+}
+
+// define C++ structure holding an image of the scene in memory: its
+// pixels, its geotransform and projection, and its nodata value
+// ******************************************************************
+struct SceneFile {
+  GDALDatasetH Dataset = nullptr;
+  GDALDataType Type    = GDT_Unknown;
+  int Cols = 0;
+  int Rows = 0;
+  double GeoTransform[6];
+  std::string Projection;
+  int HasNoData      = FALSE;
+  double NoDataValue = 0.0;
+};
+
+static SceneFile OpenImage( std::string const& Filename ) {
+  /* *************************************************************************
+   * SceneFile OpenImage( std::string const& ):
+   *
+   * This function opens an image of the scene and gets its size, data
+   * type, georeferencing, and nodata value.
+   *
+   * Args:
+   *   std::string const& : file name of the image.
+   * Returns:
+   *   SceneFile : the opened image (exits if it cannot be opened).
+   */
+  SceneFile Image;
+  Image.Dataset = GDALOpen( Filename.c_str(),GA_ReadOnly );
+  if( Image.Dataset == nullptr ) {
+    printf("  \n ERROR (fatal): unable to open %s. Exiting ... \n",Filename.c_str());
+    exit(1);
+  }
+  GDALRasterBandH Band = GDALGetRasterBand( Image.Dataset,1 );
+  Image.Type = GDALGetRasterDataType( Band );
+  Image.Cols = GDALGetRasterXSize( Image.Dataset );
+  Image.Rows = GDALGetRasterYSize( Image.Dataset );
+  GDALGetGeoTransform( Image.Dataset,Image.GeoTransform );
+  Image.Projection  = GDALGetProjectionRef( Image.Dataset );
+  Image.NoDataValue = GDALGetRasterNoDataValue( Band,&Image.HasNoData );
+  return Image;
+}
+
+static PansharpenRaster ReadImage( SceneFile const& Image,unsigned char* Data,
+  GSpacing PixelStride,GSpacing LineStride,bool GeoTransform ) {
+  /* *************************************************************************
+   * PansharpenRaster ReadImage( SceneFile const&,unsigned char*,GSpacing,
+   *   GSpacing,bool ):
+   *
+   * This function reads an image into a buffer with the strides given,
+   * and returns the raster describing it for PansharpenBuffers().
+   *
+   * Args:
+   *   SceneFile const& : opened image.
+   *   unsigned char* : first pixel of the buffer.
+   *   GSpacing : bytes from a pixel to the next one.
+   *   GSpacing : bytes from a row to the next one.
+   *   bool : whether the raster carries the image's geotransform (a
+   *          multispectral raster without one spans the pan extent).
+   * Returns:
+   *   PansharpenRaster : raster of the buffer (exits if unreadable).
+   */
+  if( GDALRasterIOEx( GDALGetRasterBand( Image.Dataset,1 ),GF_Read,0,0,Image.Cols,Image.Rows,
+        Data,Image.Cols,Image.Rows,Image.Type,PixelStride,LineStride,nullptr ) != CE_None ) {
+    printf("  \n ERROR (fatal): unable to read %s. Exiting ... \n",GDALGetDescription( Image.Dataset ));
+    exit(1);
+  }
+  PansharpenRaster Raster;
+  Raster.Data = Data;
+  Raster.Type = Image.Type;
+  Raster.Cols = Image.Cols;
+  Raster.Rows = Image.Rows;
+  Raster.PixelStride = PixelStride;
+  Raster.LineStride  = LineStride;
+  Raster.HasNoData   = Image.HasNoData;
+  Raster.NoDataValue = Image.NoDataValue;
+  if( GeoTransform ) {
+    Raster.HasGeoTransform = true;
+    for( int i=0; i<6; i++ ) Raster.GeoTransform[i] = Image.GeoTransform[i];
+    Raster.Projection = Image.Projection;
+  }
+  return Raster;
+}
+
+static bool CompareOutput( PansharpenRaster const& Output,std::string const& Reference,
+  const char* Name ) {
+  /* *************************************************************************
+   * bool CompareOutput( PansharpenRaster const&,std::string const&,
+   *   const char* ):
+   *
+   * This function compares an output raster of PansharpenBuffers() (of
+   * Float32 pixels) with the output Geotiff of bin/pansharpen, band by
+   * band and row by row, and reports the first pixel that differs.
+   *
+   * Args:
+   *   PansharpenRaster const& : output raster (with its strides).
+   *   std::string const& : file name of the reference output.
+   *   const char* : name of the run (for the report).
+   * Returns:
+   *   bool : true if every pixel of every band is identical.
+   */
+  GDALDatasetH Dataset = GDALOpen( Reference.c_str(),GA_ReadOnly );
+  if( Dataset == nullptr ) {
+    printf("  %s: unable to open %s \n",Name,Reference.c_str());
+    return false;
+  }
+  bool Identical = GDALGetRasterCount( Dataset ) == Output.Bands &&
+    GDALGetRasterXSize( Dataset ) == Output.Cols && GDALGetRasterYSize( Dataset ) == Output.Rows;
+  if( !Identical ) printf("  %s: %s is not of the size of the output \n",Name,Reference.c_str());
+  GSpacing PixelStride = Output.PixelStride ? Output.PixelStride : sizeof(float);
+  GSpacing LineStride  = Output.LineStride ? Output.LineStride : PixelStride*Output.Cols;
+  GSpacing BandStride  = Output.BandStride ? Output.BandStride : LineStride*Output.Rows;
+  std::vector<float> Row( Output.Cols );
+  for( int band=0; band<Output.Bands && Identical; band++ ) {
+    GDALRasterBandH Band = GDALGetRasterBand( Dataset,band+1 );
+    for( int row=0; row<Output.Rows && Identical; row++ ) {
+      if( GDALRasterIO( Band,GF_Read,0,row,Output.Cols,1,Row.data(),Output.Cols,1,GDT_Float32,0,0 ) != CE_None ) {
+        printf("  %s: unable to read row %d of %s \n",Name,row,Reference.c_str());
+        Identical = false;
+        break;
+      }
+      const unsigned char* First = (const unsigned char*)Output.Data+band*BandStride+row*LineStride;
+      for( int col=0; col<Output.Cols; col++ ) {
+        if( memcmp( First+col*PixelStride,&Row[col],sizeof(float) ) == 0 ) continue;
+        printf("  %s: band %d of %s differs first at pixel (%d,%d) \n",Name,band+1,
+          Reference.c_str(),col,row);
+        Identical = false;
+        break;
+      }
+    }
+  }
+  GDALClose( Dataset );
+  return Identical;
+}
+
+static void Sharpen( PansharpenRaster const& Pan,const PansharpenRaster* MS,
+  const PansharpenRaster* Outputs,PansharpenOptions const& Options ) {
+  /* *************************************************************************
+   * void Sharpen( PansharpenRaster const&,const PansharpenRaster*,
+   *   const PansharpenRaster*,PansharpenOptions const& ):
+   *
+   * This function calls PansharpenBuffers() on the 4 bands of the scene
+   * and exits if it throws.
+   *
+   * Args:
+   *   PansharpenRaster const& : panchromatic raster.
+   *   const PansharpenRaster* : multispectral rasters.
+   *   const PansharpenRaster* : output rasters, indexed by method.
+   *   PansharpenOptions const& : options of the pan-sharpening.
+   * Returns:
+   *   None. Void.
+   */
+  try {
+    PansharpenBuffers( Pan,MS,N_BANDS,Outputs,Options );
+  } catch( PansharpenError const& e ) {
+    printf("  \n ERROR (fatal): %s Exiting ... \n",e.what());
+    exit(1);
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  /* **************************************************************
+   *
+   * This is the main method of the in-memory check. It pan-sharpens
+   * the scene given through PansharpenBuffers(), with packed and
+   * with strided rasters, and compares the outputs with those of
+   * bin/pansharpen (see Usage()).
+   *
+   * ************************************************************ */
+  if( argc != 3 ) Usage();
+  std::string SceneDirectory     = argv[1];
+  std::string ReferenceDirectory = argv[2];
+  GDALAllRegister();
+  std::vector<SceneFile> Images;
+  for( const char* File : SCENE_FILES ) Images.push_back( OpenImage( SceneDirectory+"/"+File ) );
+  SceneFile const& PanImage = Images[0];
+  int Cols = PanImage.Cols,Rows = PanImage.Rows;
+  int panBytes = GDALGetDataTypeSizeBytes( PanImage.Type );
+  int msBytes  = GDALGetDataTypeSizeBytes( Images[1].Type );
+  int msCols   = Images[1].Cols,msRows = Images[1].Rows;
+
+  PansharpenOptions Options;
+  Options.WindowRows = WINDOW_ROWS;
+  Options.Threads    = 2;
+  Options.Methods    = ALL_METHODS;
+  bool Identical = true;
+
+  // packed rasters: the pan raster and the outputs are used in place
+  // (no window copies), each multispectral band with its geotransform
+  // *****************************************************************
+  {
+    std::vector<unsigned char> Pixels( (size_t)Cols*Rows*panBytes );
+    std::vector< std::vector<unsigned char> > Bands( N_BANDS );
+    PansharpenRaster Pan = ReadImage( PanImage,Pixels.data(),panBytes,(GSpacing)panBytes*Cols,true );
+    PansharpenRaster MS[ N_BANDS ];
+    for( int band=0; band<N_BANDS; band++ ) {
+      Bands[band].resize( (size_t)msCols*msRows*msBytes );
+      MS[band] = ReadImage( Images[band+1],Bands[band].data(),msBytes,(GSpacing)msBytes*msCols,true );
+    }
+    std::vector< std::vector<float> > Sharpened( N_METHODS );
+    PansharpenRaster Outputs[ N_METHODS ];
+    for( int method=0; method<N_METHODS; method++ ) {
+      Sharpened[method].resize( (size_t)N_BANDS*Cols*Rows );
+      Outputs[method].Data  = Sharpened[method].data();
+      Outputs[method].Type  = GDT_Float32;
+      Outputs[method].Cols  = Cols;
+      Outputs[method].Rows  = Rows;
+      Outputs[method].Bands = N_BANDS;
+    }
+    Sharpen( Pan,MS,Outputs,Options );
+    for( int method=0; method<N_METHODS; method++ ) {
+      if( !CompareOutput( Outputs[method],ReferenceDirectory+"/"+SHARPEN_METHODS[method].OutputFile,
+            "packed" ) ) Identical = false;
+    }
+  }
+
+  // strided rasters: pan rows padded, the multispectral bands pixel-
+  // interleaved in one buffer without a geotransform (synthesized from
+  // the pan extent), and pixel-interleaved outputs
+  // ******************************************************************
+  {
+    GSpacing panLine = (GSpacing)panBytes*( Cols+13 );
+    std::vector<unsigned char> Pixels( (size_t)panLine*Rows );
+    std::vector<unsigned char> Interleaved( (size_t)N_BANDS*msCols*msRows*msBytes );
+    PansharpenRaster Pan = ReadImage( PanImage,Pixels.data(),panBytes,panLine,true );
+    PansharpenRaster MS[ N_BANDS ];
+    for( int band=0; band<N_BANDS; band++ ) {
+      MS[band] = ReadImage( Images[band+1],Interleaved.data()+band*msBytes,(GSpacing)N_BANDS*msBytes,
+        (GSpacing)N_BANDS*msBytes*msCols,false );
+    }
+    std::vector< std::vector<float> > Sharpened( N_METHODS );
+    PansharpenRaster Outputs[ N_METHODS ];
+    for( int method=0; method<N_METHODS; method++ ) {
+      Sharpened[method].resize( (size_t)N_BANDS*Cols*Rows );
+      Outputs[method].Data  = Sharpened[method].data();
+      Outputs[method].Type  = GDT_Float32;
+      Outputs[method].Cols  = Cols;
+      Outputs[method].Rows  = Rows;
+      Outputs[method].Bands = N_BANDS;
+      Outputs[method].PixelStride = N_BANDS*sizeof(float);
+      Outputs[method].LineStride  = (GSpacing)N_BANDS*sizeof(float)*Cols;
+      Outputs[method].BandStride  = sizeof(float);
+    }
+    Sharpen( Pan,MS,Outputs,Options );
+    for( int method=0; method<N_METHODS; method++ ) {
+      if( !CompareOutput( Outputs[method],ReferenceDirectory+"/"+SHARPEN_METHODS[method].OutputFile,
+            "strided" ) ) Identical = false;
+    }
+  }
+  for( SceneFile& Image : Images ) GDALClose( Image.Dataset );
+  GDALDestroyDriverManager();
+  return Identical ? 0 : 1;
+}
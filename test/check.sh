@@ -0,0 +1,234 @@
+#!/bin/sh
+#
+# end-to-end checks (make check): pan-sharpens small synthetic scenes
+# (bin/makescene) and compares every output, pixel for pixel
+# (bin/compareimagery), with the reference run: one thread, the scalar
+# kernels (PANSHARPEN_ISA=scalar), no shards. The SIMD kernels, the
+# threaded pipeline, and the stitched shards must all match it exactly.
+#
+# usage: test/check.sh [WORKDIR]   (default: bin/check, removed on success)
+#
+PANSHARPEN=bin/pansharpen
+MAKESCENE=bin/makescene
+COMPARE=bin/compareimagery
+SHARPENBUFFERS=bin/sharpenbuffers
+WORK=${1:-bin/check}
+FAILED=0
+
+rm -rf "$WORK"
+mkdir -p "$WORK"
+
+# run bin/pansharpen on scene $1 into directory $2 with the kernels of
+# instruction set $3 (scalar, or best for the best the processor has),
+# with the remaining arguments as options
+# ********************************************************************
+sharpen() {
+  SCENE=$1; OUT=$2; ISA=$3; shift 3
+  [ "$ISA" = best ] && ISA=
+  mkdir -p "$OUT"
+  if ! env ${ISA:+PANSHARPEN_ISA=$ISA} $PANSHARPEN -p "$SCENE/PAN.TIF" -r "$SCENE/RED.TIF" -g "$SCENE/GREEN.TIF" \
+       -b "$SCENE/BLUE.TIF" -n "$SCENE/NIR.TIF" -o "$OUT" "$@" > "$OUT.log" 2>&1; then
+    echo "  FAILED  pansharpen $* (see $OUT.log)"
+    FAILED=$((FAILED+1))
+  fi
+}
+
+# run bin/pansharpen as sharpen() does, on the pan image of scene $1
+# and the multispectral bands stacked in Geotiff $3 (--ms), into
+# directory $2, with the remaining arguments as options
+# ******************************************************************
+stacked() {
+  SCENE=$1; OUT=$2; MS=$3; shift 3
+  mkdir -p "$OUT"
+  if ! $PANSHARPEN -p "$SCENE/PAN.TIF" --ms "$MS" -o "$OUT" "$@" > "$OUT.log" 2>&1; then
+    echo "  FAILED  pansharpen --ms $MS $* (see $OUT.log)"
+    FAILED=$((FAILED+1))
+  fi
+}
+
+# compare every output of the reference directory $1 with the output of
+# the same name in directory $2 (with extension $4, e.g. .vrt of merged
+# shards), reporting check $3; $5 holds options of bin/compareimagery
+# (e.g. a border tolerance)
+# *********************************************************************
+compare() {
+  REF=$1; OUT=$2; NAME=$3; EXT=${4:-.tif}; FLAGS=$5
+  OK=1
+  for EXPECTED in "$REF"/sharpened_*.tif; do
+    ACTUAL="$OUT/$(basename "$EXPECTED" .tif)$EXT"
+    if ! $COMPARE $FLAGS "$EXPECTED" "$ACTUAL"; then OK=0; fi
+  done
+  if [ $OK = 1 ]; then
+    echo "  OK      $NAME"
+  else
+    echo "  FAILED  $NAME"
+    FAILED=$((FAILED+1))
+  fi
+}
+
+# scene 1: UInt16, multispectral 4x coarser (fused upsampler), tiled
+# and compressed, not a multiple of the blocks or windows
+# ******************************************************************
+S1="$WORK/scene1"
+$MAKESCENE -o "$S1" --size 1000x700 --type UInt16 --ratio 4 --tiled --blocksize 64 \
+  --compress DEFLATE > /dev/null || exit 1
+COMMON="-z 4 -w 64 --method all"
+sharpen "$S1" "$WORK/s1_ref" scalar $COMMON -j 1
+sharpen "$S1" "$WORK/s1_isa" best $COMMON -j 1
+compare "$WORK/s1_ref" "$WORK/s1_isa" "SIMD kernels match scalar kernels (UInt16)"
+sharpen "$S1" "$WORK/s1_threads" best $COMMON -j 4
+compare "$WORK/s1_ref" "$WORK/s1_threads" "4 threads match 1 thread (UInt16)"
+for SHARD in 1 2 3; do
+  sharpen "$S1" "$WORK/s1_shards" best $COMMON -j 2 --shard $SHARD/3
+done
+if ! $PANSHARPEN -o "$WORK/s1_shards" --method all --merge-shards 3 > "$WORK/s1_merge.log" 2>&1; then
+  echo "  FAILED  pansharpen --merge-shards 3 (see $WORK/s1_merge.log)"
+  FAILED=$((FAILED+1))
+fi
+compare "$WORK/s1_ref" "$WORK/s1_shards" "3 merged shards match 1 run (UInt16)" .vrt
+
+# the multispectral bands stacked in one Geotiff (--ms), in order and
+# permuted (a scene of the same pixels whose MS.TIF holds NIR,red,blue,
+# green, read back with --ms-bands)
+# *********************************************************************
+stacked "$S1" "$WORK/s1_stacked" "$S1/MS.TIF" $COMMON -j 2
+compare "$WORK/s1_ref" "$WORK/s1_stacked" "--ms matches 4 band images (UInt16)"
+$MAKESCENE -o "$WORK/scene1_permuted" --size 1000x700 --type UInt16 --ratio 4 --tiled --blocksize 64 \
+  --compress DEFLATE --ms-bands 2,4,3,1 > /dev/null || exit 1
+stacked "$S1" "$WORK/s1_permuted" "$WORK/scene1_permuted/MS.TIF" $COMMON -j 2 --ms-bands 2,4,3,1
+compare "$WORK/s1_ref" "$WORK/s1_permuted" "--ms with permuted --ms-bands matches 4 band images (UInt16)"
+
+# the library (PansharpenBuffers) on the scene read into memory: packed
+# rasters (the zero-copy path), and strided ones (padded pan rows, 
+# interleaved bands, and multispectral rasters without a geotransform)
+# *********************************************************************
+if $SHARPENBUFFERS "$S1" "$WORK/s1_ref" > "$WORK/s1_buffers.log" 2>&1; then
+  echo "  OK      packed and strided buffers match 1 run (UInt16)"
+else
+  echo "  FAILED  packed and strided buffers (see $WORK/s1_buffers.log)"
+  FAILED=$((FAILED+1))
+fi
+
+# the fused upsampler against the GDAL warper (--no-fused-upsample): 
+# identical inside, and within 2 (rounding of the bilinear fallback of
+# GDAL's cubic kernel) in the border of 2 multispectral pixels, 8 pan
+# pixels, where the bicubic taps leave the image
+# ********************************************************************
+FUSED="-z 4 -w 64 --method fihs,brovey"
+sharpen "$S1" "$WORK/s1_fused" best $FUSED -j 2
+sharpen "$S1" "$WORK/s1_warper" best $FUSED -j 2 --no-fused-upsample
+compare "$WORK/s1_fused" "$WORK/s1_warper" "fused upsampler matches the GDAL warper (UInt16)" .tif \
+  "--border 8 --tolerance 2"
+
+# compare the FIHS and Brovey outputs of a --window run in directory
+# $2 with window $3 (xoff,yoff,xsize,ysize) of the outputs of the whole
+# scene in directory $1, reporting check $4 (the statistics of GS and
+# PCA are those of the window, so they differ)
+# ********************************************************************
+cropped() {
+  REF=$1; OUT=$2; WINDOW=$3; NAME=$4
+  OK=1
+  for METHOD in FIHS Brovey; do
+    if ! $COMPARE --window "$WINDOW" "$REF/sharpened_$METHOD.tif" "$OUT/sharpened_$METHOD.tif"; then OK=0; fi
+  done
+  if [ $OK = 1 ]; then
+    echo "  OK      $NAME"
+  else
+    echo "  FAILED  $NAME"
+    FAILED=$((FAILED+1))
+  fi
+}
+
+# a region of interest (--window), not aligned to the multispectral 
+# grid, against the same crop of the whole scene (fused upsampler)
+# *****************************************************************
+WINDOW=203,151,410,300
+sharpen "$S1" "$WORK/s1_window" best $FUSED -j 2 --window $WINDOW
+cropped "$WORK/s1_fused" "$WORK/s1_window" $WINDOW "--window matches the crop of the scene (UInt16)"
+
+# --resume: a run killed (SIGKILL) once 3 windows are committed, with a
+# checkpoint after every window, then resumed; resumed again after one
+# partial output is deleted, and with other windows (a layout that no 
+# longer matches), both of which must start over
+# ********************************************************************
+interrupt() {
+  OUT=$1; shift
+  mkdir -p "$OUT"
+  env PANSHARPEN_CHECKPOINT_SECONDS=0 PANSHARPEN_KILL_AFTER_COMMITS=3 $PANSHARPEN \
+    -p "$S1/PAN.TIF" -r "$S1/RED.TIF" -g "$S1/GREEN.TIF" -b "$S1/BLUE.TIF" -n "$S1/NIR.TIF" \
+    -o "$OUT" "$@" -j 2 > "$OUT.killed.log" 2>&1
+  COMMITTED=$(tail -n 1 "$OUT/pansharpen.journal" 2> /dev/null | sed -n 's/^committed //p')
+  if [ -z "$COMMITTED" ] || [ "$COMMITTED" -lt 3 ]; then
+    echo "  FAILED  no journal of 3 or more committed windows in $OUT"
+    FAILED=$((FAILED+1))
+  fi
+}
+
+# check that the run in directory $1 went on from $2 committed windows
+# (0: started over), reporting check $3
+# ********************************************************************
+resumed() {
+  OUT=$1; EXPECTED=$2; NAME=$3
+  if grep -q "resume: $EXPECTED of" "$OUT.log" || { [ "$EXPECTED" = 0 ] && ! grep -q "resume:" "$OUT.log"; }; then
+    echo "  OK      $NAME"
+  else
+    echo "  FAILED  $NAME (see $OUT.log)"
+    FAILED=$((FAILED+1))
+  fi
+}
+interrupt "$WORK/s1_resume" $COMMON
+sharpen "$S1" "$WORK/s1_resume" best $COMMON -j 2 --resume
+resumed "$WORK/s1_resume" "$COMMITTED" "--resume goes on from the committed windows"
+compare "$WORK/s1_ref" "$WORK/s1_resume" "resumed outputs match 1 run (UInt16)"
+interrupt "$WORK/s1_missing" $COMMON
+rm -f "$WORK/s1_missing/sharpened_GS.tif.partial"
+sharpen "$S1" "$WORK/s1_missing" best $COMMON -j 2 --resume
+resumed "$WORK/s1_missing" 0 "--resume starts over without a partial output"
+compare "$WORK/s1_ref" "$WORK/s1_missing" "outputs started over match 1 run (UInt16)"
+interrupt "$WORK/s1_relayout" $FUSED
+sharpen "$S1" "$WORK/s1_relayout" best -z 4 -w 128 --method fihs,brovey -j 2 --resume
+resumed "$WORK/s1_relayout" 0 "--resume starts over with other windows"
+compare "$WORK/s1_fused" "$WORK/s1_relayout" "outputs started over match 1 run (UInt16)"
+
+# native output data type: the fixed-point FIHS and Brovey kernels
+# ****************************************************************
+NATIVE="-z 4 -w 64 --method fihs,brovey --ot native"
+sharpen "$S1" "$WORK/s1_native_ref" scalar $NATIVE -j 1
+sharpen "$S1" "$WORK/s1_native" best $NATIVE -j 4 -t 256
+compare "$WORK/s1_native_ref" "$WORK/s1_native" "fixed-point SIMD kernels, tiles, and threads (UInt16)"
+
+# scene 2: Byte, multispectral grid shifted by half a pan pixel (GDAL
+# warper), 3 output bands
+# *******************************************************************
+S2="$WORK/scene2"
+$MAKESCENE -o "$S2" --size 700x500 --type Byte --ratio 2 --shift > /dev/null || exit 1
+COMMON="-z 3 -w 32 --method all"
+sharpen "$S2" "$WORK/s2_ref" scalar $COMMON -j 1
+sharpen "$S2" "$WORK/s2_threads" best $COMMON -j 4
+compare "$WORK/s2_ref" "$WORK/s2_threads" "SIMD kernels and 4 threads match (Byte, warper)"
+WINDOW=0,17,351,200
+sharpen "$S2" "$WORK/s2_window" best -z 3 -w 32 --method fihs,brovey -j 2 --window $WINDOW
+cropped "$WORK/s2_ref" "$WORK/s2_window" $WINDOW "--window matches the crop of the scene (Byte, warper)"
+stacked "$S2" "$WORK/s2_stacked" "$S2/MS.TIF" $COMMON -j 2
+compare "$WORK/s2_ref" "$WORK/s2_stacked" "--ms matches 3 band images (Byte, warper)"
+
+# a batch whose manifest has a line that is not a scene: the line fails
+# (exit status 1), and the valid scenes around it are still sharpened
+# *********************************************************************
+{
+  echo "$S2/PAN.TIF,$S2/RED.TIF,$S2/GREEN.TIF,$S2/BLUE.TIF,$S2/NIR.TIF,$WORK/s2_batch"
+  echo "$S2/PAN.TIF,$S2/RED.TIF,$WORK/s2_batch_invalid"
+} > "$WORK/s2_manifest.csv"
+if $PANSHARPEN --batch "$WORK/s2_manifest.csv" $COMMON -j 2 > "$WORK/s2_batch.log" 2>&1 ||
+   ! grep -q "FAILED  line 2 " "$WORK/s2_batch.log"; then
+  echo "  FAILED  --batch does not report the invalid manifest line (see $WORK/s2_batch.log)"
+  FAILED=$((FAILED+1))
+fi
+compare "$WORK/s2_ref" "$WORK/s2_batch" "--batch goes on past an invalid manifest line (Byte, warper)"
+
+if [ $FAILED -gt 0 ]; then
+  echo "  $FAILED check(s) FAILED (outputs kept in $WORK)"
+  exit 1
+fi
+rm -rf "$WORK"
+echo "  all checks passed"